@@ -0,0 +1,156 @@
+#version 430 core
+
+#define INFINITY pow(2.,8.)
+#define sat(p) clamp(p, 0.0, 1.0)
+#define NO_DERIVATIVES
+
+layout(local_size_x = 8, local_size_y = 8) in;
+
+//========================= Type Definitions =======================
+struct Light {
+    int type;
+    vec3 position;
+    vec3 color;
+};
+
+struct SubSurfaceMaterial {
+    vec3 albedo;
+    
+    float ambient;
+    float depth;
+    float distortion;
+    float power;
+};
+
+struct Material {
+    vec3 albedo;
+
+    float roughness;
+    float metal;
+    float ambientOcclusion;
+
+    bool subsurface;
+    bool emmissive;
+
+    bool trasmit;
+    float transmitAmount;
+};
+
+struct PBRTexture {
+    int layer;
+};
+;
+//========================= END Type Definitions =======================
+
+uniform float fudge;
+uniform float maxDistance;
+uniform int maxIterations;
+
+uniform samplerCube irr;
+uniform samplerCube prefilter;
+
+uniform Light lights[10];
+uniform int numberOfLights;
+
+uniform float time;
+uniform float sceneTime;
+uniform int photonsPerSide;
+uniform vec3 causticCenter;
+uniform float causticExtent;
+
+<<TEXTURES>>
+
+<<SDF_HELPERS>>
+
+<<NOISE>>
+
+float de(vec3 p, out int mid);
+
+<<RAY_TRACE>>
+
+<<MATERIALS>>
+
+<<LIGHTING>>
+
+<<SAMPLING>>
+
+#define PATH_LENGTH 9
+
+<<CAUSTICS>>
+
+<<USER_CODE>>
+
+// Traces one photon from a light and keeps it only if it reaches a diffuse surface after at least one
+// glass or metal bounce; everything else is already found by the path tracer's light sampling.
+void main() {
+    ivec2 id = ivec2(gl_GlobalInvocationID.xy);
+    if(any(greaterThanEqual(id, ivec2(photonsPerSide))) || numberOfLights == 0) return;
+
+    float seed = float(baseHash(uvec2(id)))/float(0xffffffffU) + rand(time);
+
+    int lightIndex = min(int(hash1(seed)*float(numberOfLights)), numberOfLights - 1);
+    Light light = lights[lightIndex];
+
+    vec3 ro, rd, flux;
+    if(light.type == 0) {
+        // sun photons leave a disk perpendicular to the light that covers the caustic region.
+        rd = -normalize(light.position);
+        vec3 uu = normalize(cross(rd, abs(rd.y) > .5 ? vec3(1.,0.,0.) : vec3(0.,1.,0.)));
+        vec3 vv = cross(uu, rd);
+        vec2 disk = randomInUnitDisk(seed)*causticExtent;
+
+        ro = causticCenter + uu*disk.x + vv*disk.y - rd*maxDistance*0.5;
+        flux = light.color*PI*causticExtent*causticExtent;
+    } else {
+        vec2 r = hash2(seed);
+        float y = 2.0*r.x - 1.0;
+        float s = sqrt(max(0.0, 1.0 - y*y));
+
+        ro = light.position;
+        rd = vec3(s*cos(2.0*PI*r.y), y, s*sin(2.0*PI*r.y));
+        // direct lighting gives point lights no falloff, irradiance color at any distance. The sphere a
+        // photon first lands on therefore carries color*4*PI*dist^2, scaled in at the first hit below.
+        flux = light.color*4.0*PI;
+    }
+    flux *= float(numberOfLights)/float(photonsPerSide*photonsPerSide);
+
+    bool specularChain = false;
+    for(int bounce = 0; bounce < PATH_LENGTH; bounce++) {
+        int mid = 0;
+        float dist = sdfs_trace(ro, rd, maxDistance, mid);
+        if(dist >= maxDistance) return;
+        if(bounce == 0 && light.type != 0) flux *= dist*dist;
+
+        vec3 pos = ro + rd*dist;
+        vec3 nor = sdfs_getNormal(pos);
+        Material mat = getMaterial(pos, nor, mid);
+        if(mat.emmissive) return;
+
+        ro = pos;
+        if(mat.trasmit) {
+            // same lobe choice as sdfs_pathtrace, so photons and camera paths agree on the glass.
+            float F = sdfs_fresnelSchlickRoughness(max(0, dot(-nor, rd)), pow(mat.roughness, 4), 0);
+            vec3 wo;
+            if(F < hash1(seed)) {
+                wo = modifyDirectionWithRoughness(refract(rd, nor, 1 / (1.0 + mat.transmitAmount)), pow(mat.roughness, 4), seed);
+                ro += 2*max(0.01, abs(sdfs_getGeometry(ro + wo*0.01)))*wo;
+                flux *= mat.albedo;
+            } else {
+                wo = modifyDirectionWithRoughness(reflect(rd, nor), mat.roughness, seed);
+            }
+            rd = wo;
+            specularChain = true;
+            continue;
+        }
+
+        if(mat.metal >= hash1(seed)) {
+            rd = modifyDirectionWithRoughness(reflect(rd, nor), mat.roughness, seed);
+            flux *= mat.albedo;
+            specularChain = true;
+            continue;
+        }
+
+        if(specularChain) sdfs_depositPhoton(pos, flux, seed);
+        return;
+    }
+}
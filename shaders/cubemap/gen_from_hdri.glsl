@@ -1,8 +1,23 @@
-#version 330 core
-out vec4 FragColor;
-in vec3 WorldPos;
+#version 430 core
+layout(local_size_x = 8, local_size_y = 8) in;
+
+layout(rgba16f, binding = 0) uniform writeonly imageCube cube;
 
 uniform sampler2D equirectangularMap;
+uniform int size;
+
+// Direction through the centre of a texel, z picks the face in GL's cube map layout.
+vec3 cubeDirection(ivec3 id)
+{
+    vec2 uv = 2.0*(vec2(id.xy) + 0.5)/float(size) - 1.0;
+
+    if(id.z == 0) return vec3(1.0, -uv.y, -uv.x);
+    if(id.z == 1) return vec3(-1.0, -uv.y, uv.x);
+    if(id.z == 2) return vec3(uv.x, 1.0, uv.y);
+    if(id.z == 3) return vec3(uv.x, -1.0, -uv.y);
+    if(id.z == 4) return vec3(uv.x, -uv.y, 1.0);
+    return vec3(-uv.x, -uv.y, -1.0);
+}
 
 const vec2 invAtan = vec2(0.1591, 0.3183);
 vec2 SampleSphericalMap(vec3 v)
@@ -15,8 +30,11 @@ vec2 SampleSphericalMap(vec3 v)
 
 void main()
 {
-    vec2 uv = SampleSphericalMap(normalize(WorldPos));
-    vec3 color = texture(equirectangularMap, uv).rgb;
-    
-    FragColor = vec4(color, 1.0);
-}
\ No newline at end of file
+    ivec3 id = ivec3(gl_GlobalInvocationID);
+    if(any(greaterThanEqual(id.xy, ivec2(size)))) return;
+
+    vec2 uv = SampleSphericalMap(normalize(cubeDirection(id)));
+    vec3 color = textureLod(equirectangularMap, uv, 0.0).rgb;
+
+    imageStore(cube, id, vec4(color, 1.0));
+}
@@ -1,12 +1,31 @@
-#version 330 core
-out vec4 FragColor;
-in vec3 WorldPos;
+#version 430 core
+layout(local_size_x = 8, local_size_y = 8) in;
+
+// one level of the prefiltered cube, the faces from firstFace on in a dispatch.
+layout(rgba16f, binding = 0) uniform writeonly imageCube prefiltered;
 
 uniform samplerCube environmentMap;
 uniform float roughness;
+uniform int size;
+uniform float sourceSize;
+uniform int sampleCount;
+uniform int firstFace;
 
 const float PI = 3.14159265359;
 // ----------------------------------------------------------------------------
+// Direction through the centre of a texel, z picks the face in GL's cube map layout.
+vec3 cubeDirection(ivec3 id)
+{
+    vec2 uv = 2.0*(vec2(id.xy) + 0.5)/float(size) - 1.0;
+
+    if(id.z == 0) return vec3(1.0, -uv.y, -uv.x);
+    if(id.z == 1) return vec3(-1.0, -uv.y, uv.x);
+    if(id.z == 2) return vec3(uv.x, 1.0, uv.y);
+    if(id.z == 3) return vec3(uv.x, -1.0, -uv.y);
+    if(id.z == 4) return vec3(uv.x, -uv.y, 1.0);
+    return vec3(-uv.x, -uv.y, -1.0);
+}
+// ----------------------------------------------------------------------------
 float DistributionGGX(vec3 N, vec3 H, float roughness)
 {
     float a = roughness*roughness;
@@ -62,17 +81,29 @@ vec3 ImportanceSampleGGX(vec2 Xi, vec3 N, float roughness)
 }
 // ----------------------------------------------------------------------------
 void main()
-{		
-    vec3 N = normalize(WorldPos);
-    
+{
+    ivec3 id = ivec3(gl_GlobalInvocationID) + ivec3(0, 0, firstFace);
+    if(any(greaterThanEqual(id.xy, ivec2(size)))) return;
+
+    vec3 N = normalize(cubeDirection(id));
+
+    // a mirror is the environment itself, read at the mip whose texels match this level's.
+    if(roughness == 0.0)
+    {
+        imageStore(prefiltered, id, vec4(textureLod(environmentMap, N, log2(sourceSize/float(size))).rgb, 1.0));
+        return;
+    }
+
     // make the simplyfying assumption that V equals R equals the normal 
     vec3 R = N;
     vec3 V = R;
 
-    const uint SAMPLE_COUNT = 1024u;
+    uint SAMPLE_COUNT = uint(sampleCount);
     vec3 prefilteredColor = vec3(0.0);
     float totalWeight = 0.0;
-    
+
+    float saTexel = 4.0 * PI / (6.0 * sourceSize * sourceSize);
+
     for(uint i = 0u; i < SAMPLE_COUNT; ++i)
     {
         // generates a sample vector that's biased towards the preferred alignment direction (importance sampling).
@@ -83,17 +114,15 @@ void main()
         float NdotL = max(dot(N, L), 0.0);
         if(NdotL > 0.0)
         {
-            // sample from the environment's mip level based on roughness/pdf
+            // filtered importance sampling: each sample reads the mip whose texels cover the solid angle
+            // its pdf leaves it, so a few dozen samples do what took a thousand point samples.
             float D   = DistributionGGX(N, H, roughness);
             float NdotH = max(dot(N, H), 0.0);
             float HdotV = max(dot(H, V), 0.0);
             float pdf = D * NdotH / (4.0 * HdotV) + 0.0001; 
 
-            float resolution = 512.0; // resolution of source cubemap (per face)
-            float saTexel  = 4.0 * PI / (6.0 * resolution * resolution);
             float saSample = 1.0 / (float(SAMPLE_COUNT) * pdf + 0.0001);
-
-            float mipLevel = roughness == 0.0 ? 0.0 : 0.5 * log2(saSample / saTexel); 
+            float mipLevel = max(0.5 * log2(saSample / saTexel) + 1.0, 0.0);
             
             prefilteredColor += textureLod(environmentMap, L, mipLevel).rgb * NdotL;
             totalWeight      += NdotL;
@@ -102,5 +131,5 @@ void main()
 
     prefilteredColor = prefilteredColor / totalWeight;
 
-    FragColor = vec4(prefilteredColor, 1.0);
-}
\ No newline at end of file
+    imageStore(prefiltered, id, vec4(prefilteredColor, 1.0));
+}
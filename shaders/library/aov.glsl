@@ -0,0 +1,35 @@
+// ======================== AOV ========================
+// First hit auxiliary outputs written next to the beauty pass. Like the beauty they are sums with the
+// sample count in w, except the material id which is taken from the first sample after a reset.
+vec3 sdfs_aovAlbedo = vec3(0);
+vec3 sdfs_aovNormal = vec3(0);
+float sdfs_aovDepth = 0.0;
+float sdfs_aovMaterial = -1.0;
+
+void sdfs_recordAov(vec3 albedo, vec3 nor, vec3 pos, int mid) {
+    sdfs_aovAlbedo = sat(albedo);
+    sdfs_aovNormal = nor;
+    sdfs_aovDepth = dot(pos - eye, camera[2]);
+    sdfs_aovMaterial = float(mid);
+}
+
+// misses keep the background as albedo so a guided filter does not smear it into the geometry.
+void sdfs_recordAovMiss(vec3 background) {
+    sdfs_aovAlbedo = sat(background);
+    sdfs_aovNormal = vec3(0);
+    sdfs_aovDepth = 0.0;
+    sdfs_aovMaterial = -1.0;
+}
+
+void sdfs_accumulateAov(vec4 lastAlbedo, vec4 lastNormal, vec4 lastData, bool reset, out vec4 albedo, out vec4 normal, out vec4 data) {
+    albedo = vec4(sdfs_aovAlbedo, 1);
+    normal = vec4(sdfs_aovNormal, 1);
+    data = vec4(sdfs_aovDepth, sdfs_aovMaterial, 0, 1);
+
+    if(!reset) {
+        albedo += lastAlbedo;
+        normal += lastNormal;
+        data = vec4(lastData.r + sdfs_aovDepth, lastData.a > 0.0 ? lastData.g : sdfs_aovMaterial, 0, lastData.a + 1.0);
+    }
+}
+// ======================== END AOV ========================
@@ -0,0 +1,41 @@
+// ======================== CAUSTIC PHOTONS ========================
+// Photons that reached a diffuse surface through glass or metal are splatted into a hashed grid
+// of cells whose area matches the current gather radius (pi*r^2), so a cell's flux divided by
+// that area estimates the caustic irradiance around it.
+#define CAUSTIC_STRIDE 3
+#define CAUSTIC_SCALE 100000.0
+
+layout(std430, binding = 2) buffer CausticGridBuffer { uint causticGrid[]; };
+
+uniform int useCaustics;
+uniform int causticCells;
+uniform float causticRadius;
+
+float sdfs_causticCellSize() {
+    return causticRadius*sqrt(PI);
+}
+
+int sdfs_causticCell(vec3 p) {
+    uvec3 c = uvec3(ivec3(floor(p/sdfs_causticCellSize())));
+    return int(baseHash(uvec2(baseHash(c.xy), c.z)) % uint(causticCells));
+}
+
+void sdfs_depositPhoton(vec3 p, vec3 flux, inout float seed) {
+    int base = sdfs_causticCell(p)*CAUSTIC_STRIDE;
+
+    // dither the fixed point conversion so small photons are not rounded away.
+    uvec3 amount = uvec3(flux*CAUSTIC_SCALE + hash1(seed));
+    if(amount.r > 0u) atomicAdd(causticGrid[base], amount.r);
+    if(amount.g > 0u) atomicAdd(causticGrid[base + 1], amount.g);
+    if(amount.b > 0u) atomicAdd(causticGrid[base + 2], amount.b);
+}
+
+vec3 sdfs_gatherCaustics(vec3 p, inout float seed) {
+    // jittering the lookup by a cell blurs the grid structure away over the passes.
+    vec3 jitter = (hash3(seed) - 0.5)*sdfs_causticCellSize();
+    int base = sdfs_causticCell(p + jitter)*CAUSTIC_STRIDE;
+
+    vec3 flux = vec3(causticGrid[base], causticGrid[base + 1], causticGrid[base + 2])/CAUSTIC_SCALE;
+    return flux/(PI*causticRadius*causticRadius);
+}
+// ======================== END CAUSTIC PHOTONS ========================
@@ -1,5 +1,15 @@
 // ==================== MATERIAL FUNCTIONS ===============================
 
+// What the caller needs from getMaterial. Bounce queries are indirect hits, where normal maps can't be
+// told apart, and shadow queries only look at whether light passes through. A footprint above 0 is
+// the world space width of the ray at the hit and picks the mip level instead of derivatives.
+#define MATERIAL_FULL 0
+#define MATERIAL_BOUNCE 1
+#define MATERIAL_SHADOW 2
+
+int materialQuery = MATERIAL_FULL;
+float materialFootprint = 0.0;
+
 vec4 textureTriPlannar(sampler2D s, vec3 p, vec3 n) {
     vec3 m = pow(abs(n), vec3(100.0));
 
@@ -10,6 +20,35 @@ vec4 textureTriPlannar(sampler2D s, vec3 p, vec3 n) {
     return (x + y + z)/(m.x + m.y + m.z);
 }
 
+// Axes whose blend weight is negligible are skipped, most hits only need one of the three fetches.
+// Derivatives are taken before any branch and handed to textureGrad, since neighbouring pixels may skip
+// different axes and implicit derivatives are undefined there. Compute kernels have no derivatives and
+// define NO_DERIVATIVES, they sample the top level as texture() would.
+vec4 textureTriPlannar(sampler2DArray s, int layer, vec3 p, vec3 n) {
+    vec3 m = pow(abs(n), vec3(100.0));
+    m *= step(vec3(0.001), m/(m.x + m.y + m.z));
+
+#ifdef NO_DERIVATIVES
+    vec3 dx = vec3(0.0), dy = vec3(0.0);
+#else
+    vec3 dx = dFdx(p), dy = dFdy(p);
+#endif
+
+    vec4 c = vec4(0.0);
+    if (materialFootprint > 0.0) {
+        float lod = max(0.0, log2(materialFootprint*float(textureSize(s, 0).x)));
+        if (m.x > 0.0) c += textureLod(s, vec3(p.yz, layer), lod)*m.x;
+        if (m.y > 0.0) c += textureLod(s, vec3(p.xz, layer), lod)*m.y;
+        if (m.z > 0.0) c += textureLod(s, vec3(p.xy, layer), lod)*m.z;
+    } else {
+        if (m.x > 0.0) c += textureGrad(s, vec3(p.yz, layer), dx.yz, dy.yz)*m.x;
+        if (m.y > 0.0) c += textureGrad(s, vec3(p.xz, layer), dx.xz, dy.xz)*m.y;
+        if (m.z > 0.0) c += textureGrad(s, vec3(p.xy, layer), dx.xy, dy.xy)*m.z;
+    }
+
+    return c/(m.x + m.y + m.z);
+}
+
 #define pToUv(p, n, uv) (uv(p.yz)*(pow(abs(n.x), 10.0)) + uv(p.xz)*(pow(abs(n.y), 10.0)) + uv(p.xy)*(pow(abs(n.z), 10.0)))/(pow(abs(n.x), 10.0) + pow(abs(n.y), 10.0) + pow(abs(n.z), 10.0))
 #define getSDFNormal(p, sdf) normalize(vec3(sdf(p + vec3(0.001, 0, 0)) - sdf(p - vec3(0.001, 0, 0)), sdf(p + vec3(0, 0.001, 0)) - sdf(p - vec3(0, 0.001, 0)), sdf(p + vec3(0, 0, 0.001)) - sdf(p - vec3(0, 0, 0.001))))
 
@@ -24,15 +63,23 @@ vec3 getNormalBump(vec3 p, vec3 n, vec3 bump) {
 }
 
 Material applyPBRTexture(vec3 position, inout vec3 normal, PBRTexture pbr) {
-    vec3 alb = textureTriPlannar(pbr.albedo, position, normal).rgb;
-    float rough = textureTriPlannar(pbr.roughness, position, normal).r;
-    float occ = textureTriPlannar(pbr.ambientOcclusion, position, normal).r;
-    float met = textureTriPlannar(pbr.metal, position, normal).r;
+    // textured materials never transmit, which is all a shadow ray asks.
+    if (materialQuery == MATERIAL_SHADOW) return Material(vec3(0), 1, 0, 1, false, false, false, 0);
+
+    vec3 alb = textureTriPlannar(materialAlbedo, pbr.layer, position, normal).rgb;
+    vec3 surface = textureTriPlannar(materialSurface, pbr.layer, position, normal).rgb;
 
-    vec3 nor = textureTriPlannar(pbr.normal, position, normal).rgb;
-    normal = getNormalBump(position, normal, nor);
+    if (materialQuery == MATERIAL_FULL) {
+        // the BC5 normal array only keeps x and y.
+        vec3 nor = textureTriPlannar(materialNormal, pbr.layer, position, normal).rgb;
+        if (nor.b == 0.0) {
+            vec2 xy = nor.rg*2.0 - 1.0;
+            nor.b = sqrt(clamp(1.0 - dot(xy, xy), 0.0, 1.0))*0.5 + 0.5;
+        }
+        normal = getNormalBump(position, normal, nor);
+    }
 
-    return Material(alb*alb, rough, met, occ, false, false, false, 0);
+    return Material(alb*alb, surface.r, surface.g, surface.b, false, false, false, 0);
 }
 
 Material createHardMaterial(vec3 alb, float roughness, float metal) {
@@ -49,4 +96,19 @@ Material createTrasmittionMaterial(vec3 alb, float roughness, float trasmit) {
 
 Material getMaterial(vec3 p, inout vec3 n, int mid);
 SubSurfaceMaterial getSubsurfaceMaterial(Material m, int mid);
+
+Material queryMaterial(vec3 p, inout vec3 n, int mid, int query, float footprint) {
+    materialQuery = query;
+    materialFootprint = footprint;
+    Material m = getMaterial(p, n, mid);
+
+    materialQuery = MATERIAL_FULL;
+    materialFootprint = 0.0;
+    return m;
+}
+
+// Ray cone spread after a bounce: glossy lobes widen it by their roughness, diffuse ones open it up.
+float bounceSpread(float spread, float roughness, bool diffuse) {
+    return diffuse ? max(spread, 1.0) : spread + roughness;
+}
 // ==================== END MATERIAL FUNCTIONS ==========================
\ No newline at end of file
@@ -0,0 +1,105 @@
+// ======================== PATH GUIDING ========================
+// Each grid cell holds an equal-area (cos theta, phi) histogram of incoming radiance plus its total.
+#define GUIDE_BINS_THETA 8
+#define GUIDE_BINS_PHI 8
+#define GUIDE_BINS (GUIDE_BINS_THETA*GUIDE_BINS_PHI)
+#define GUIDE_STRIDE (GUIDE_BINS + 1)
+#define GUIDE_SCALE 64.0
+#define GUIDE_MAX_RADIANCE 64.0
+#define GUIDE_MIN_TOTAL 256u
+
+layout(std430, binding = 0) readonly buffer GuideSampleBuffer { uint guideSample[]; };
+layout(std430, binding = 1) buffer GuideTrainBuffer { uint guideTrain[]; };
+
+uniform int useGuide;
+uniform int trainGuide;
+uniform int guideCells;
+uniform float guideCellSize;
+uniform float guideFraction;
+
+int sdfs_guideVertices = 0;
+int sdfs_guideVertexCell[PATH_LENGTH];
+int sdfs_guideVertexBin[PATH_LENGTH];
+float sdfs_guideVertexPdf[PATH_LENGTH];
+vec3 sdfs_guideVertexCol[PATH_LENGTH];
+vec3 sdfs_guideVertexSig[PATH_LENGTH];
+
+int sdfs_guideCell(vec3 p) {
+    uvec3 c = uvec3(ivec3(floor(p/guideCellSize)));
+    return int(baseHash(uvec2(baseHash(c.xy), c.z)) % uint(guideCells));
+}
+
+int sdfs_guideBin(vec3 d) {
+    float u = clamp(d.y*0.5 + 0.5, 0.0, 0.9999);
+    float v = fract(atan(d.z, d.x)/(2.0*PI) + 1.0);
+    return int(u*GUIDE_BINS_THETA)*GUIDE_BINS_PHI + min(int(v*GUIDE_BINS_PHI), GUIDE_BINS_PHI - 1);
+}
+
+vec3 sdfs_guideBinDirection(int bin, vec2 r) {
+    float y = 2.0*(float(bin/GUIDE_BINS_PHI) + r.x)/float(GUIDE_BINS_THETA) - 1.0;
+    float phi = 2.0*PI*(float(bin%GUIDE_BINS_PHI) + r.y)/float(GUIDE_BINS_PHI);
+    float s = sqrt(max(0.0, 1.0 - y*y));
+
+    return vec3(s*cos(phi), y, s*sin(phi));
+}
+
+bool sdfs_guideReady(int cell) {
+    return useGuide == 1 && guideSample[cell*GUIDE_STRIDE + GUIDE_BINS] >= GUIDE_MIN_TOTAL;
+}
+
+// every bin covers 4*PI/GUIDE_BINS steradians, so the pdf is piecewise constant.
+float sdfs_guidePdf(int cell, vec3 d) {
+    float total = float(guideSample[cell*GUIDE_STRIDE + GUIDE_BINS]);
+    float count = float(guideSample[cell*GUIDE_STRIDE + sdfs_guideBin(d)]);
+
+    return count/total*float(GUIDE_BINS)/(4.0*PI);
+}
+
+vec3 sdfs_sampleGuide(int cell, inout float seed) {
+    uint target = uint(hash1(seed)*float(guideSample[cell*GUIDE_STRIDE + GUIDE_BINS]));
+    uint running = 0u;
+    int bin = GUIDE_BINS - 1;
+
+    for(int i = 0; i < GUIDE_BINS; i++) {
+        running += guideSample[cell*GUIDE_STRIDE + i];
+        if(running > target) {
+            bin = i;
+            break;
+        }
+    }
+
+    return sdfs_guideBinDirection(bin, hash2(seed));
+}
+
+void sdfs_recordGuideVertex(int cell, vec3 wo, vec3 col, vec3 sig, float pdf) {
+    if(trainGuide == 0 || sdfs_guideVertices >= PATH_LENGTH) return;
+
+    sdfs_guideVertexCell[sdfs_guideVertices] = cell;
+    sdfs_guideVertexBin[sdfs_guideVertices] = sdfs_guideBin(wo);
+    sdfs_guideVertexPdf[sdfs_guideVertices] = pdf;
+    sdfs_guideVertexCol[sdfs_guideVertices] = col;
+    sdfs_guideVertexSig[sdfs_guideVertices] = sig;
+    sdfs_guideVertices++;
+}
+
+// once the path is done, the radiance that arrived at each recorded vertex is whatever was
+// gathered after it divided by the throughput it was carried with.
+void sdfs_trainGuide(vec3 col) {
+    if(trainGuide == 0) return;
+
+    for(int i = 0; i < PATH_LENGTH; i++) {
+        if(i >= sdfs_guideVertices) break;
+
+        vec3 li = max(col - sdfs_guideVertexCol[i], vec3(0))/max(sdfs_guideVertexSig[i], vec3(0.0001));
+        float lum = dot(li, vec3(0.2126, 0.7152, 0.0722));
+        float weight = min(lum/max(sdfs_guideVertexPdf[i]*4.0*PI, 0.05), GUIDE_MAX_RADIANCE);
+
+        uint amount = uint(weight*GUIDE_SCALE);
+        if(amount == 0u) continue;
+
+        int base = sdfs_guideVertexCell[i]*GUIDE_STRIDE;
+        atomicAdd(guideTrain[base + sdfs_guideVertexBin[i]], amount);
+        atomicAdd(guideTrain[base + GUIDE_BINS], amount);
+    }
+}
+// ======================== END PATH GUIDING ========================
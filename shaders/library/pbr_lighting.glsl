@@ -1,4 +1,23 @@
 // ==================== LIGHTING ==================================
+uniform vec3 irradianceSH[9];
+uniform int useIrradianceSH;
+
+// diffuse irradiance over pi, from the environment's spherical harmonics or its convolved cube map.
+vec3 sdfs_irradiance(vec3 n) {
+    if(useIrradianceSH == 0) return texture(irr, n).rgb;
+
+    vec3 e = irradianceSH[0]*0.282095
+        + irradianceSH[1]*0.488603*n.y
+        + irradianceSH[2]*0.488603*n.z
+        + irradianceSH[3]*0.488603*n.x
+        + irradianceSH[4]*1.092548*n.x*n.y
+        + irradianceSH[5]*1.092548*n.y*n.z
+        + irradianceSH[6]*0.315392*(3.0*n.z*n.z - 1.0)
+        + irradianceSH[7]*1.092548*n.x*n.z
+        + irradianceSH[8]*0.546274*(n.x*n.x - n.y*n.y);
+    return max(e, vec3(0.0));
+}
+
 vec3 sdfs_getDirectLighting(vec3 n, vec3 l, vec3 rd,
          Material material, float sha, vec3 lc) {
     
@@ -80,7 +99,7 @@ vec3 sdfs_getIndirectLighting(vec3 n, vec3 rd, vec3 rf,
     vec3 f = mix(vec3(0.05), material.albedo, material.metal);
     vec3 F = f + (max(vec3(1.0 - material.roughness), f) - f)*pow(1.0 - nov, 5.0);
 
-    vec3 i = texture(irr, n).rgb;
+    vec3 i = sdfs_irradiance(n);
     vec3 dif = i*(1.0 - F)*(1.0 - material.metal)*material.albedo;
 
     vec2 ab = texture(brdf, vec2(nov, material.roughness)).rg;
@@ -0,0 +1,41 @@
+// =================== LIGHT TRACING BRDF FUNCTIONS ========================
+vec3 cosWeightedRandomHemisphereDirection( const vec3 n, inout float seed ) {
+  	vec2 r = hash2(seed);
+    
+	vec3  uu = normalize(cross(n, abs(n.y) > .5 ? vec3(1.,0.,0.) : vec3(0.,1.,0.)));
+	vec3  vv = cross(uu, n);
+	
+	float ra = sqrt(r.y);
+	float rx = ra*cos(6.2831*r.x); 
+	float ry = ra*sin(6.2831*r.x);
+	float rz = sqrt( abs(1.0-r.y) );
+	vec3  rr = vec3( rx*uu + ry*vv + rz*n );
+    
+    return normalize(rr);
+}
+
+vec3 modifyDirectionWithRoughness( const vec3 n, const float roughness, inout float seed) {
+  	vec2 r = hash2(seed);
+    
+	vec3  uu = normalize(cross(n, abs(n.y) > .5 ? vec3(1.,0.,0.) : vec3(0.,1.,0.)));
+	vec3  vv = cross(uu, n);
+	
+    float a = roughness*roughness*roughness*roughness;
+    
+	float rz = sqrt(abs((1.0-r.y) / clamp(1.+(a - 1.)*r.y,.00001,1.)));
+	float ra = sqrt(abs(1.-rz*rz));
+	float rx = ra*cos(2*PI*r.x); 
+	float ry = ra*sin(2*PI*r.x);
+	vec3  rr = vec3( rx*uu + ry*vv + rz*n );
+    
+    return normalize(rr);
+}
+
+vec2 randomInUnitDisk(inout float seed) {
+    vec2 h = hash2(seed) * vec2(1.,2*PI);
+    float phi = h.y;
+    float r = sqrt(h.x);
+	return r*vec2(sin(phi),cos(phi));
+}
+
+// =================== END LIGHT TRACING BRDF FUNCTIONS ========================
\ No newline at end of file
@@ -0,0 +1,34 @@
+#version 430 core
+
+in vec2 tex;
+layout(location = 0) out vec4 out_albedo;
+layout(location = 1) out vec4 out_surface;   // r: roughness, g: metal, b: ambient occlusion
+layout(location = 2) out vec4 out_normal;
+
+uniform sampler2D albedo;
+uniform sampler2D roughness;
+uniform sampler2D metal;
+uniform sampler2D ambientOcclusion;
+uniform sampler2D normal;
+uniform int present;
+
+vec4 sampleOr(sampler2D s, int bit, vec4 fallback) {
+    return (present & (1 << bit)) != 0 ? texture(s, tex) : fallback;
+}
+
+void main() {
+    out_albedo = vec4(sampleOr(albedo, 0, vec4(0.5)).rgb, 1.0);
+    out_surface = vec4(
+        sampleOr(roughness, 1, vec4(0.5)).r,
+        sampleOr(metal, 2, vec4(0.0)).r,
+        sampleOr(ambientOcclusion, 3, vec4(1.0)).r,
+        1.0);
+    // BC5 normal maps only keep x and y, z is rebuilt from them.
+    vec3 n = sampleOr(normal, 4, vec4(0.5, 0.5, 1.0, 1.0)).rgb;
+    if (n.b == 0.0) {
+        vec2 xy = n.rg*2.0 - 1.0;
+        n.b = sqrt(clamp(1.0 - dot(xy, xy), 0.0, 1.0))*0.5 + 0.5;
+    }
+
+    out_normal = vec4(n, 1.0);
+}
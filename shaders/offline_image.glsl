@@ -6,12 +6,39 @@ out vec4 out_fragColor;
 uniform float exposure;
 uniform sampler2D lastPass;
 
+// 0 is the beauty pass, otherwise one of the auxiliary outputs (albedo, normal, depth, material id).
+uniform int aov;
+uniform sampler2D aovPass;
+uniform float maxDistance;
+
+// side by side preview, right of comparePosition shows comparePass (the denoised beauty), off when negative.
+uniform sampler2D comparePass;
+uniform float comparePosition;
+
+vec3 materialColor(float id) {
+    if(id < 0.0) return vec3(0);
+    return fract(sin(vec3(id + 1.0)*vec3(12.9898, 78.233, 45.164))*43758.5453);
+}
+
 void main() {
-    vec4 data = texture(lastPass, tex);
+    bool compare = comparePosition >= 0.0 && tex.x > comparePosition;
+    vec4 data = compare ? texture(comparePass, tex) : texture(lastPass, tex);
     vec3 col = data.rgb/data.a;
 
-    col = 1.0 - exp(-exposure*col);
-    col = pow(abs(col), vec3(1.0/2.2));
+    if(aov == 0) {
+        col = 1.0 - exp(-exposure*col);
+        col = pow(abs(col), vec3(1.0/2.2));
+
+        if(comparePosition >= 0.0 && abs(tex.x - comparePosition) < 0.001) col = vec3(1);
+    } else {
+        data = texture(aovPass, tex);
+        float samples = max(data.a, 1.0);
+
+        if(aov == 1) col = data.rgb/samples;
+        else if(aov == 2) col = length(data.rgb) > 0.0 ? normalize(data.rgb)*0.5 + 0.5 : vec3(0);
+        else if(aov == 3) col = vec3(data.r > 0.0 ? 1.0 - clamp(data.r/samples/maxDistance, 0.0, 1.0) : 0.0);
+        else col = materialColor(data.g);
+    }
 
     out_fragColor = vec4(col, 1.0);
-}
\ No newline at end of file
+}
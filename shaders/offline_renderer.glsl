@@ -1,10 +1,13 @@
-#version 330 core
+#version 430 core
 
 #define INFINITY pow(2.,8.)
 #define sat(p) clamp(p, 0.0, 1.0)
 
 in vec2 tex;
-out vec4 out_fragColor;
+layout(location = 0) out vec4 out_fragColor;
+layout(location = 1) out vec4 out_albedo;
+layout(location = 2) out vec4 out_normal;
+layout(location = 3) out vec4 out_data;
 
 //========================= Type Definitions =======================
 struct Light {
@@ -37,12 +40,7 @@ struct Material {
 };
 
 struct PBRTexture {
-    sampler2D albedo;
-    sampler2D roughness;
-    sampler2D metal;
-    sampler2D normal;
-    sampler2D ambientOcclusion;
-    sampler2D height;
+    int layer;
 };
 ;
 //========================= END Type Definitions =======================
@@ -66,10 +64,19 @@ uniform Light lights[10];
 uniform int numberOfLights;
 
 uniform sampler2D lastPass;
+uniform sampler2D lastAlbedo;
+uniform sampler2D lastNormal;
+uniform sampler2D lastData;
 uniform float time;
+uniform float sceneTime;
 uniform float dof;
 uniform int shouldReset;
 
+// tiled renders draw a sub rectangle of a larger image, resolution is then the size of the tile target.
+uniform vec2 tileOffset;
+uniform vec2 fullResolution;
+uniform float focusDistance;
+
 <<TEXTURES>>
 
 <<SDF_HELPERS>>
@@ -84,54 +91,23 @@ float de(vec3 p, out int mid);
 
 <<LIGHTING>>
 
-// =================== LIGHT TRACING BRDF FUNCTIONS ========================
-vec3 cosWeightedRandomHemisphereDirection( const vec3 n, inout float seed ) {
-  	vec2 r = hash2(seed);
-    
-	vec3  uu = normalize(cross(n, abs(n.y) > .5 ? vec3(1.,0.,0.) : vec3(0.,1.,0.)));
-	vec3  vv = cross(uu, n);
-	
-	float ra = sqrt(r.y);
-	float rx = ra*cos(6.2831*r.x); 
-	float ry = ra*sin(6.2831*r.x);
-	float rz = sqrt( abs(1.0-r.y) );
-	vec3  rr = vec3( rx*uu + ry*vv + rz*n );
-    
-    return normalize(rr);
-}
-
-vec3 modifyDirectionWithRoughness( const vec3 n, const float roughness, inout float seed) {
-  	vec2 r = hash2(seed);
-    
-	vec3  uu = normalize(cross(n, abs(n.y) > .5 ? vec3(1.,0.,0.) : vec3(0.,1.,0.)));
-	vec3  vv = cross(uu, n);
-	
-    float a = roughness*roughness*roughness*roughness;
-    
-	float rz = sqrt(abs((1.0-r.y) / clamp(1.+(a - 1.)*r.y,.00001,1.)));
-	float ra = sqrt(abs(1.-rz*rz));
-	float rx = ra*cos(2*PI*r.x); 
-	float ry = ra*sin(2*PI*r.x);
-	vec3  rr = vec3( rx*uu + ry*vv + rz*n );
-    
-    return normalize(rr);
-}
-
-vec2 randomInUnitDisk(inout float seed) {
-    vec2 h = hash2(seed) * vec2(1.,2*PI);
-    float phi = h.y;
-    float r = sqrt(h.x);
-	return r*vec2(sin(phi),cos(phi));
-}
+<<SAMPLING>>
 
-// =================== END LIGHT TRACING BRDF FUNCTIONS ========================
 // TODO: This should be a uniform.
 #define PATH_LENGTH 9
 
-vec3 sdfs_pathtrace(vec3 ro, vec3 rd, inout float seed) {
+<<PATH_GUIDE>>
+
+<<CAUSTICS>>
+
+<<AOV>>
+
+// spread is the angle one pixel covers, the ray cone it starts grows along the path and picks texture mips.
+vec3 sdfs_pathtrace(vec3 ro, vec3 rd, inout float seed, float spread) {
     vec3 sig = vec3(1);
     vec3 col = vec3(0);
     bool isBackground = true;
+    float cone = 0.0;
 
     for(int bounce = 0; bounce < PATH_LENGTH; bounce++) {
         int mid = 0;
@@ -141,11 +117,13 @@ vec3 sdfs_pathtrace(vec3 ro, vec3 rd, inout float seed) {
             isBackground = false;
             vec3 pos = ro + rd*dist;
             vec3 nor = sdfs_getNormal(pos);
-            Material mat = getMaterial(pos, nor, mid);
+            cone += dist*spread;
+            Material mat = queryMaterial(pos, nor, mid, bounce == 0 ? MATERIAL_FULL : MATERIAL_BOUNCE, cone);
+            if (bounce == 0) sdfs_recordAov(mat.albedo, nor, pos, mid);
 
             if (mat.emmissive) {
                 col += sig*mat.albedo;
-                return col;
+                break;
             }
 
             vec3 f0 = mix(vec3(0.04), mat.albedo, mat.metal);
@@ -178,9 +156,10 @@ vec3 sdfs_pathtrace(vec3 ro, vec3 rd, inout float seed) {
                     if (hitDist < lightDist) {
                         vec3 hitPos = pos+nor*0.01 + lightDirection*hitDist;
                         vec3 hitNor = sdfs_getNormal(hitPos);
-                        Material hitM = getMaterial(hitPos, hitNor, hitId);
+                        Material hitM = queryMaterial(hitPos, hitNor, hitId, MATERIAL_SHADOW, 0.0);
 
-                        if (hitM.trasmit) {
+                        // with caustic photons the light through glass is gathered from the photon grid instead.
+                        if (hitM.trasmit && useCaustics == 0) {
                             sha = clamp(dot(-lightDirection, hitNor) - pow(hitM.roughness, 4), 0, 1)*hitM.albedo;
                         } else {
                             sha = vec3(0.0);
@@ -192,6 +171,10 @@ vec3 sdfs_pathtrace(vec3 ro, vec3 rd, inout float seed) {
                 }
             }
 
+            if (useCaustics == 1 && !mat.trasmit) {
+                col += sig*sdfs_computeDirectDiffuseLighting(nor, rd, nor, mat)*sdfs_gatherCaustics(pos, seed);
+            }
+
             ro = pos;
             if (mat.trasmit) {
                 //sig *= mat.albedo*mat.ambientOcclusion;
@@ -201,9 +184,11 @@ vec3 sdfs_pathtrace(vec3 ro, vec3 rd, inout float seed) {
                     wo = modifyDirectionWithRoughness(refract(rd, nor, 1 / (1.0 + mat.transmitAmount)), pow(mat.roughness, 4), seed);
                     ro += 2*max(0.01, abs(sdfs_getGeometry(ro + wo*0.01)))*wo;
                     sig *= mat.albedo;
+                    spread = bounceSpread(spread, pow(mat.roughness, 4), false);
                 } else {
                     wo = modifyDirectionWithRoughness(reflect(rd, nor), mat.roughness, seed);
                     sig *= clamp(sdfs_computeDirectSpecularLighting(nor, rd, wo, mat), 0, 1);
+                    spread = bounceSpread(spread, mat.roughness, false);
                 }
                 rd = wo;
                 continue;
@@ -216,27 +201,43 @@ vec3 sdfs_pathtrace(vec3 ro, vec3 rd, inout float seed) {
                 vec3 wo = modifyDirectionWithRoughness(reflect(rd, nor), mat.roughness, seed);
                 sig *= clamp(sdfs_computeDirectSpecularLighting(nor, rd, wo, mat), 0, 1);
                 sig *= mix(vec3(1), mat.albedo, mat.metal);
+                spread = bounceSpread(spread, mat.roughness, false);
                 rd = wo;
                 continue;
             } 
 
             // if we get here, that means we have a simple diffuse brdf to handle.
-            vec3 wo = cosWeightedRandomHemisphereDirection(nor, seed);
-            sig *= sdfs_computeDirectDiffuseLighting(nor, rd, wo, mat);
+            int cell = useGuide == 1 || trainGuide == 1 ? sdfs_guideCell(pos) : 0;
+            bool guided = sdfs_guideReady(cell);
+            vec3 wo = guided && hash1(seed) < guideFraction
+                ? sdfs_sampleGuide(cell, seed)
+                : cosWeightedRandomHemisphereDirection(nor, seed);
+
+            // one-sample MIS between the cosine lobe and the learned distribution, weighted
+            // relative to the cosine pdf so unguided paths carry exactly what they did before.
+            float cosPdf = max(0.0, dot(nor, wo))/PI;
+            float pdf = guided ? mix(cosPdf, sdfs_guidePdf(cell, wo), guideFraction) : cosPdf;
+            sig *= sdfs_computeDirectDiffuseLighting(nor, rd, wo, mat)*(pdf > 0.0 ? cosPdf/pdf : 0.0);
+
+            sdfs_recordGuideVertex(cell, wo, col, sig, pdf);
+            spread = bounceSpread(spread, mat.roughness, true);
             rd = wo;
         } else {
             if (hasEnvMap == 1) {
                 if (isBackground) {
-                    return useIrr == 1
-                        ? texture(irr, rd).rgb
+                    vec3 background = useIrr == 1
+                        ? sdfs_irradiance(rd)
                         : textureLod(prefilter, rd, 0).rgb;
+                    sdfs_recordAovMiss(background);
+                    return background;
                 }
                 col += sig*(1.0 - exp(-envExp*textureLod(prefilter, rd, 0).rgb));
             }
-            return col;
+            break;
         }
     }
 
+    sdfs_trainGuide(col);
     return col;
 }
 
@@ -252,19 +253,22 @@ mat3 setCamera( in vec3 ro, in vec3 ta ) {
 
 void main() {
     vec2 fragCoord = gl_FragCoord.xy/resolution;
-    vec2 uv = (2.0*gl_FragCoord.xy - resolution)/resolution.y;
+    vec2 pixel = gl_FragCoord.xy + tileOffset;
+    vec2 uv = (2.0*pixel - fullResolution)/fullResolution.y;
 
     float seed = float(baseHash(floatBitsToUint(uv)))/float(0xffffffffU) + rand(time);
 
-    uv += 2.0*hash2(seed)/resolution.y;
+    uv += 2.0*hash2(seed)/fullResolution.y;
     vec3 rd = camera*normalize(vec3(uv, fov));
 
-    float focusPlane = texture(lastPass, vec2(0)).r;
-    if(all(equal(ivec2(gl_FragCoord.xy), ivec2(0)))) {
+    // without a given focus distance the first pixel measures it and keeps it for the next passes.
+    float focusPlane = focusDistance >= 0.0 ? focusDistance : texture(lastPass, vec2(0)).r;
+    if(focusDistance < 0.0 && all(equal(ivec2(gl_FragCoord.xy), ivec2(0)))) {
         // Calculate focus plane and store distance.
         mat3 cam = setCamera(eye, vec3(0));
         float nfpd = sdfs_trace(eye, normalize(cam*vec3(0, 0, fov)), maxDistance);
 		out_fragColor = vec4(vec3(nfpd), 1);
+        out_albedo = out_normal = out_data = vec4(0);
         return;
     }
 
@@ -272,10 +276,12 @@ void main() {
     vec3 ro = eye + camera*vec3(randomInUnitDisk(seed), 0)*dof;
     rd = normalize(fp - ro);
 
-    vec4 col = vec4(sdfs_pathtrace(ro, rd, seed), 1);
+    vec4 col = vec4(sdfs_pathtrace(ro, rd, seed, 2.0/(fullResolution.y*fov)), 1);
 
     if(shouldReset == 0)
         col += texture(lastPass, fragCoord);
     
     out_fragColor = col;
+    sdfs_accumulateAov(texture(lastAlbedo, fragCoord), texture(lastNormal, fragCoord), texture(lastData, fragCoord),
+        shouldReset == 1, out_albedo, out_normal, out_data);
 }
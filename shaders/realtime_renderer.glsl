@@ -39,12 +39,7 @@ struct Material {
 };
 
 struct PBRTexture {
-    sampler2D albedo;
-    sampler2D roughness;
-    sampler2D metal;
-    sampler2D normal;
-    sampler2D ambientOcclusion;
-    sampler2D height;
+    int layer;
 };
 ;
 //========================= END Type Definitions =======================
@@ -62,6 +57,7 @@ uniform int maxIterations;
 uniform int useDebugPlane;
 uniform float debugPlaneHeight;
 uniform int showRayMarchAmount;
+uniform float sceneTime;
 
 uniform samplerCube irr;
 uniform samplerCube prefilter;
@@ -92,7 +88,7 @@ float de(vec3 p, out int mid);
 // ==================== MAIN RENDER =====================================
 vec3 sdfs_render(vec3 rayOrigin, vec3 rayDirection) {
     vec3 pixelColor = useIrr == 1
-        ? texture(irr, rayDirection).rgb
+        ? sdfs_irradiance(rayDirection)
         : textureLod(prefilter, rayDirection, 0).rgb;
 
     vec3 transmitMask = vec3(1);
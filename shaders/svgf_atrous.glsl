@@ -0,0 +1,88 @@
+#version 430 core
+
+in vec2 tex;
+out vec4 out_fragColor;
+
+uniform vec2 resolution;
+uniform int stepSize;
+uniform int finalPass;
+
+uniform sampler2D colorPass;     // rgb: illumination, a: variance
+uniform sampler2D albedoPass;
+uniform sampler2D normalPass;
+uniform sampler2D dataPass;
+
+uniform float colorPhi;
+uniform float normalPhi;
+uniform float depthPhi;
+
+float luminance(vec3 c) {
+    return dot(c, vec3(0.2126, 0.7152, 0.0722));
+}
+
+// 3x3 gaussian of the variance, the luminance weight is much more stable with it.
+float filteredVariance(ivec2 p) {
+    const float kernel[2] = float[2](0.5, 0.25);
+    float variance = 0.0;
+    for(int y = -1; y <= 1; y++) {
+        for(int x = -1; x <= 1; x++) {
+            ivec2 q = clamp(p + ivec2(x, y), ivec2(0), ivec2(resolution) - 1);
+            variance += texelFetch(colorPass, q, 0).a*kernel[abs(x)]*kernel[abs(y)];
+        }
+    }
+
+    return variance;
+}
+
+// One level of the edge-avoiding a-trous wavelet, weighted by luminance against the local variance,
+// normal, depth and material id. The final level puts the albedo back for display.
+void main() {
+    const float kernel[3] = float[3](3.0/8.0, 1.0/4.0, 1.0/16.0);
+
+    ivec2 p = ivec2(gl_FragCoord.xy);
+    vec4 center = texelFetch(colorPass, p, 0);
+    vec4 data = texelFetch(dataPass, p, 0);
+    vec3 nor = texelFetch(normalPass, p, 0).xyz;
+    float depth = data.r/max(data.a, 1.0);
+    float lum = luminance(center.rgb);
+    float sigmaL = colorPhi*sqrt(max(0.0, filteredVariance(p))) + 1e-4;
+
+    vec3 sum = center.rgb;
+    float variance = center.a;
+    float weights = 1.0;
+
+    for(int y = -2; y <= 2; y++) {
+        for(int x = -2; x <= 2; x++) {
+            if(x == 0 && y == 0) continue;
+
+            ivec2 q = p + ivec2(x, y)*stepSize;
+            if(any(lessThan(q, ivec2(0))) || any(greaterThanEqual(q, ivec2(resolution)))) continue;
+
+            vec4 c = texelFetch(colorPass, q, 0);
+            vec4 d = texelFetch(dataPass, q, 0);
+            if(d.g != data.g) continue;
+
+            float dq = d.r/max(d.a, 1.0);
+            float wn = length(nor) > 0.0
+                ? pow(max(0.0, dot(normalize(nor), normalize(texelFetch(normalPass, q, 0).xyz))), normalPhi)
+                : 1.0;
+            float wz = abs(depth - dq)/(depthPhi*float(stepSize)*max(depth, 0.01)*0.05 + 1e-4);
+            float wl = abs(lum - luminance(c.rgb))/sigmaL;
+
+            float w = kernel[abs(x)]*kernel[abs(y)]/(kernel[0]*kernel[0])*wn*exp(-wz - wl);
+            sum += c.rgb*w;
+            variance += c.a*w*w;
+            weights += w;
+        }
+    }
+
+    vec3 col = sum/weights;
+    variance /= weights*weights;
+
+    if(finalPass == 1) {
+        vec4 albedo = texelFetch(albedoPass, p, 0);
+        out_fragColor = vec4(col*max(albedo.rgb/max(albedo.a, 1.0), vec3(0.001)), 1);
+    } else {
+        out_fragColor = vec4(col, variance);
+    }
+}
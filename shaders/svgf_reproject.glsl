@@ -0,0 +1,85 @@
+#version 430 core
+
+in vec2 tex;
+layout(location = 0) out vec4 out_color;      // rgb: integrated illumination, a: variance
+layout(location = 1) out vec4 out_moments;    // x: luminance, y: luminance squared, z: history length
+
+uniform vec2 resolution;
+uniform mat3 camera;
+uniform vec3 eye;
+uniform float fov;
+
+uniform mat3 previousCamera;
+uniform vec3 previousEye;
+uniform float previousFov;
+uniform int hasHistory;
+
+uniform sampler2D colorPass;
+uniform sampler2D albedoPass;
+uniform sampler2D normalPass;
+uniform sampler2D dataPass;
+
+uniform sampler2D previousColor;
+uniform sampler2D previousMoments;
+uniform sampler2D previousNormal;
+uniform sampler2D previousData;
+
+uniform float minAlpha;
+uniform float maxHistory;
+
+float luminance(vec3 c) {
+    return dot(c, vec3(0.2126, 0.7152, 0.0722));
+}
+
+vec3 averaged(vec4 v) {
+    return v.rgb/max(v.a, 1.0);
+}
+
+// Reprojects last frame's integrated illumination with this frame's depth and both cameras, rejecting
+// the history where depth, normal or material disagree, and blends in the new 1 spp sample.
+void main() {
+    vec4 data = texture(dataPass, tex);
+    vec3 nor = texture(normalPass, tex).xyz;
+    vec3 albedo = max(averaged(texture(albedoPass, tex)), vec3(0.001));
+    vec3 col = averaged(texture(colorPass, tex))/albedo;
+
+    float depth = data.r/max(data.a, 1.0);
+    float lum = luminance(col);
+
+    vec2 uv = (2.0*gl_FragCoord.xy - resolution)/resolution.y;
+    vec3 pos = eye + camera*vec3(uv, fov)*(depth/fov);
+
+    bool valid = hasHistory == 1 && depth > 0.0;
+    vec2 previousTex = vec2(0);
+    if(valid) {
+        vec3 local = transpose(previousCamera)*(pos - previousEye);
+        vec2 previousUv = local.xy*previousFov/local.z;
+        previousTex = (previousUv*resolution.y + resolution)/(2.0*resolution);
+
+        vec4 previous = texture(previousData, previousTex);
+        vec3 previousNor = texture(previousNormal, previousTex).xyz;
+
+        valid = local.z > 0.0
+            && all(greaterThanEqual(previousTex, vec2(0))) && all(lessThanEqual(previousTex, vec2(1)))
+            && abs(previous.r/max(previous.a, 1.0) - local.z) < 0.05*local.z
+            && dot(normalize(nor), normalize(previousNor)) > 0.9
+            && previous.g == data.g;
+    }
+
+    vec3 moments = vec3(lum, lum*lum, 1);
+    vec3 integrated = col;
+
+    if(valid) {
+        vec3 history = texture(previousMoments, previousTex).xyz;
+        float historyLength = min(history.z + 1.0, maxHistory);
+        float alpha = max(minAlpha, 1.0/historyLength);
+
+        integrated = mix(texture(previousColor, previousTex).rgb, col, alpha);
+        moments = vec3(mix(history.xy, moments.xy, alpha), historyLength);
+    }
+
+    // a young history has not seen enough samples for its variance to mean much, so it is inflated.
+    float variance = max(0.0, moments.y - moments.x*moments.x)*max(1.0, 4.0/moments.z);
+    out_color = vec4(integrated, variance);
+    out_moments = vec4(moments, 1);
+}
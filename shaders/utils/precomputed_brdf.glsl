@@ -1,6 +1,7 @@
-#version 330 core
-out vec4 FragColor;
-in vec2 tex;
+#version 430 core
+layout(local_size_x = 8, local_size_y = 8) in;
+
+layout(rg16f, binding = 0) uniform writeonly image2D lut;
 
 const float PI = 3.14159265359;
 // ----------------------------------------------------------------------------
@@ -108,6 +109,11 @@ vec2 IntegrateBRDF(float NdotV, float roughness)
 // ----------------------------------------------------------------------------
 void main() 
 {
+    ivec2 id = ivec2(gl_GlobalInvocationID.xy);
+    ivec2 size = imageSize(lut);
+    if(any(greaterThanEqual(id, size))) return;
+
+    vec2 tex = (vec2(id) + 0.5)/vec2(size);
     vec2 integratedBRDF = IntegrateBRDF(tex.x, tex.y);
-    FragColor = vec4(integratedBRDF, 0, 1);
-}
\ No newline at end of file
+    imageStore(lut, id, vec4(integratedBRDF, 0, 1));
+}
@@ -0,0 +1,112 @@
+// ======================== WAVEFRONT ========================
+// Shared declarations for the wavefront path tracer kernels. Paths live in a fixed size pool and move
+// between the kernels through index queues whose sizes are kept in the counters buffer.
+#define INFINITY pow(2.,8.)
+#define sat(p) clamp(p, 0.0, 1.0)
+
+#define PATH_LENGTH 9
+#define WAVEFRONT_GROUP 64
+#define MATERIAL_BUCKETS 16
+#define NO_DERIVATIVES
+
+//========================= Type Definitions =======================
+struct Light {
+    int type;
+    vec3 position;
+    vec3 color;
+};
+
+struct SubSurfaceMaterial {
+    vec3 albedo;
+    
+    float ambient;
+    float depth;
+    float distortion;
+    float power;
+};
+
+struct Material {
+    vec3 albedo;
+
+    float roughness;
+    float metal;
+    float ambientOcclusion;
+
+    bool subsurface;
+    bool emmissive;
+
+    bool trasmit;
+    float transmitAmount;
+};
+
+struct PBRTexture {
+    int layer;
+};
+;
+//========================= END Type Definitions =======================
+
+uniform vec2 resolution;
+uniform mat3 camera;
+uniform vec3 eye;
+uniform float fov;
+
+uniform float fudge;
+uniform float maxDistance;
+uniform int maxIterations;
+
+uniform samplerCube irr;
+uniform samplerCube prefilter;
+uniform int hasEnvMap;
+uniform float envExp;
+uniform int useIrr;
+
+uniform Light lights[10];
+uniform int numberOfLights;
+
+uniform float time;
+uniform float sceneTime;
+uniform float dof;
+uniform int shouldReset;
+
+uniform int chunkStart;
+uniform int pathCapacity;
+
+struct PathState {
+    vec4 origin;       // xyz: ray origin, w: bounce
+    vec4 direction;    // xyz: ray direction, w: seed
+    vec4 throughput;   // xyz: sig, w: ray cone width at the origin
+    vec4 radiance;     // xyz: col, w: ray cone spread
+};
+
+struct PathAov {
+    vec4 albedo;       // xyz: first hit albedo, w: linear depth
+    vec4 normal;       // xyz: first hit normal, w: material id
+};
+
+struct ShadowRay {
+    vec4 position;     // xyz: hit position, w: path index
+    vec4 normal;       // xyz: shading normal, w: seed
+    vec4 direction;    // xyz: incoming ray direction, w: metal
+    vec4 albedo;       // xyz: albedo, w: roughness
+    vec4 throughput;   // xyz: sig at the hit
+};
+
+layout(std430, binding = 3) buffer PathBuffer { PathState paths[]; };
+layout(std430, binding = 4) buffer WavefrontCounters {
+    uint rayCount;
+    uint nextRayCount;
+    uint hitCount;
+    uint shadowCount;
+    uint bucketCounts[MATERIAL_BUCKETS];
+    uint bucketOffsets[MATERIAL_BUCKETS];
+    uvec4 dispatchRays;
+    uvec4 dispatchHits;
+    uvec4 dispatchShadows;
+};
+layout(std430, binding = 5) buffer RayQueue { uint rayQueue[]; };
+layout(std430, binding = 6) buffer NextRayQueue { uint nextRayQueue[]; };
+layout(std430, binding = 7) buffer HitBuffer { vec2 hits[]; };    // x: distance, y: material id
+layout(std430, binding = 8) buffer SortedQueue { uint sortedQueue[]; };
+layout(std430, binding = 9) buffer ShadowQueue { ShadowRay shadowRays[]; };
+layout(std430, binding = 10) buffer AovBuffer { PathAov aovs[]; };
+// ======================== END WAVEFRONT ========================
\ No newline at end of file
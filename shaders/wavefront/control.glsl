@@ -0,0 +1,43 @@
+#version 430 core
+
+<<WAVEFRONT>>
+
+layout(local_size_x = 1) in;
+
+#define BEGIN_BOUNCE 0
+#define PARTITION 1
+#define SHADOWS 2
+#define NEXT_BOUNCE 3
+
+uniform int mode;
+
+uvec4 groupsFor(uint count) {
+    return uvec4((count + WAVEFRONT_GROUP - 1)/WAVEFRONT_GROUP, 1, 1, 0);
+}
+
+// Single thread bookkeeping between the kernels, it turns queue sizes into indirect dispatch sizes.
+void main() {
+    if(mode == NEXT_BOUNCE) {
+        rayCount = nextRayCount;
+        nextRayCount = 0u;
+    }
+
+    if(mode == BEGIN_BOUNCE || mode == NEXT_BOUNCE) {
+        hitCount = 0u;
+        shadowCount = 0u;
+        for(int b = 0; b < MATERIAL_BUCKETS; b++) bucketCounts[b] = 0u;
+        dispatchRays = groupsFor(rayCount);
+    } else if(mode == PARTITION) {
+        // exclusive prefix sum of the bucket sizes, the counts are reused as scatter cursors.
+        uint total = 0u;
+        for(int b = 0; b < MATERIAL_BUCKETS; b++) {
+            bucketOffsets[b] = total;
+            total += bucketCounts[b];
+            bucketCounts[b] = 0u;
+        }
+        hitCount = total;
+        dispatchHits = groupsFor(total);
+    } else if(mode == SHADOWS) {
+        dispatchShadows = groupsFor(shadowCount);
+    }
+}
@@ -0,0 +1,56 @@
+#version 430 core
+
+<<WAVEFRONT>>
+
+layout(local_size_x = WAVEFRONT_GROUP) in;
+
+<<TEXTURES>>
+
+<<SDF_HELPERS>>
+
+<<NOISE>>
+
+float de(vec3 p, out int mid);
+
+<<RAY_TRACE>>
+
+<<MATERIALS>>
+
+<<LIGHTING>>
+
+<<USER_CODE>>
+
+// Traces every queued ray. Hits are counted per material bucket for the partition, misses pick up
+// the environment and finish here.
+void main() {
+    uint i = gl_GlobalInvocationID.x;
+    if(i >= rayCount) return;
+
+    uint index = rayQueue[i];
+    vec3 ro = paths[index].origin.xyz;
+    vec3 rd = paths[index].direction.xyz;
+
+    int mid = 0;
+    float dist = sdfs_trace(ro, rd, maxDistance, mid);
+    hits[index] = vec2(dist, float(mid));
+
+    if(dist < maxDistance) {
+        atomicAdd(bucketCounts[uint(mid) % MATERIAL_BUCKETS], 1u);
+        return;
+    }
+
+    bool primary = paths[index].origin.w == 0.0;
+    if(primary) aovs[index] = PathAov(vec4(0), vec4(0, 0, 0, -1));
+
+    if(hasEnvMap == 1) {
+        if(primary) {
+            paths[index].radiance.xyz = useIrr == 1
+                ? sdfs_irradiance(rd)
+                : textureLod(prefilter, rd, 0).rgb;
+            aovs[index].albedo.xyz = sat(paths[index].radiance.xyz);
+        } else {
+            vec3 sig = paths[index].throughput.xyz;
+            paths[index].radiance.xyz += sig*(1.0 - exp(-envExp*textureLod(prefilter, rd, 0).rgb));
+        }
+    }
+}
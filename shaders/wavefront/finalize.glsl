@@ -0,0 +1,40 @@
+#version 430 core
+
+<<WAVEFRONT>>
+
+layout(local_size_x = WAVEFRONT_GROUP) in;
+layout(rgba32f, binding = 0) uniform image2D accumulation;
+layout(rgba32f, binding = 1) uniform image2D albedoImage;
+layout(rgba32f, binding = 2) uniform image2D normalImage;
+layout(rgba32f, binding = 3) uniform image2D dataImage;
+
+<<AOV>>
+
+// Adds the finished chunk to the accumulation buffers, pixel 0 keeps the focus plane distance.
+void main() {
+    uint index = gl_GlobalInvocationID.x;
+    int pixel = chunkStart + int(index);
+    int width = int(resolution.x);
+    if(index >= uint(pathCapacity) || pixel == 0 || pixel >= width*int(resolution.y)) return;
+
+    ivec2 coord = ivec2(pixel % width, pixel / width);
+    vec4 col = vec4(paths[index].radiance.xyz, 1);
+
+    if(shouldReset == 0)
+        col += imageLoad(accumulation, coord);
+
+    imageStore(accumulation, coord, col);
+
+    sdfs_aovAlbedo = aovs[index].albedo.xyz;
+    sdfs_aovDepth = aovs[index].albedo.w;
+    sdfs_aovNormal = aovs[index].normal.xyz;
+    sdfs_aovMaterial = aovs[index].normal.w;
+
+    vec4 albedo, normal, data;
+    sdfs_accumulateAov(imageLoad(albedoImage, coord), imageLoad(normalImage, coord), imageLoad(dataImage, coord),
+        shouldReset == 1, albedo, normal, data);
+
+    imageStore(albedoImage, coord, albedo);
+    imageStore(normalImage, coord, normal);
+    imageStore(dataImage, coord, data);
+}
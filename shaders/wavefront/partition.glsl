@@ -0,0 +1,18 @@
+#version 430 core
+
+<<WAVEFRONT>>
+
+layout(local_size_x = WAVEFRONT_GROUP) in;
+
+// Scatters the hits into material id order, so neighbouring shading threads run the same material code.
+void main() {
+    uint i = gl_GlobalInvocationID.x;
+    if(i >= rayCount) return;
+
+    uint index = rayQueue[i];
+    vec2 hit = hits[index];
+    if(hit.x >= maxDistance) return;
+
+    uint bucket = uint(int(hit.y)) % MATERIAL_BUCKETS;
+    sortedQueue[bucketOffsets[bucket] + atomicAdd(bucketCounts[bucket], 1u)] = index;
+}
@@ -0,0 +1,71 @@
+#version 430 core
+
+<<WAVEFRONT>>
+
+layout(local_size_x = WAVEFRONT_GROUP) in;
+layout(rgba32f, binding = 0) uniform image2D accumulation;
+
+// set for the single invocation dispatch that measures the focus plane before any path reads it.
+uniform int focusPass;
+
+<<TEXTURES>>
+
+<<SDF_HELPERS>>
+
+<<NOISE>>
+
+float de(vec3 p, out int mid);
+
+<<RAY_TRACE>>
+
+<<MATERIALS>>
+
+<<LIGHTING>>
+
+<<SAMPLING>>
+
+mat3 setCamera( in vec3 ro, in vec3 ta ) {
+	vec3 cw = normalize(ta-ro);
+	vec3 cp = vec3(0.0, 1.0,0.0);
+	vec3 cu = normalize( cross(cw,cp) );
+	vec3 cv = normalize( cross(cu,cw) );
+    return mat3( cu, cv, cw );
+}
+
+<<USER_CODE>>
+
+// Starts one camera path per pixel of the chunk, exactly like main() in offline_renderer.glsl.
+void main() {
+    if(focusPass == 1) {
+        if(gl_GlobalInvocationID.x != 0u) return;
+
+        // Calculate focus plane and store distance in the first pixel.
+        mat3 cam = setCamera(eye, vec3(0));
+        float nfpd = sdfs_trace(eye, normalize(cam*vec3(0, 0, fov)), maxDistance);
+        imageStore(accumulation, ivec2(0), vec4(vec3(nfpd), 1));
+        return;
+    }
+
+    uint index = gl_GlobalInvocationID.x;
+    int pixel = chunkStart + int(index);
+    int width = int(resolution.x);
+    if(index >= uint(pathCapacity) || pixel >= width*int(resolution.y)) return;
+
+    ivec2 coord = ivec2(pixel % width, pixel / width);
+    vec2 uv = (2.0*(vec2(coord) + 0.5) - resolution)/resolution.y;
+
+    float seed = float(baseHash(floatBitsToUint(uv)))/float(0xffffffffU) + rand(time);
+
+    uv += 2.0*hash2(seed)/resolution.y;
+    vec3 rd = camera*normalize(vec3(uv, fov));
+
+    if(pixel == 0) return;
+
+    float focusPlane = imageLoad(accumulation, ivec2(0)).r;
+    vec3 fp = eye + rd*focusPlane;
+    vec3 ro = eye + camera*vec3(randomInUnitDisk(seed), 0)*dof;
+    rd = normalize(fp - ro);
+
+    paths[index] = PathState(vec4(ro, 0), vec4(rd, seed), vec4(vec3(1), 0), vec4(vec3(0), 2.0/(resolution.y*fov)));
+    rayQueue[atomicAdd(rayCount, 1u)] = index;
+}
@@ -0,0 +1,106 @@
+#version 430 core
+
+<<WAVEFRONT>>
+
+layout(local_size_x = WAVEFRONT_GROUP) in;
+
+<<TEXTURES>>
+
+<<SDF_HELPERS>>
+
+<<NOISE>>
+
+float de(vec3 p, out int mid);
+
+<<RAY_TRACE>>
+
+<<MATERIALS>>
+
+<<LIGHTING>>
+
+<<SAMPLING>>
+
+<<CAUSTICS>>
+
+<<USER_CODE>>
+
+// Evaluates the material at every hit (in material order), queues its light sampling for the shadow
+// kernel and picks the next bounce, the same lobes sdfs_pathtrace chooses.
+void main() {
+    uint i = gl_GlobalInvocationID.x;
+    if(i >= hitCount) return;
+
+    uint index = sortedQueue[i];
+    PathState path = paths[index];
+
+    vec3 rd = path.direction.xyz;
+    float seed = path.direction.w;
+    vec3 sig = path.throughput.xyz;
+    vec3 col = path.radiance.xyz;
+    float spread = path.radiance.w;
+
+    int mid = int(hits[index].y);
+    vec3 pos = path.origin.xyz + rd*hits[index].x;
+    vec3 nor = sdfs_getNormal(pos);
+    float cone = path.throughput.w + hits[index].x*spread;
+    Material mat = queryMaterial(pos, nor, mid, path.origin.w == 0.0 ? MATERIAL_FULL : MATERIAL_BOUNCE, cone);
+
+    if(path.origin.w == 0.0) {
+        aovs[index] = PathAov(vec4(sat(mat.albedo), dot(pos - eye, camera[2])), vec4(nor, float(mid)));
+    }
+
+    if(mat.emmissive) {
+        paths[index].radiance.xyz = col + sig*mat.albedo;
+        return;
+    }
+
+    if(numberOfLights > 0) {
+        uint slot = atomicAdd(shadowCount, 1u);
+        shadowRays[slot] = ShadowRay(
+            vec4(pos, float(index)),
+            vec4(nor, hash1(seed)*1000.0),
+            vec4(rd, mat.metal),
+            vec4(mat.albedo, mat.roughness),
+            vec4(sig, 0));
+    }
+
+    if(useCaustics == 1 && !mat.trasmit) {
+        col += sig*sdfs_computeDirectDiffuseLighting(nor, rd, nor, mat)*sdfs_gatherCaustics(pos, seed);
+    }
+
+    vec3 ro = pos;
+    vec3 wo;
+    if(mat.trasmit) {
+        float F = sdfs_fresnelSchlickRoughness(max(0, dot(-nor, rd)), pow(mat.roughness, 4), 0);
+        if(F < hash1(seed)) {
+            wo = modifyDirectionWithRoughness(refract(rd, nor, 1 / (1.0 + mat.transmitAmount)), pow(mat.roughness, 4), seed);
+            ro += 2*max(0.01, abs(sdfs_getGeometry(ro + wo*0.01)))*wo;
+            sig *= mat.albedo;
+            spread = bounceSpread(spread, pow(mat.roughness, 4), false);
+        } else {
+            wo = modifyDirectionWithRoughness(reflect(rd, nor), mat.roughness, seed);
+            sig *= clamp(sdfs_computeDirectSpecularLighting(nor, rd, wo, mat), 0, 1);
+            spread = bounceSpread(spread, mat.roughness, false);
+        }
+    } else {
+        float F = sdfs_fresnelSchlickRoughness(max(0.0, -dot(nor, rd)), 0.04, mat.roughness);
+        if(mat.metal >= hash1(seed) || F > hash1(seed)) {
+            wo = modifyDirectionWithRoughness(reflect(rd, nor), mat.roughness, seed);
+            sig *= clamp(sdfs_computeDirectSpecularLighting(nor, rd, wo, mat), 0, 1);
+            sig *= mix(vec3(1), mat.albedo, mat.metal);
+            spread = bounceSpread(spread, mat.roughness, false);
+        } else {
+            wo = cosWeightedRandomHemisphereDirection(nor, seed);
+            sig *= sdfs_computeDirectDiffuseLighting(nor, rd, wo, mat);
+            spread = bounceSpread(spread, mat.roughness, true);
+        }
+    }
+
+    float bounce = path.origin.w + 1.0;
+    paths[index] = PathState(vec4(ro, bounce), vec4(wo, seed), vec4(sig, cone), vec4(col, spread));
+
+    // a path that can no longer carry any light is not worth another extension.
+    if(bounce < float(PATH_LENGTH) && max(sig.r, max(sig.g, sig.b)) > 0.0) {
+        nextRayQueue[atomicAdd(nextRayCount, 1u)] = index;
+    }
+}
@@ -0,0 +1,83 @@
+#version 430 core
+
+<<WAVEFRONT>>
+
+layout(local_size_x = WAVEFRONT_GROUP) in;
+
+<<TEXTURES>>
+
+<<SDF_HELPERS>>
+
+<<NOISE>>
+
+float de(vec3 p, out int mid);
+
+<<RAY_TRACE>>
+
+<<MATERIALS>>
+
+<<LIGHTING>>
+
+<<SAMPLING>>
+
+<<CAUSTICS>>
+
+<<USER_CODE>>
+
+// Direct lighting for one shaded hit, the light loop of sdfs_pathtrace with its shadow rays.
+void main() {
+    uint i = gl_GlobalInvocationID.x;
+    if(i >= shadowCount) return;
+
+    ShadowRay ray = shadowRays[i];
+    uint index = uint(ray.position.w);
+
+    vec3 pos = ray.position.xyz;
+    vec3 nor = ray.normal.xyz;
+    vec3 rd = ray.direction.xyz;
+    vec3 sig = ray.throughput.xyz;
+    float seed = ray.normal.w;
+    Material mat = createHardMaterial(ray.albedo.rgb, ray.albedo.w, ray.direction.w);
+
+    vec3 col = vec3(0);
+    for(int l = 0; l < 10; l++) {
+        if(l >= numberOfLights) break;
+        Light light = lights[l];
+
+        vec3 lightDirection = light.type == 0
+            ? normalize(light.position)
+            : normalize(light.position - pos);
+
+        float lightDist = light.type == 0
+            ? maxDistance
+            : length(light.position - pos);
+
+        float F = sdfs_fresnelSchlickRoughness(max(0.0, -dot(nor, lightDirection)), 0.04, mat.roughness);
+        if (F > hash1(seed) - mat.metal) {
+            vec3 coverage = clamp(sdfs_computeDirectSpecularLighting(nor, rd, lightDirection, mat), 0, 1);
+            col += sig*coverage*light.color;
+        } else {
+            vec3 coverage = sdfs_computeDirectDiffuseLighting(nor, rd, lightDirection, mat);
+            vec3 sha;
+
+            int hitId;
+            float hitDist = sdfs_trace(pos+nor*0.01, lightDirection, lightDist, hitId);
+            if (hitDist < lightDist) {
+                vec3 hitPos = pos+nor*0.01 + lightDirection*hitDist;
+                vec3 hitNor = sdfs_getNormal(hitPos);
+                Material hitM = queryMaterial(hitPos, hitNor, hitId, MATERIAL_SHADOW, 0.0);
+
+                if (hitM.trasmit && useCaustics == 0) {
+                    sha = clamp(dot(-lightDirection, hitNor) - pow(hitM.roughness, 4), 0, 1)*hitM.albedo;
+                } else {
+                    sha = vec3(0.0);
+                }
+            } else {
+                sha = vec3(1);
+            }
+            col += sig*coverage*light.color*sha;
+        }
+    }
+
+    paths[index].radiance.xyz += col;
+}
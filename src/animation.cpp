@@ -0,0 +1,100 @@
+#include "animation.h"
+#include <algorithm>
+#include <cmath>
+
+// keys closer than this are the same key.
+#define KEY_EPSILON 1e-4f
+
+template <typename K> static void insertKey(std::vector<K>& keys, K key) {
+	auto at = std::find_if(keys.begin(), keys.end(), [&](K const& k) { return k.time > key.time - KEY_EPSILON; });
+	if (at != keys.end() && std::abs(at->time - key.time) < KEY_EPSILON) *at = key;
+	else keys.insert(at, key);
+}
+
+// Finds the keys around time and how far between them it lies, indices are clamped to the ends.
+template <typename K> static void findSpan(std::vector<K> const& keys, float time, int span[4], float& t) {
+	int last = (int)keys.size() - 1;
+	int next = (int)(std::upper_bound(keys.begin(), keys.end(), time, [](float time, K const& k) { return time < k.time; }) - keys.begin());
+	int previous = std::max(next - 1, 0);
+	next = std::min(next, last);
+
+	span[0] = std::max(previous - 1, 0);
+	span[1] = previous;
+	span[2] = next;
+	span[3] = std::min(next + 1, last);
+
+	float length = keys[next].time - keys[previous].time;
+	t = length > 0.0f ? glm::clamp((time - keys[previous].time) / length, 0.0f, 1.0f) : 0.0f;
+}
+
+template <typename T> static T catmullRom(T p0, T p1, T p2, T p3, float t) {
+	float t2 = t * t, t3 = t2 * t;
+	return 0.5f * ((2.0f * p1) + (p2 - p0) * t + (2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3) * t2 + (3.0f * p1 - p0 - 3.0f * p2 + p3) * t3);
+}
+
+void Animation::KeyCamera(float time, Camera* camera) {
+	insertKey(CameraKeys, { time, camera->Position, camera->Direction, camera->Fov, camera->DepthOfField });
+}
+
+void Animation::KeyUniform(float time, SceneUniform const& uniform) {
+	auto curve = std::find_if(UniformCurves.begin(), UniformCurves.end(), [&](UniformCurve& c) { return c.name == uniform.name; });
+	if (curve == UniformCurves.end()) {
+		UniformCurves.push_back({ uniform.name });
+		curve = UniformCurves.end() - 1;
+	}
+
+	UniformKey key;
+	key.time = time;
+	for (int i = 0; i < 16; i++) key.values[i] = uniform.type == UniformType::Int ? (float)uniform.valuesi[i] : uniform.valuesf[i];
+
+	insertKey(curve->keys, key);
+}
+
+void Animation::RemoveKeys(float time) {
+	auto atTime = [&](float t) { return std::abs(t - time) < KEY_EPSILON; };
+
+	CameraKeys.erase(std::remove_if(CameraKeys.begin(), CameraKeys.end(), [&](CameraKey& k) { return atTime(k.time); }), CameraKeys.end());
+	for (auto& curve : UniformCurves) {
+		curve.keys.erase(std::remove_if(curve.keys.begin(), curve.keys.end(), [&](UniformKey& k) { return atTime(k.time); }), curve.keys.end());
+	}
+
+	UniformCurves.erase(std::remove_if(UniformCurves.begin(), UniformCurves.end(), [](UniformCurve& c) { return c.keys.empty(); }), UniformCurves.end());
+}
+
+// Poses the camera and sets the keyed uniforms for time, anything without keys is left alone.
+void Animation::Apply(float time, Camera* camera, std::vector<SceneUniform>* uniforms) {
+	int s[4];
+	float t;
+
+	if (!CameraKeys.empty()) {
+		findSpan(CameraKeys, time, s, t);
+		auto& k = CameraKeys;
+
+		camera->Position = catmullRom(k[s[0]].position, k[s[1]].position, k[s[2]].position, k[s[3]].position, t);
+		camera->Direction = glm::normalize(catmullRom(k[s[0]].direction, k[s[1]].direction, k[s[2]].direction, k[s[3]].direction, t));
+		camera->Fov = catmullRom(k[s[0]].fov, k[s[1]].fov, k[s[2]].fov, k[s[3]].fov, t);
+		camera->DepthOfField = std::max(catmullRom(k[s[0]].depthOfField, k[s[1]].depthOfField, k[s[2]].depthOfField, k[s[3]].depthOfField, t), 0.0f);
+	}
+
+	for (auto& curve : UniformCurves) {
+		auto uniform = std::find_if(uniforms->begin(), uniforms->end(), [&](SceneUniform& u) { return u.name == curve.name; });
+		if (uniform == uniforms->end() || curve.keys.empty()) continue;
+
+		findSpan(curve.keys, time, s, t);
+		auto& k = curve.keys;
+
+		for (int i = 0; i < 16; i++) {
+			float value = catmullRom(k[s[0]].values[i], k[s[1]].values[i], k[s[2]].values[i], k[s[3]].values[i], t);
+			uniform->valuesf[i] = value;
+			uniform->valuesi[i] = (int)std::round(value);
+		}
+	}
+}
+
+bool Animation::IsEmpty() {
+	return CameraKeys.empty() && UniformCurves.empty();
+}
+
+int Animation::GetFrameCount() {
+	return std::max((int)std::ceil(Duration * FrameRate), 1);
+}
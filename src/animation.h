@@ -0,0 +1,45 @@
+#include <scene.h>
+#include <camera.h>
+#include <string>
+#include <vector>
+
+#pragma once
+
+struct CameraKey {
+	float time;
+	glm::vec3 position;
+	glm::vec3 direction;
+	float fov;
+	float depthOfField;
+};
+
+struct UniformKey {
+	float time;
+	float values[16];
+};
+
+struct UniformCurve {
+	std::string name;
+	std::vector<UniformKey> keys;
+};
+
+// Keyframes for the camera and the scene uniforms over Duration seconds, kept sorted by time.
+// Positions and values follow Catmull-Rom splines through their keys, directions are interpolated
+// the same way and renormalized. Before the first key and after the last the end key holds.
+class Animation {
+public:
+	void KeyCamera(float, Camera*);
+	void KeyUniform(float, SceneUniform const&);
+	void RemoveKeys(float);
+	void Apply(float, Camera*, std::vector<SceneUniform>*);
+
+	bool IsEmpty();
+	int GetFrameCount();
+
+	std::vector<CameraKey> CameraKeys;
+	std::vector<UniformCurve> UniformCurves;
+
+	float Duration = 5.0f;
+	int FrameRate = 24;
+	float Time = 0.0f;
+};
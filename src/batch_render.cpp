@@ -0,0 +1,316 @@
+#include "batch_render.h"
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include <project.h>
+#include <image_output.h>
+#include <render_server.h>
+#include <render_coordinator.h>
+#include <checkpoint.h>
+#include <sequence_renderer.h>
+#include <texture_loader.h>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstring>
+#include <cstdio>
+#include <chrono>
+#include <thread>
+
+#define EXIT_RENDER_FAILED 1
+
+bool BatchRender::Parse(int argc, char **argv, BatchOptions& options, std::string& error) {
+	for (int i = 1; i < argc; i++) {
+		std::string argument = argv[i];
+		if (i + 1 >= argc) {
+			error = "Missing value for " + argument;
+			return false;
+		}
+
+		std::string value = argv[++i];
+		if (argument == "--render") {
+			options.ProjectPath = value;
+		} else if (argument == "--out") {
+			options.OutputPath = value;
+		} else if (argument == "--spp") {
+			options.Samples = atoi(value.c_str());
+		} else if (argument == "--serve") {
+			options.ServePort = atoi(value.c_str());
+		} else if (argument == "--workers") {
+			std::stringstream list(value);
+			std::string worker;
+			while (std::getline(list, worker, ',')) {
+				if (!worker.empty()) options.Workers.push_back(worker);
+			}
+		} else if (argument == "--timeout") {
+			options.WorkerTimeout = atoi(value.c_str());
+		} else if (argument == "--merge") {
+			std::stringstream list(value);
+			std::string checkpoint;
+			while (std::getline(list, checkpoint, ',')) {
+				if (!checkpoint.empty()) options.Merge.push_back(checkpoint);
+			}
+		} else if (argument == "--frames") {
+			if (sscanf(value.c_str(), "%d-%d", &options.FirstFrame, &options.LastFrame) != 2) {
+				error = "Frames should look like 0-119";
+				return false;
+			}
+		} else if (argument == "--frame-seconds") {
+			options.FrameSeconds = (float)atof(value.c_str());
+		} else if (argument == "--tile") {
+			options.TileSize = atoi(value.c_str());
+		} else if (argument == "--size") {
+			if (sscanf(value.c_str(), "%dx%d", &options.Width, &options.Height) != 2) {
+				error = "Size should look like 3840x2160";
+				return false;
+			}
+		} else {
+			error = "Unknown option " + argument;
+			return false;
+		}
+	}
+
+	if (options.ServePort > 0) return true;
+	if (!options.Merge.empty()) {
+		if (options.OutputPath.empty()) error = "--merge needs --out";
+		return error.empty();
+	}
+
+	if (options.ProjectPath.empty() || options.OutputPath.empty()) error = "Both --render and --out are required";
+	else if (options.Samples <= 0) error = "--spp should be positive";
+	else if (options.Width <= 0 || options.Height <= 0) error = "--size should be positive";
+	else if (options.TileSize < 16) error = "--tile should be at least 16";
+	else if (options.WorkerTimeout <= 0) error = "--timeout should be positive";
+	else if (!options.Workers.empty() && !ImageOutput::IsSupported(options.OutputPath)) error = "Distributed renders are written as .exr, .pfm or .hdr";
+	else if (options.FirstFrame < 0 && VideoStream::IsStream(options.OutputPath)) error = "Streams are rendered from an animation, add --frames";
+	else if (options.FirstFrame >= 0 && !options.Workers.empty()) error = "--frames renders on this machine, use --serve jobs with a time to spread frames";
+	else if (options.FirstFrame >= 0 && (options.LastFrame < options.FirstFrame || ResolutionScaleFor(options.Width, options.Height) < 0)) {
+		error = "--frames needs a range like 0-119 and one of the window resolutions";
+	}
+	else if (!ImageOutput::IsSupported(options.OutputPath) && ResolutionScaleFor(options.Width, options.Height) < 0) {
+		error = "PNG output is limited to 1920x1080, 1600x900, 1526x864, 1280x720 and 640x360, use .exr for other sizes";
+	}
+
+	return error.empty();
+}
+
+void BatchRender::PrintUsage() {
+	std::cerr << "usage: sdf-studio --render project.txt --out frame.exr [--spp 1024] [--size 1920x1080] [--tile 512]\n"
+		<< "       sdf-studio --render project.txt --out frame.exr --workers 127.0.0.1:7001,127.0.0.1:7002 [--timeout 600] [--spp ...]\n"
+		<< "       sdf-studio --render project.txt --out frames/shot_####.exr --frames 0-119 [--spp 256] [--frame-seconds 10]\n"
+		<< "       sdf-studio --render project.txt --out - --frames 0-119 --spp 16 --size 640x360 | ffplay -\n"
+		<< "       sdf-studio --serve 7878\n"
+		<< "       sdf-studio --merge a.checkpoint,b.checkpoint --out project.txt.checkpoint\n"
+		<< "  .exr, .pfm and .hdr render any size in tiles, .png renders at one of the window resolutions.\n"
+		<< "  --frames to -, .y4m or .ppm streams raw frames to stdout, a file or a named pipe.\n"
+		<< "  .png renders continue from the project's checkpoint and write one every few minutes.\n";
+}
+
+int BatchRender::Run(BatchOptions options) {
+	// frames streamed to stdout must not be interleaved with progress and status lines.
+	if (options.OutputPath == "-") std::cout.rdbuf(std::cerr.rdbuf());
+
+	int lastReported = -1;
+	auto report = [&](float progress) {
+		int percent = (int)(progress * 100.0f);
+		if (percent / 5 == lastReported / 5) return;
+
+		lastReported = percent;
+		std::cout << percent << "%" << std::endl;
+	};
+
+	if (!options.Merge.empty()) {
+		try {
+			Checkpoint merged;
+			merged.Read(options.Merge[0]);
+			for (size_t i = 1; i < options.Merge.size(); i++) {
+				Checkpoint other;
+				other.Read(options.Merge[i]);
+				merged.Merge(other);
+			}
+
+			merged.Write(options.OutputPath);
+			std::cout << "Merged " << merged.Samples << " samples into " << options.OutputPath << std::endl;
+			return 0;
+		} catch (std::exception ex) {
+			std::cerr << ex.what() << std::endl;
+			return EXIT_RENDER_FAILED;
+		}
+	}
+
+	// the coordinator only merges and writes, the workers do all of the GL work.
+	if (!options.Workers.empty()) {
+		std::string status;
+		bool rendered = RenderCoordinator(options).Run(report, status);
+
+		std::cout << status << std::endl;
+		return rendered ? 0 : EXIT_RENDER_FAILED;
+	}
+
+	if (!glfwInit()) {
+		std::cerr << "Unable to initialize GLFW\n";
+		return EXIT_RENDER_FAILED;
+	}
+
+	if (CreateContext() == nullptr) {
+		glfwTerminate();
+		return EXIT_RENDER_FAILED;
+	}
+
+	if (options.ServePort > 0) {
+		RenderServer server(options.ServePort);
+		int result = server.Run();
+
+		glfwTerminate();
+		return result;
+	}
+
+	if (!std::ifstream(options.ProjectPath).good()) {
+		std::cerr << "Unable to open " << options.ProjectPath << std::endl;
+		glfwTerminate();
+		return EXIT_RENDER_FAILED;
+	}
+
+	Project project;
+	project.LoadScene(options.ProjectPath);
+	TextureLoader::Instance()->Finish();
+
+	if (!project.ProjectScene->GetCompileError().empty()) {
+		std::cerr << project.ProjectScene->GetCompileError() << std::endl;
+		glfwTerminate();
+		return EXIT_RENDER_FAILED;
+	}
+
+	std::string status;
+	bool rendered = options.FirstFrame >= 0 ? RenderSequence(&project, options, report, status)
+		: Render(project.ProjectScene, options, [&](float progress) {
+			project.UpdateCheckpoint();
+			report(progress);
+		}, status);
+
+	std::cout << status << std::endl;
+	glfwTerminate();
+
+	return rendered ? 0 : EXIT_RENDER_FAILED;
+}
+
+// Makes an invisible window's context current, GLFW must already be initialized.
+GLFWwindow* BatchRender::CreateContext() {
+	glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+#ifdef SDF_STUDIO_HEADLESS
+	glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_OSMESA_CONTEXT_API);
+#endif
+
+	// software rasterizers like llvmpipe can stop short of 4.6, nothing used needs more than 4.3.
+	GLFWwindow* window = nullptr;
+	int versions[][2] = { { 4, 6 }, { 4, 5 }, { 4, 3 } };
+	for (auto version : versions) {
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, version[0]);
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, version[1]);
+		glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+		window = glfwCreateWindow(64, 64, "SDF Studio", NULL, NULL);
+		if (window != nullptr) break;
+	}
+
+	if (window == nullptr) {
+		std::cerr << "Unable to create an OpenGL 4.3 context\n";
+		return nullptr;
+	}
+
+	glfwMakeContextCurrent(window);
+	if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+		std::cerr << "Unable to load OpenGL\n";
+		return nullptr;
+	}
+
+	std::cout << "OpenGL " << glGetString(GL_VERSION) << " on " << glGetString(GL_RENDERER) << std::endl;
+
+	glEnable(GL_DEPTH_TEST);
+	glDepthFunc(GL_LEQUAL);
+
+	return window;
+}
+
+// Renders a loaded scene to options.OutputPath, progress is reported in [0, 1]. PNG renders continue
+// whatever accumulation the scene already holds, such as a resumed checkpoint.
+bool BatchRender::Render(Scene* scene, BatchOptions const& options, std::function<void(float)> progress, std::string& status) {
+	if (ImageOutput::IsSupported(options.OutputPath)) {
+		scene->Poster->TileSize = options.TileSize;
+		scene->Poster->SamplesPerTile = options.Samples;
+		scene->StartPoster(options.OutputPath, options.Width, options.Height);
+
+		while (scene->Poster->IsActive()) {
+			scene->OfflineRender();
+			progress(scene->Poster->GetProgress());
+		}
+
+		status = scene->Poster->GetStatus();
+		return !scene->Poster->Failed;
+	}
+
+	// 8-bit images go through the regular accumulation buffer, so they are limited to its sizes.
+	if (!UseResolution(scene, options.Width, options.Height, status)) return false;
+
+	for (int i = scene->OfflineRenderAmounts; i < options.Samples; i++) {
+		scene->OfflineRender();
+		progress((float)i / options.Samples);
+	}
+
+	scene->SaveRender(options.OutputPath);
+	while (scene->IsSaving()) {
+		scene->PollSaves();
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	status = scene->GetSaveStatus();
+	progress(1.0f);
+	return !scene->SaveFailed();
+}
+
+// Renders the frames of the project's animation to the numbered paths of options.OutputPath.
+bool BatchRender::RenderSequence(Project* project, BatchOptions const& options, std::function<void(float)> progress, std::string& status) {
+	if (!UseResolution(project->ProjectScene, options.Width, options.Height, status)) return false;
+
+	SequenceRenderer sequence(project);
+	sequence.SamplesPerFrame = options.Samples;
+	sequence.SecondsPerFrame = options.FrameSeconds;
+	sequence.Start(options.OutputPath, options.FirstFrame, options.LastFrame);
+
+	while (sequence.IsActive()) {
+		sequence.Step();
+		progress(sequence.GetProgress());
+
+		// nothing to render while the saver catches up.
+		if (project->ProjectScene->GetPendingSaves() >= sequence.FramesInFlight) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	status = sequence.GetStatus();
+	return !sequence.Failed;
+}
+
+// Sizes the accumulation targets to one of the window resolutions.
+bool BatchRender::UseResolution(Scene* scene, int width, int height, std::string& status) {
+	int scale = ResolutionScaleFor(width, height);
+	if (scale < 0) {
+		status = "Accumulated renders are limited to the window resolutions, use a tiled .exr for "
+			+ std::to_string(width) + "x" + std::to_string(height);
+		return false;
+	}
+
+	if (scene->ResolutionScale != scale) {
+		scene->ResolutionScale = scale;
+		scene->UpdateResolution();
+	}
+
+	return true;
+}
+
+// the project ResolutionScale matching a size, -1 when none does.
+int BatchRender::ResolutionScaleFor(int width, int height) {
+	glm::vec2 sizes[] = { { 1920, 1080 }, { 1600, 900 }, { 1526, 864 }, { 1280, 720 }, { 640, 360 } };
+	for (int i = 0; i < 5; i++) {
+		if (sizes[i].x == width && sizes[i].y == height) return i;
+	}
+
+	return -1;
+}
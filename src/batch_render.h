@@ -0,0 +1,41 @@
+#include <string>
+#include <vector>
+#include <functional>
+#include <project.h>
+
+#pragma once
+
+struct BatchOptions {
+	std::string ProjectPath;
+	std::string OutputPath;
+	int Samples = 1024;
+	int Width = 1920;
+	int Height = 1080;
+	int TileSize = 512;
+	int ServePort = 0;
+	std::vector<std::string> Workers;
+	// seconds a worker may go without sending anything before its unit is handed to another.
+	int WorkerTimeout = 600;
+	std::vector<std::string> Merge;
+
+	// an animation range renders one image per frame, -1 renders the project as saved.
+	int FirstFrame = -1;
+	int LastFrame = -1;
+	float FrameSeconds = 0.0f;
+};
+
+// Unattended rendering from the command line. Loads a project into an invisible window (an OSMesa
+// context in headless builds), path traces it to the requested sample count and writes the image.
+class BatchRender {
+public:
+	static bool Parse(int, char **, BatchOptions&, std::string&);
+	static void PrintUsage();
+
+	static int Run(BatchOptions);
+
+	static GLFWwindow* CreateContext();
+	static bool Render(Scene *, BatchOptions const&, std::function<void(float)>, std::string&);
+	static bool RenderSequence(Project *, BatchOptions const&, std::function<void(float)>, std::string&);
+	static int ResolutionScaleFor(int, int);
+	static bool UseResolution(Scene *, int, int, std::string&);
+};
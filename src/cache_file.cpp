@@ -0,0 +1,68 @@
+#include "cache_file.h"
+#include <fstream>
+#include <cstdio>
+#include <atomic>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <direct.h>
+#include <process.h>
+#else
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+bool WriteCacheFile(std::string path, const void* header, size_t headerBytes, const void* data, size_t bytes) {
+	auto slash = path.find_last_of("/\\");
+	if (slash != std::string::npos) {
+#ifdef _WIN32
+		_mkdir(path.substr(0, slash).c_str());
+#else
+		mkdir(path.substr(0, slash).c_str(), 0755);
+#endif
+	}
+
+	std::string temporary = TemporaryPath(path);
+	{
+		std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+		if (!file) return false;
+
+		file.write((const char*)header, headerBytes);
+		file.write((const char*)data, bytes);
+		if (!file) {
+			file.close();
+			std::remove(temporary.c_str());
+			return false;
+		}
+	}
+
+	if (RenameOver(temporary, path)) return true;
+
+	std::remove(temporary.c_str());
+	return false;
+}
+
+std::string TemporaryPath(std::string path) {
+	static std::atomic<unsigned> counter(0);
+
+#ifdef _WIN32
+	int process = _getpid();
+#else
+	int process = (int)getpid();
+#endif
+
+	auto slash = path.find_last_of("/\\");
+	auto dot = path.find_last_of('.');
+	if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) dot = path.size();
+
+	return path.substr(0, dot) + ".tmp" + std::to_string(process) + "_" + std::to_string(counter++) + path.substr(dot);
+}
+
+bool RenameOver(std::string from, std::string to) {
+#ifdef _WIN32
+	return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+	return std::rename(from.c_str(), to.c_str()) == 0;
+#endif
+}
@@ -0,0 +1,12 @@
+#include <string>
+
+#pragma once
+
+// Writes a header and a payload to path, creating its directory. The file is written under a temporary
+// name and renamed, so a reader never maps a half written cache entry.
+bool WriteCacheFile(std::string, const void*, size_t, const void*, size_t);
+
+// A name next to path that no other writer, in this process or another, is using. The extension is kept.
+std::string TemporaryPath(std::string);
+// Renames a file over another in one step, so readers see either the old file or the new one.
+bool RenameOver(std::string, std::string);
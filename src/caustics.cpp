@@ -0,0 +1,70 @@
+#include "caustics.h"
+#include <algorithm>
+#include <cmath>
+
+// must match CAUSTIC_STRIDE in shaders/library/caustics.glsl
+#define CAUSTIC_STRIDE 3
+
+CausticPhotons::CausticPhotons() {
+	glGenBuffers(1, &grid);
+}
+
+CausticPhotons::~CausticPhotons() {
+	glDeleteBuffers(1, &grid);
+}
+
+void CausticPhotons::Reset() {
+	Passes = 0;
+}
+
+// time seeds the photons, a fixed value emits the same set again.
+void CausticPhotons::Emit(Program *program, float time) {
+	if (allocatedCells != Cells) allocate();
+
+	GLuint zero = 0;
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, grid);
+	glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, grid);
+
+	// deposits and gathers have to agree on the cell size, so the radius is fixed for the pass here.
+	radius = GetRadius();
+	program->Bind("time", time)
+		.Bind("photonsPerSide", PhotonsPerSide)
+		.Bind("causticCenter", Center)
+		.Bind("causticExtent", Extent)
+		.Bind("causticCells", allocatedCells)
+		.Bind("causticRadius", radius);
+
+	GLuint groups = (PhotonsPerSide + 7) / 8;
+	glDispatchCompute(groups, groups, 1);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+	Passes++;
+}
+
+void CausticPhotons::Use(Program *program) {
+	if (allocatedCells == 0) allocate();
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, grid);
+
+	program->Bind("useCaustics", Enabled ? 1 : 0)
+		.Bind("causticCells", allocatedCells)
+		.Bind("causticRadius", radius);
+}
+
+float CausticPhotons::GetRadius() {
+	// progressive photon mapping radius reduction, r_n = r_0 * n^((alpha - 1)/2)
+	float shrunk = InitialRadius * std::pow((float)(Passes + 1), (Alpha - 1.0f) * 0.5f);
+	return std::max(shrunk, InitialRadius * 0.05f);
+}
+
+size_t CausticPhotons::GetMemoryUsage() {
+	return (size_t)allocatedCells * CAUSTIC_STRIDE * sizeof(GLuint);
+}
+
+void CausticPhotons::allocate() {
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, grid);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, (GLsizeiptr)Cells * CAUSTIC_STRIDE * sizeof(GLuint), nullptr, GL_DYNAMIC_COPY);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	allocatedCells = Cells;
+}
@@ -0,0 +1,34 @@
+#include <program.h>
+
+#pragma once
+
+// Photon pass for caustics through transmissive and metal surfaces. Every offline pass emits a fresh
+// set of photons into a hashed grid whose gather radius shrinks progressively with the pass count.
+class CausticPhotons {
+public:
+	CausticPhotons();
+	~CausticPhotons();
+
+	void Reset();
+	void Emit(Program *, float);
+	void Use(Program *);
+
+	float GetRadius();
+	size_t GetMemoryUsage();
+
+	bool Enabled = false;
+	int PhotonsPerSide = 256;
+	int Cells = 1 << 18;
+	float InitialRadius = 0.1f;
+	float Alpha = 0.7f;
+	glm::vec3 Center = glm::vec3(0.0f);
+	float Extent = 5.0f;
+
+	int Passes = 0;
+private:
+	GLuint grid;
+	int allocatedCells = 0;
+	float radius = 0.1f;
+
+	void allocate();
+};
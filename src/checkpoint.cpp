@@ -0,0 +1,110 @@
+#include "checkpoint.h"
+#include <cache_file.h>
+#include <hash.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+#define CHECKPOINT_MAGIC "SDFC"
+#define CHECKPOINT_VERSION 2
+#define CHECKPOINT_TARGETS 4
+
+void Checkpoint::Read(std::string path) {
+	std::ifstream file(path, std::ios::binary);
+	if (!file) throw std::runtime_error(("Unable to open " + path).c_str());
+
+	char magic[4];
+	int32_t version, targets, runs;
+	file.read(magic, 4);
+	file.read((char*)&version, sizeof(int32_t));
+	if (!file || memcmp(magic, CHECKPOINT_MAGIC, 4) != 0 || version != CHECKPOINT_VERSION) {
+		throw std::runtime_error((path + " is not a checkpoint").c_str());
+	}
+
+	file.read((char*)&StateHash, sizeof(uint64_t));
+	file.read((char*)&runs, sizeof(int32_t));
+	if (!file || runs < 1 || runs > 65536) throw std::runtime_error((path + " is damaged").c_str());
+	RunIds.resize(runs);
+	file.read((char*)RunIds.data(), runs * sizeof(uint64_t));
+	file.read((char*)&Width, sizeof(int32_t));
+	file.read((char*)&Height, sizeof(int32_t));
+	file.read((char*)&Samples, sizeof(int32_t));
+	file.read((char*)&targets, sizeof(int32_t));
+	if (!file || targets != CHECKPOINT_TARGETS || Width <= 0 || Height <= 0) {
+		throw std::runtime_error((path + " is damaged").c_str());
+	}
+
+	Targets.resize((size_t)Width * Height * 4 * CHECKPOINT_TARGETS);
+	file.read((char*)Targets.data(), Targets.size() * sizeof(float));
+	if (!file) throw std::runtime_error((path + " is truncated").c_str());
+}
+
+// Writes next to the destination first, a crash while writing leaves the previous checkpoint intact.
+void Checkpoint::Write(std::string path) {
+	std::string temporary = TemporaryPath(path);
+	{
+		std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+		int32_t version = CHECKPOINT_VERSION, targets = CHECKPOINT_TARGETS, runs = (int32_t)RunIds.size();
+
+		file.write(CHECKPOINT_MAGIC, 4);
+		file.write((const char*)&version, sizeof(int32_t));
+		file.write((const char*)&StateHash, sizeof(uint64_t));
+		file.write((const char*)&runs, sizeof(int32_t));
+		file.write((const char*)RunIds.data(), RunIds.size() * sizeof(uint64_t));
+		file.write((const char*)&Width, sizeof(int32_t));
+		file.write((const char*)&Height, sizeof(int32_t));
+		file.write((const char*)&Samples, sizeof(int32_t));
+		file.write((const char*)&targets, sizeof(int32_t));
+		file.write((const char*)Targets.data(), Targets.size() * sizeof(float));
+
+		if (!file.good()) {
+			file.close();
+			std::remove(temporary.c_str());
+			throw std::runtime_error(("Unable to write " + temporary).c_str());
+		}
+	}
+
+	if (!RenameOver(temporary, path)) {
+		std::remove(temporary.c_str());
+		throw std::runtime_error(("Unable to replace " + path).c_str());
+	}
+}
+
+void Checkpoint::Merge(Checkpoint const& other) {
+	if (other.StateHash != StateHash || other.Width != Width || other.Height != Height) {
+		throw std::runtime_error("Checkpoints of different renders cannot be merged");
+	}
+
+	// a copy, or a file already merged into this one, would count its samples twice.
+	for (auto id : other.RunIds) {
+		if (std::find(RunIds.begin(), RunIds.end(), id) != RunIds.end()) {
+			throw std::runtime_error("Checkpoints from the same run cannot be merged");
+		}
+	}
+
+	Accumulate(Targets, other.Targets, true);
+	Samples += other.Samples;
+	RunIds.insert(RunIds.end(), other.RunIds.begin(), other.RunIds.end());
+}
+
+// random_device alone is deterministic on some runtimes, the clock keeps ids apart there.
+uint64_t Checkpoint::NewRunId() {
+	std::random_device device;
+	unsigned int entropy[2] = { device(), device() };
+	auto now = std::chrono::high_resolution_clock::now().time_since_epoch().count();
+	return Hash().Add(entropy, sizeof(entropy)).Add(&now, sizeof(now)).Value;
+}
+
+// Adds raw targets laid out as four RGBA blocks. Material ids are labels rather than sums, so the
+// first set's are kept, and so is the focus distance held in the first beauty pixel of full frames.
+void Checkpoint::Accumulate(std::vector<float>& into, std::vector<float> const& from, bool hasFocusPixel) {
+	size_t dataBlock = from.size() / 4 * 3;
+	for (size_t i = hasFocusPixel ? 4 : 0; i < from.size(); i++) {
+		if (i >= dataBlock && i % 4 == 1) continue;
+		into[i] += from[i];
+	}
+}
@@ -0,0 +1,26 @@
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#pragma once
+
+// Offline accumulation saved to disk so a long render survives a crash or can be paused. Holds the
+// four raw targets (sums with the sample count in alpha), the pass count and the hash of the state
+// that produced them. Files from separate runs of one state merge by adding their sums; every run gets
+// a random id, and files sharing one hold the same samples and are refused.
+class Checkpoint {
+public:
+	void Read(std::string);
+	void Write(std::string);
+	void Merge(Checkpoint const&);
+
+	static void Accumulate(std::vector<float>&, std::vector<float> const&, bool);
+	static uint64_t NewRunId();
+
+	uint64_t StateHash = 0;
+	std::vector<uint64_t> RunIds;
+	int Width = 0;
+	int Height = 0;
+	int Samples = 0;
+	std::vector<float> Targets;
+};
@@ -0,0 +1,107 @@
+#include "denoiser.h"
+#include <simd.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#define ALBEDO_EPSILON 0.001f
+#define BANDS_PER_THREAD 4
+
+static const float KERNEL[5] = { 1.0f / 16.0f, 1.0f / 4.0f, 3.0f / 8.0f, 1.0f / 4.0f, 1.0f / 16.0f };
+
+std::vector<float> Denoiser::Denoise(std::vector<float> const& color, std::vector<float> const& albedo, std::vector<float> const& normal, int width, int height) {
+	auto start = std::chrono::high_resolution_clock::now();
+	auto pool = ThreadPool::Instance();
+
+	size_t size = (size_t)width * height * 4;
+	std::vector<float> current(size), next(size);
+
+	int bands = std::min(height, (pool->GetThreadCount() + 1) * BANDS_PER_THREAD);
+	auto forBands = [&](std::function<void(int, int)> body) {
+		pool->ParallelFor(bands, [&](int band) {
+			body(band * height / bands, (band + 1) * height / bands);
+		});
+	};
+
+	// filter lighting only, the albedo is put back at the end.
+	float4 epsilon = splat4(ALBEDO_EPSILON);
+	forBands([&](int first, int last) {
+		for (size_t i = (size_t)first * width * 4; i < (size_t)last * width * 4; i += 4) {
+			float4 a = max4(load4(&albedo[i]), epsilon);
+			store4(&current[i], div4(load4(&color[i]), a));
+		}
+	});
+
+	for (int iteration = 0; iteration < Iterations; iteration++) {
+		// each level doubles the tap spacing and tightens the color weight as the noise drops.
+		int step = 1 << iteration;
+		float sigma = ColorSigma / (float)(1 << iteration);
+		forBands([&](int first, int last) {
+			filterRows(current, next, albedo, normal, width, height, first, last, sigma, step);
+		});
+
+		std::swap(current, next);
+	}
+
+	forBands([&](int first, int last) {
+		for (size_t i = (size_t)first * width * 4; i < (size_t)last * width * 4; i += 4) {
+			float4 a = max4(load4(&albedo[i]), epsilon);
+			store4(&next[i], mul4(load4(&current[i]), a));
+			next[i + 3] = 1.0f;
+		}
+	});
+
+	auto end = std::chrono::high_resolution_clock::now();
+	LastDuration = std::chrono::duration<float, std::milli>(end - start).count();
+
+	return next;
+}
+
+void Denoiser::filterRows(std::vector<float> const& in, std::vector<float>& out, std::vector<float> const& albedo, std::vector<float> const& normal,
+	int width, int height, int first, int last, float sigma, int step) {
+	float colorScale = 1.0f / std::max(sigma * sigma, 1e-6f);
+	float albedoScale = 1.0f / std::max(AlbedoSigma * AlbedoSigma, 1e-6f);
+
+	for (int y = first; y < last; y++) {
+		for (int x = 0; x < width; x++) {
+			size_t p = ((size_t)y * width + x) * 4;
+			float4 cp = load4(&in[p]);
+			float4 np = load4(&normal[p]);
+			float4 ap = load4(&albedo[p]);
+			bool background = dot3(np, np) == 0.0f;
+
+			float4 sum = zero4();
+			float weights = 0.0f;
+
+			for (int ky = 0; ky < 5; ky++) {
+				int qy = y + (ky - 2) * step;
+				if (qy < 0 || qy >= height) continue;
+
+				for (int kx = 0; kx < 5; kx++) {
+					int qx = x + (kx - 2) * step;
+					if (qx < 0 || qx >= width) continue;
+
+					size_t q = ((size_t)qy * width + qx) * 4;
+					float4 cq = load4(&in[q]);
+					float4 nq = load4(&normal[q]);
+					float4 dc = sub4(cp, cq);
+					float4 da = sub4(ap, load4(&albedo[q]));
+
+					// misses have no normal, they only blend with other misses.
+					float wn;
+					if (background) wn = dot3(nq, nq) == 0.0f ? 1.0f : 0.0f;
+					else wn = std::pow(std::max(0.0f, dot3(np, nq)), NormalPower);
+					if (wn <= 0.0f) continue;
+
+					float w = KERNEL[kx] * KERNEL[ky] * wn
+						* std::exp(-dot3(dc, dc) * colorScale - dot3(da, da) * albedoScale);
+
+					sum = add4(sum, mul4(cq, splat4(w)));
+					weights += w;
+				}
+			}
+
+			store4(&out[p], weights > 0.0f ? div4(sum, splat4(weights)) : cp);
+		}
+	}
+}
@@ -0,0 +1,23 @@
+#include <vector>
+#include <thread_pool.h>
+
+#pragma once
+
+// Edge-avoiding a-trous wavelet filter for path traced renders. The beauty is divided by the first hit
+// albedo, filtered with weights from the color, normal and albedo of each tap, and multiplied back so
+// texture detail survives. Images are RGBA floats and rows are filtered in parallel bands.
+class Denoiser {
+public:
+	std::vector<float> Denoise(std::vector<float> const&, std::vector<float> const&, std::vector<float> const&, int, int);
+
+	bool Enabled = false;
+	int Iterations = 5;
+	float ColorSigma = 0.8f;
+	float NormalPower = 64.0f;
+	float AlbedoSigma = 0.1f;
+
+	float LastDuration = 0.0f;
+private:
+	void filterRows(std::vector<float> const&, std::vector<float>&, std::vector<float> const&, std::vector<float> const&,
+		int, int, int, int, float, int);
+};
@@ -4,19 +4,116 @@
 #include <streambuf>
 #include <sstream>
 #include <glm/glm.hpp>
-#include <glm\ext\matrix_clip_space.hpp>
-#include <glm\ext\matrix_transform.hpp>
+#include <glm/gtc/constants.hpp>
+#include <glm/gtc/packing.hpp>
+#include <glm/ext/matrix_clip_space.hpp>
+#include <glm/ext/matrix_transform.hpp>
+#include <hash.h>
+#include <cache_file.h>
+#include <simd.h>
+#include <thread_pool.h>
+#include <cstring>
+#include <algorithm>
+#include <cmath>
+#include <chrono>
+#include <stb_image.h>
+#include <stdexcept>
+
+LruCache<uint64_t, EnvironmentMaps> Environment::MapCache(4);
+std::string Environment::CacheDirectory = "environment_cache";
+
+#define ENVIRONMENT_CACHE_VERSION 3
+#define CUBE_SIZE 1024
+#define IRRADIANCE_SIZE 64
+#define PREFILTER_LEVELS 5
+
+// RGB16F faces of the cube and prefilter maps follow the header in that order, prefilter level by level.
+struct EnvironmentCacheHeader {
+	char magic[4];
+	uint32_t version;
+	uint64_t sourceHash;
+	uint64_t shaderHash;
+};
+
+// The cube's level 0 and then each prefilter level, six faces apiece: the order faces are computed,
+// cached and uploaded in.
+#define CUBE_FACES (6 + PREFILTER_LEVELS * 6)
+
+static int faceMip(int index) {
+	return index < 6 ? 0 : (index - 6) / 6;
+}
+
+static int faceSize(int prefilterSize, int index) {
+	return index < 6 ? CUBE_SIZE : std::max(1, prefilterSize >> faceMip(index));
+}
+
+static size_t faceOffset(int prefilterSize, int index) {
+	size_t offset = 0;
+	for (int i = 0; i < index; i++) offset += (size_t)faceSize(prefilterSize, i) * faceSize(prefilterSize, i) * 3 * sizeof(uint16_t);
+	return offset;
+}
+
+static Texture* faceTexture(EnvironmentMaps* target, int index) {
+	return index < 6 ? target->cubeMap : target->prefilterMap;
+}
+
+static glm::mat4 captureProjection() {
+	return glm::perspective(glm::radians(90.0f), 1.0f, 0.1f, 10.0f);
+}
+
+static glm::mat4 captureView(int face) {
+	static const glm::mat4 views[] = {
+		glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(1.0f,  0.0f,  0.0f), glm::vec3(0.0f, -1.0f,  0.0f)),
+		glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(-1.0f, 0.0f,  0.0f), glm::vec3(0.0f, -1.0f,  0.0f)),
+		glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f,  1.0f,  0.0f), glm::vec3(0.0f,  0.0f,  1.0f)),
+		glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, -1.0f,  0.0f), glm::vec3(0.0f,  0.0f, -1.0f)),
+		glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f,  0.0f,  1.0f), glm::vec3(0.0f, -1.0f,  0.0f)),
+		glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f,  0.0f, -1.0f), glm::vec3(0.0f, -1.0f,  0.0f))
+	};
+	return views[face];
+}
+
+static void allocateCubes(EnvironmentMaps* target, int prefilterSize, int prefilterSamples) {
+	target->cubeMap->AllocateCube(CUBE_SIZE, CUBE_SIZE, true);
+	target->irradianceMap->AllocateCube(IRRADIANCE_SIZE, IRRADIANCE_SIZE);
+	target->prefilterMap->AllocateCube(prefilterSize, prefilterSize, true);
+
+	target->prefilterSize = prefilterSize;
+	target->prefilterSamples = prefilterSamples;
+}
+
+// Once the cube's level 0 is in: its mips for filtered sampling, and the prefilter levels to fill.
+static void allocatePrefilterMips(EnvironmentMaps* target) {
+	target->cubeMap->GenerateMipmap();
+	target->prefilterMap->GenerateMipmap();
+}
+
+EnvironmentMaps::EnvironmentMaps() {
+	hdri = new Texture();
+	cubeMap = new Texture();
+	irradianceMap = new Texture();
+	prefilterMap = new Texture();
+
+	for (auto& coefficient : irradianceSH) coefficient = glm::vec3(0.0f);
+}
+
+EnvironmentMaps::~EnvironmentMaps() {
+	for (auto texture : { hdri, cubeMap, irradianceMap, prefilterMap }) {
+		texture->DeleteTexture();
+		delete texture;
+	}
+}
 
 Environment::Environment() {
 	cubeScreen = new Screen();
 	quadScreen = new Screen();
 	program = new Program();
+	convertProgram = new Program();
+	prefilterProgram = new Program();
 
-	HdriTexture = new Texture();
+	maps = std::make_shared<EnvironmentMaps>();
+	HdriTexture = maps->hdri;
 	brdfTexture = new Texture();
-	cubeMap = new Texture();
-	irradianceMap = new Texture();
-	prefilterMap = new Texture();
 
 	std::ifstream vertStream(std::string(PROJECT_SOURCE_DIR "/shaders/model_vert.glsl"));
 	cubeVertSource = std::string(std::istreambuf_iterator<char>(vertStream), std::istreambuf_iterator<char>());
@@ -31,57 +128,139 @@ Environment::Environment() {
 	prefilterSource = std::string(std::istreambuf_iterator<char>(prefilterStream), std::istreambuf_iterator<char>());
 
 	glGenFramebuffers(1, &fbo);
-	glGenRenderbuffers(1, &rbo);
+	cubeScreen->PrepareCube();
 	hasEnvMap = false;
 }
 
+Environment::~Environment() {
+	delete cubeScreen;
+	delete quadScreen;
+	delete program;
+	delete convertProgram;
+	delete prefilterProgram;
+
+	brdfTexture->DeleteTexture();
+	delete brdfTexture;
+
+	glDeleteFramebuffers(1, &fbo);
+}
+
+// The loading HDRI first: hashing looks for maps already in memory, decoding happens on the thread
+// pool, and Update does the GL work a slice per frame while the current maps keep rendering.
 void Environment::SetHDRI(std::string filename) {
+	pending.reset();
+	error.clear();
+	ClampSettings();
+
+	if (!filename.empty()) {
+		pending.reset(new PendingHdri());
+		pending->path = filename;
+		pending->decoded = std::make_shared<DecodedHdri>();
+
+		auto decoded = pending->decoded;
+		pending->hashing = ThreadPool::Instance()->Submit([decoded, filename]() {
+			decoded->key = HashFile(filename);
+		});
+		return;
+	}
 
-	if (filename.empty()) {
-		HdriPath = "";
-		HdriTexture->Allocate2D(1, 1, false);
-	} else {
-		HdriPath = filename;
-		HdriTexture->LoadHDRIFromFile2D(HdriPath);
-	}
-	cubeMap->AllocateCube(1024, 1024, true);
-	irradianceMap->AllocateCube(64, 64);
-	prefilterMap->AllocateCube(512, 512, true);
-	brdfTexture->Allocate2D();
+	uint64_t key = Hash().Value;
+	auto cached = MapCache.Get(key);
+	if (!cached) {
+		cached = std::make_shared<EnvironmentMaps>();
+		cached->hdri->Allocate2D(1, 1, false);
+		allocateCubes(cached.get(), PrefilterSize, PrefilterSamples);
+		MapCache.Put(key, cached);
+	}
+
+	maps = cached;
+	HdriTexture = maps->hdri;
+	HdriPath = filename;
 	hasEnvMap = false;
+	Generation++;
 }
 
+// Brings settings read from a project or typed into the panel back into the ranges the maps support.
+void Environment::ClampSettings() {
+	int size = 128;
+	while (size < 1024 && size < PrefilterSize) size <<= 1;
+	PrefilterSize = size;
+	PrefilterSamples = std::max(1, std::min(4096, PrefilterSamples));
+	HdriWidth = std::max(0, HdriWidth);
+}
+
+// Finishes a loading HDRI, then computes whatever the current maps are still missing.
 void Environment::PreRender() {
-	glm::mat4 captureProjection = glm::perspective(glm::radians(90.0f), 1.0f, 0.1f, 10.0f);
-	glm::mat4 captureViews[] =
-	{
-		glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(1.0f,  0.0f,  0.0f), glm::vec3(0.0f, -1.0f,  0.0f)),
-		glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(-1.0f, 0.0f,  0.0f), glm::vec3(0.0f, -1.0f,  0.0f)),
-		glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f,  1.0f,  0.0f), glm::vec3(0.0f,  0.0f,  1.0f)),
-		glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, -1.0f,  0.0f), glm::vec3(0.0f,  0.0f, -1.0f)),
-		glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f,  0.0f,  1.0f), glm::vec3(0.0f, -1.0f,  0.0f)),
-		glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f,  0.0f, -1.0f), glm::vec3(0.0f, -1.0f,  0.0f))
-	};
+	if (pending) Finish();
+
+	if (!maps->prefiltered) {
+		auto cached = readCache(cachePath(maps.get()), maps->sourceHash, shaderHash(maps.get()), faceOffset(maps->prefilterSize, CUBE_FACES));
+		if (cached.empty()) {
+			computeMaps(maps.get());
+			writeCache(maps.get());
+		} else {
+			for (int index = 0; index < CUBE_FACES; index++) uploadFace(maps.get(), cached.data(), index);
+		}
 
-	cubeScreen->PrepareCube();
+		maps->prefiltered = true;
+	}
+
+	// the convolved cube is only made for environments that ask for it.
+	if (!UseSphericalHarmonics && !maps->irradianceReady) {
+		for (int face = 0; face < 6; face++) irradianceFace(maps.get(), face);
+		maps->irradianceReady = true;
+	}
 
-	convertHdriToCubeMap(captureProjection, captureViews);
-	calcIrradianceCubeMap(captureProjection, captureViews);
-	calcPrefilterCubeMap(captureProjection, captureViews);
 	hasEnvMap = true;
 }
 
+void Environment::Update() {
+	if (pending) stepPending(false);
+}
+
+void Environment::Finish() {
+	if (pending) stepPending(true);
+}
+
+bool Environment::IsLoading() {
+	return pending != nullptr;
+}
+
+// Rough share of a loading HDRI that is done: the upload counts for a quarter, the cube maps for the rest.
+float Environment::GetLoadProgress() {
+	if (!pending || !pending->maps) return 0.0f;
+	if (pending->maps->prefiltered) return 1.0f;
+
+	int height = pending->decoded->height;
+	float rows = height > 0 ? (float)pending->uploadedRows / height : 0.0f;
+	return 0.25f * rows + 0.75f * pending->face / CUBE_FACES;
+}
+
+std::string Environment::GetError() {
+	return error;
+}
+
 void Environment::Use(Program *program, bool offline) {
-	program->Bind("irr", irradianceMap->UseCube())
-		.Bind("prefilter", prefilterMap->UseCube())
-		.Bind("numberOfLights", (int)lights.size())
-		.Bind("useIrr", UseIrradianceForBackground ? 1 : 0);
+	bool harmonics = UseSphericalHarmonics || !maps->irradianceReady;
+	program->Bind("irr", maps->irradianceMap)
+		.Bind("prefilter", maps->prefilterMap)
+		.Bind("useIrr", UseIrradianceForBackground ? 1 : 0)
+		.Bind("useIrradianceSH", harmonics ? 1 : 0);
+
+	if (harmonics) {
+		for (int i = 0; i < 9; i++) program->Bind("irradianceSH[" + std::to_string(i) + "]", maps->irradianceSH[i]);
+	}
 
 	if (offline) {
 		program->Bind("hasEnvMap", hasEnvMap ? 1 : 0)
 			.Bind("envExp", LightPathExposure);
 	}
 
+	UseLights(program, offline);
+}
+
+void Environment::UseLights(Program *program, bool offline) {
+	program->Bind("numberOfLights", (int)lights.size());
 
 	for(int i = 0; i < lights.size(); i++) {
 		program->Bind("lights[" + std::to_string(i) + "].type", (int)lights[i].type);
@@ -102,90 +281,404 @@ void Environment::RemoveLight(int i) {
 	lights.erase(lights.begin() + i);
 }
 
-void Environment::convertHdriToCubeMap(glm::mat4 captureProjection, glm::mat4 captureViews[6]) {
-	
-	program->Reload()
-		.Attach(cubeVertSource, GL_VERTEX_SHADER)
-		.Attach(convertSource, GL_FRAGMENT_SHADER)
-		.Link()
-		.Activate()
-		.Bind("equirectangularMap", HdriTexture->Use2D())
-		.Bind("projection", captureProjection);
+// Projects the equirectangular image onto the first 9 spherical harmonics, rows split over the thread
+// pool. Each band is scaled by its cosine lobe convolution over pi, so evaluating the sum gives what the
+// convolved cube map holds: irradiance / pi. Once cancelled is set the remaining rows are skipped.
+void Environment::projectIrradiance(const float* pixels, int width, int height, int channels, glm::vec3 sh[9], const std::atomic<bool>* cancelled) {
+	std::vector<double> cosPhi(width), sinPhi(width);
+	for (int x = 0; x < width; x++) {
+		double phi = ((x + 0.5) / width - 0.5) * 2.0 * glm::pi<double>();
+		cosPhi[x] = cos(phi);
+		sinPhi[x] = sin(phi);
+	}
 
-	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
-	glBindRenderbuffer(GL_RENDERBUFFER, rbo);
-	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, 1024, 1024);
-	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, rbo);
+	int chunks = std::max(1, std::min(height, ThreadPool::Instance()->GetThreadCount() * 4));
+	std::vector<double> sums((size_t)chunks * 27, 0.0);
+
+	ThreadPool::Instance()->ParallelFor(chunks, [&](int chunk) {
+		double* sum = &sums[(size_t)chunk * 27];
+		double dTheta = glm::pi<double>() / height, dPhi = 2.0 * glm::pi<double>() / width;
+
+		for (int row = chunk * height / chunks; row < (chunk + 1) * height / chunks; row++) {
+			if (cancelled && *cancelled) return;
+
+			// the image was loaded bottom row first, so row 0 looks straight down.
+			double latitude = ((row + 0.5) / height - 0.5) * glm::pi<double>();
+			double y = sin(latitude), ring = cos(latitude);
+			double weight = ring * dTheta * dPhi;
+
+			// a row is summed as RGB lanes in float, then weighted into the double totals.
+			float4 rowSum[9];
+			for (int i = 0; i < 9; i++) rowSum[i] = zero4();
+
+			const float* pixel = pixels + (size_t)row * width * channels;
+			for (int column = 0; column < width; column++, pixel += channels) {
+				float x = (float)(ring * cosPhi[column]), z = (float)(ring * sinPhi[column]), yf = (float)y;
+				float basis[9] = {
+					0.282095f,
+					0.488603f * yf, 0.488603f * z, 0.488603f * x,
+					1.092548f * x * yf, 1.092548f * yf * z, 0.315392f * (3.0f * z * z - 1.0f), 1.092548f * x * z, 0.546274f * (x * x - yf * yf)
+				};
+
+				float4 rgb = set4(pixel[0], pixel[channels > 1 ? 1 : 0], pixel[channels > 2 ? 2 : 0], 0.0f);
+				for (int i = 0; i < 9; i++) rowSum[i] = add4(rowSum[i], mul4(splat4(basis[i]), rgb));
+			}
+
+			for (int i = 0; i < 9; i++) {
+				float lanes[4];
+				store4(lanes, rowSum[i]);
+				for (int c = 0; c < 3; c++) sum[i * 3 + c] += lanes[c] * weight;
+			}
+		}
+	});
+
+	const double band[9] = { 1.0, 2.0 / 3.0, 2.0 / 3.0, 2.0 / 3.0, 0.25, 0.25, 0.25, 0.25, 0.25 };
+	for (int i = 0; i < 9; i++) {
+		glm::dvec3 total(0.0);
+		for (int chunk = 0; chunk < chunks; chunk++) total += glm::dvec3(sums[chunk * 27 + i * 3], sums[chunk * 27 + i * 3 + 1], sums[chunk * 27 + i * 3 + 2]);
+		sh[i] = glm::vec3(total * band[i]);
+	}
+}
+
+// Changes with anything that changes the precomputed maps, so old entries are ignored after shader edits.
+uint64_t Environment::shaderHash(EnvironmentMaps* target) {
+	return Hash()
+		.Add(ENVIRONMENT_CACHE_VERSION)
+		.Add(convertSource)
+		.Add(prefilterSource)
+		.Add(CUBE_SIZE).Add(PREFILTER_LEVELS)
+		.Add(target->hdriWidth).Add(target->prefilterSize).Add(target->prefilterSamples)
+		.Value;
+}
 
-	glViewport(0, 0, 1024, 1024);
-	
-	for (unsigned int i = 0; i < 6; i++) {
-		program->Bind("view", captureViews[i]);
+// Maps in memory are only shared between environments that prefilter the same way.
+uint64_t Environment::mapsKey(uint64_t sourceHash) {
+	return Hash().Add(&sourceHash, sizeof(sourceHash)).Add(HdriWidth).Add(PrefilterSize).Add(PrefilterSamples).Value;
+}
+
+// Empty when there is nothing to cache: no file behind the maps, or caching turned off.
+std::string Environment::cachePath(EnvironmentMaps* target) {
+	if (target->sourceHash == 0 || CacheDirectory.empty()) return "";
+
+	char name[48];
+	snprintf(name, sizeof(name), "%016llx_%016llx.sdfenv", (unsigned long long)target->sourceHash, (unsigned long long)shaderHash(target));
+	return CacheDirectory + "/" + name;
+}
+
+// Decodes on the thread pool: 3 float channels, box filtered down to at most maxWidth, projected onto
+// the irradiance harmonics and finally stored as half floats.
+void Environment::decodeHdri(std::string path, int maxWidth, DecodedHdri* decoded) {
+	stbi_set_flip_vertically_on_load_thread(1);
 
-		// TODO: Move this code to somewhere.
-		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, cubeMap->TextureId, 0);
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	int width, height, channels;
+	float* data = stbi_loadf(path.c_str(), &width, &height, &channels, 3);
+	if (!data) throw std::runtime_error(("Unable to load image: " + path).c_str());
 
-		cubeScreen->DrawCube();
+	// nothing reads a cancelled decode, it only has to stop early.
+	auto cancelled = [&]() {
+		if (!decoded->cancelled) return false;
+		stbi_image_free(data);
+		return true;
+	};
+	if (cancelled()) return;
+
+	// a whole factor, so every filtered pixel averages the same number of texels.
+	int factor = maxWidth > 0 ? std::max(1, (width + maxWidth - 1) / maxWidth) : 1;
+	decoded->width = std::max(1, width / factor);
+	decoded->height = std::max(1, height / factor);
+
+	std::vector<float> filtered;
+	const float* pixels = data;
+	if (factor > 1) {
+		filtered.assign((size_t)decoded->width * decoded->height * 3, 0.0f);
+		float scale = 1.0f / (factor * factor);
+
+		for (int y = 0; y < decoded->height; y++) {
+			if (cancelled()) return;
+
+			for (int dy = 0; dy < factor; dy++) {
+				const float* row = data + (size_t)(y * factor + dy) * width * 3;
+				float* out = &filtered[(size_t)y * decoded->width * 3];
+				for (int x = 0; x < decoded->width * 3; x++) {
+					int column = x / 3 * factor, channel = x % 3;
+					for (int dx = 0; dx < factor; dx++) out[x] += row[(column + dx) * 3 + channel] * scale;
+				}
+			}
+		}
+		pixels = filtered.data();
+	}
+
+	if (cancelled()) return;
+	projectIrradiance(pixels, decoded->width, decoded->height, 3, decoded->irradianceSH, &decoded->cancelled);
+	if (cancelled()) return;
+
+	decoded->pixels.resize((size_t)decoded->width * decoded->height * 3);
+	for (size_t i = 0; i < decoded->pixels.size(); i++) {
+		decoded->pixels[i] = glm::packHalf1x16(std::min(pixels[i], 65504.0f));
 	}
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
-	cubeMap->GenerateMipmap();
 
+	stbi_image_free(data);
 }
 
-void Environment::calcIrradianceCubeMap(glm::mat4 captureProjection, glm::mat4 captureViews[6]) {
-	program->Reload()
-		.Attach(cubeVertSource, GL_VERTEX_SHADER)
-		.Attach(irradianceSource, GL_FRAGMENT_SHADER)
-		.Link()
-		.Activate()
-		.Bind("projection", captureProjection)
-		.Bind("environmentMap", cubeMap->UseCube());
+// Faces of a cache entry made for this HDRI and these shaders, empty when there is none. Safe off the GL thread.
+std::vector<char> Environment::readCache(std::string path, uint64_t sourceHash, uint64_t shaders, size_t bytes) {
+	if (path.empty()) return {};
 
-	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
-	glBindRenderbuffer(GL_RENDERBUFFER, rbo);
-	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, 64, 64);
-	glViewport(0, 0, 64, 64);
-	
-	for (unsigned int i = 0; i < 6; i++) {
-		program->Bind("view", captureViews[i]);
+	std::ifstream file(path, std::ios::binary);
+	if (!file) return {};
+
+	EnvironmentCacheHeader header;
+	file.read((char*)&header, sizeof(header));
+	if (!file || memcmp(header.magic, "SDFE", 4) != 0 || header.version != ENVIRONMENT_CACHE_VERSION
+		|| header.sourceHash != sourceHash || header.shaderHash != shaders) return {};
 
-		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, irradianceMap->TextureId, 0);
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	std::vector<char> data(bytes);
+	file.read(data.data(), data.size());
+	if ((size_t)file.gcount() != data.size()) return {};
 
-		cubeScreen->DrawCube();
+	return data;
+}
+
+// Reads the freshly computed maps back and writes them out on the thread pool.
+void Environment::writeCache(EnvironmentMaps* target) {
+	std::string path = cachePath(target);
+	if (path.empty()) return;
+
+	auto data = std::make_shared<std::vector<char>>(faceOffset(target->prefilterSize, CUBE_FACES));
+
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	for (int index = 0; index < CUBE_FACES; index++) {
+		glBindTexture(GL_TEXTURE_CUBE_MAP, faceTexture(target, index)->TextureId);
+		glGetTexImage(GL_TEXTURE_CUBE_MAP_POSITIVE_X + index % 6, faceMip(index), GL_RGB, GL_HALF_FLOAT, data->data() + faceOffset(target->prefilterSize, index));
 	}
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+
+	EnvironmentCacheHeader header = { { 'S', 'D', 'F', 'E' }, ENVIRONMENT_CACHE_VERSION, target->sourceHash, shaderHash(target) };
+
+	ThreadPool::Instance()->Submit([header, path, data]() {
+		WriteCacheFile(path, &header, sizeof(header), data->data(), data->size());
+	});
+}
+
+// Saves the GL state the frame was using around a slice of loading, a failed load keeps the current maps.
+void Environment::stepPending(bool now) {
+	GLint previousFbo, previousProgram, viewport[4];
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFbo);
+	glGetIntegerv(GL_CURRENT_PROGRAM, &previousProgram);
+	glGetIntegerv(GL_VIEWPORT, viewport);
+
+	try {
+		advancePending(now);
+	} catch (std::exception ex) {
+		error = ex.what();
+		pending.reset();
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, previousFbo);
+	glUseProgram(previousProgram);
+	glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
 }
 
-void Environment::calcPrefilterCubeMap(glm::mat4 captureProjection, glm::mat4 captureViews[6]) {
-	prefilterMap->GenerateMipmap();
+// Uploads and copies from the disk cache stop at UploadBudget. GPU passes queue work the clock can't
+// see, so at most one runs per call. With now set everything is done before returning.
+void Environment::advancePending(bool now) {
+	auto start = std::chrono::high_resolution_clock::now();
+	auto overBudget = [&]() {
+		return !now && std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count() >= UploadBudget;
+	};
+	auto ready = [&](std::future<void>& task) {
+		if (now) task.wait();
+		return task.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+	};
+
+	PendingHdri& load = *pending;
+	if (load.hashing.valid()) {
+		if (!ready(load.hashing)) return;
+		load.hashing.get();
+
+		uint64_t key = load.decoded->key;
+		if (key == 0) throw std::runtime_error(("Unable to read image: " + load.path).c_str());
+
+		load.key = mapsKey(key);
+		load.maps = MapCache.Get(load.key);
+		if (!load.maps) {
+			load.maps = std::make_shared<EnvironmentMaps>();
+			load.maps->sourceHash = key;
+			allocateCubes(load.maps.get(), PrefilterSize, PrefilterSamples);
+			load.maps->hdriWidth = HdriWidth;
+
+			auto decoded = load.decoded;
+			std::string path = load.path, cache = cachePath(load.maps.get());
+			int maxWidth = load.maps->hdriWidth;
+			uint64_t shaders = shaderHash(load.maps.get());
+			size_t bytes = faceOffset(PrefilterSize, CUBE_FACES);
+			load.decoding = ThreadPool::Instance()->Submit([decoded, path, cache, maxWidth, key, shaders, bytes]() {
+				decodeHdri(path, maxWidth, decoded.get());
+				if (!decoded->cancelled) decoded->cached = readCache(cache, key, shaders, bytes);
+			});
+		}
+	}
+
+	if (load.decoding.valid()) {
+		if (!ready(load.decoding)) return;
+		load.decoding.get();
+
+		load.maps->hdri->Allocate2DHalf(load.decoded->width, load.decoded->height);
+		std::copy(load.decoded->irradianceSH, load.decoded->irradianceSH + 9, load.maps->irradianceSH);
+	}
+
+	DecodedHdri& decoded = *load.decoded;
+	EnvironmentMaps* target = load.maps.get();
+
+	int band = std::max(1, (1 << 20) / (decoded.width * 6 + 1));
+	while (load.uploadedRows < decoded.height) {
+		if (overBudget()) return;
+
+		int rows = std::min(band, decoded.height - load.uploadedRows);
+		glBindTexture(GL_TEXTURE_2D, target->hdri->TextureId);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, load.uploadedRows, decoded.width, rows, GL_RGB, GL_HALF_FLOAT,
+			&decoded.pixels[(size_t)load.uploadedRows * decoded.width * 3]);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		load.uploadedRows += rows;
+	}
+
+	bool drew = false;
+	if (!target->prefiltered) {
+		if (decoded.cached.empty()) {
+			// a prefilter face costs size^2 * PrefilterSamples fetches, so each gets an Update of its own
+			// rather than the whole set stalling one frame.
+			while (load.face < CUBE_FACES) {
+				if (drew && !now) return;
+				if (load.face < 6) {
+					convertCube(target);
+					load.face = 6;
+				} else {
+					prefilterFaces(target, faceMip(load.face), load.face % 6, 1);
+					load.face++;
+				}
+				drew = true;
+			}
+
+			writeCache(target);
+		}
+
+		while (load.face < CUBE_FACES && !decoded.cached.empty()) {
+			if (overBudget()) return;
+			uploadFace(target, decoded.cached.data(), load.face++);
+		}
+
+		target->prefiltered = true;
+	}
+
+	if (!UseSphericalHarmonics && !target->irradianceReady) {
+		while (load.irradianceFace < 6) {
+			if (drew && !now) return;
+			irradianceFace(target, load.irradianceFace++);
+			drew = true;
+		}
+		target->irradianceReady = true;
+	}
+
+	swapPending();
+}
+
+void Environment::swapPending() {
+	maps = pending->maps;
+	MapCache.Put(pending->key, maps);
+
+	HdriTexture = maps->hdri;
+	HdriPath = pending->path;
+	hasEnvMap = true;
+	Generation++;
+	pending.reset();
+}
+
+void Environment::linkPasses() {
+	if (passesLinked) return;
+
+	convertProgram->Reload()
+		.Attach(convertSource, GL_COMPUTE_SHADER)
+		.Link();
+
+	prefilterProgram->Reload()
+		.Attach(prefilterSource, GL_COMPUTE_SHADER)
+		.Link();
 
 	program->Reload()
 		.Attach(cubeVertSource, GL_VERTEX_SHADER)
-		.Attach(prefilterSource, GL_FRAGMENT_SHADER)
-		.Link()
-		.Activate()
-		.Bind("projection", captureProjection)
-		.Bind("environmentMap", cubeMap->UseCube());
+		.Attach(irradianceSource, GL_FRAGMENT_SHADER)
+		.Link();
+
+	passesLinked = true;
+}
+
+// The HDRI goes into all six cube faces in one dispatch, then each prefilter level takes one more.
+// Filtered importance sampling reads the cube's mips, so prefilterSamples can stay small.
+void Environment::computeMaps(EnvironmentMaps* target) {
+	convertCube(target);
+	for (int mip = 0; mip < PREFILTER_LEVELS; mip++) prefilterFaces(target, mip, 0, 6);
+}
+
+void Environment::convertCube(EnvironmentMaps* target) {
+	linkPasses();
+
+	convertProgram->Activate()
+		.Bind("equirectangularMap", target->hdri)
+		.Bind("size", CUBE_SIZE);
+
+	glBindImageTexture(0, target->cubeMap->TextureId, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+	glDispatchCompute(CUBE_SIZE / 8, CUBE_SIZE / 8, 6);
+	glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+
+	allocatePrefilterMips(target);
+}
+
+// Filters faces [firstFace, firstFace + faces) of one prefilter level, the cube must be converted first.
+void Environment::prefilterFaces(EnvironmentMaps* target, int mip, int firstFace, int faces) {
+	linkPasses();
+
+	int size = faceSize(target->prefilterSize, 6 + mip * 6);
+	float roughness = (float)mip / (PREFILTER_LEVELS - 1);
+
+	prefilterProgram->Activate()
+		.Bind("environmentMap", target->cubeMap)
+		.Bind("sourceSize", (float)CUBE_SIZE)
+		.Bind("sampleCount", target->prefilterSamples)
+		.Bind("size", size)
+		.Bind("roughness", roughness)
+		.Bind("firstFace", firstFace);
+
+	glBindImageTexture(0, target->prefilterMap->TextureId, mip, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+	glDispatchCompute((size + 7) / 8, (size + 7) / 8, faces);
+	glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+}
+
+void Environment::uploadFace(EnvironmentMaps* target, const char* data, int index) {
+	if (index == 6) allocatePrefilterMips(target);
+
+	int size = faceSize(target->prefilterSize, index);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, faceTexture(target, index)->TextureId);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexSubImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + index % 6, faceMip(index), 0, 0, size, size, GL_RGB, GL_HALF_FLOAT, data + faceOffset(target->prefilterSize, index));
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
+
+// The optional convolved irradiance cube, drawn a face at a time. No depth buffer: a cube seen from
+// inside never overlaps itself.
+void Environment::irradianceFace(EnvironmentMaps* target, int face) {
+	linkPasses();
+
+	program->Activate()
+		.Bind("projection", captureProjection())
+		.Bind("view", captureView(face))
+		.Bind("environmentMap", target->cubeMap);
 
 	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
-	for (unsigned int mip = 0; mip < 5; ++mip) {
-		GLuint mipWidth = 512 * std::pow(0.5, mip);
-		GLuint mipHeight = 512 * std::pow(0.5, mip);
-
-		glBindRenderbuffer(GL_RENDERBUFFER, rbo);
-		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, mipWidth, mipHeight);
-		glViewport(0, 0, mipWidth, mipHeight);
-
-		float roughness = (float)mip / 4.0;
-		program->Bind("roughness", roughness);
-		for (unsigned int i = 0; i < 6; i++) {
-			program->Bind("view", captureViews[i]);
-			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, prefilterMap->TextureId, mip);
-			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-			cubeScreen->DrawCube();
-		}
-	}
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, target->irradianceMap->TextureId, 0);
+	glViewport(0, 0, IRRADIANCE_SIZE, IRRADIANCE_SIZE);
+	glClear(GL_COLOR_BUFFER_BIT);
+
+	cubeScreen->DrawCube();
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
-}
\ No newline at end of file
+}
@@ -3,6 +3,10 @@
 #include <screen.h>
 #include <camera.h>
 #include <vector>
+#include <memory>
+#include <future>
+#include <atomic>
+#include <lru_cache.h>
 
 #pragma once
 
@@ -20,13 +24,47 @@ struct Light {
 	float shadowPenumbra;
 };
 
+// Cube maps derived from one HDRI. They depend on nothing but the image, so every environment that
+// loads the same file shares them.
+struct EnvironmentMaps {
+	EnvironmentMaps();
+	~EnvironmentMaps();
+
+	Texture* hdri;
+	Texture* cubeMap;
+	Texture* irradianceMap;
+	Texture* prefilterMap;
+
+	// 9 band-2 spherical harmonics of the diffuse irradiance, convolved with the cosine lobe.
+	glm::vec3 irradianceSH[9];
+
+	// what the HDRI was filtered down to and the prefiltered cube made with.
+	int hdriWidth = 0;
+	int prefilterSize = 0;
+	int prefilterSamples = 0;
+
+	bool prefiltered = false;
+	bool irradianceReady = false;
+	// content hash of the HDRI, 0 for no file. Also names the disk cache entry.
+	uint64_t sourceHash = 0;
+};
+
 class Environment {
 public:
 	Environment();
+	~Environment();
 
 	void SetHDRI(std::string);
+	void ClampSettings();
 	void PreRender();
+	void Update();
+	void Finish();
+
+	bool IsLoading();
+	float GetLoadProgress();
+	std::string GetError();
 	void Use(Program *, bool offline = false);
+	void UseLights(Program *, bool offline = false);
 
 	void RemoveLight(int);
 	std::vector<Light>* GetLights();
@@ -35,20 +73,71 @@ public:
 	std::string HdriPath;
 	float LightPathExposure = 1.0f;
 	bool UseIrradianceForBackground = false;
+	// diffuse irradiance from spherical harmonics instead of the convolved cube map.
+	bool UseSphericalHarmonics = true;
+	// HDRIs wider than this are box filtered down before upload, 0 keeps the file's resolution. Saved
+	// with the project, changes apply to the next HDRI load.
+	int HdriWidth = 4096;
+	// milliseconds Update may spend uploading a loading HDRI each frame.
+	float UploadBudget = 4.0f;
+	// face size of the prefiltered cube's top level (a power of two from 128 to 1024) and GGX samples
+	// per texel (1 to 4096), saved with the project. Changes apply to the next HDRI load.
+	int PrefilterSize = 512;
+	int PrefilterSamples = 64;
+	// bumped whenever different maps are swapped in.
+	int Generation = 0;
+
+	// keyed by the HDRI's contents.
+	static LruCache<uint64_t, EnvironmentMaps> MapCache;
+	// precomputed cube maps are stored here and uploaded instead of recomputed, empty turns it off.
+	static std::string CacheDirectory;
 private:
-	Texture* cubeMap;
-	Texture* irradianceMap;
-	Texture* prefilterMap;
+	// What the thread pool makes of an HDRI file: its hash, the image as RGB half floats (bottom row
+	// first), its irradiance and the faces of a matching disk cache entry if there is one.
+	struct DecodedHdri {
+		uint64_t key = 0;
+		std::vector<uint16_t> pixels;
+		int width = 0;
+		int height = 0;
+		glm::vec3 irradianceSH[9];
+		std::vector<char> cached;
+		// set once nobody waits for the result, the decode stops at its next check.
+		std::atomic<bool> cancelled{ false };
+	};
+
+	// An HDRI being loaded next to the current maps, which keep rendering until Update swaps it in.
+	struct PendingHdri {
+		std::string path;
+		std::shared_ptr<DecodedHdri> decoded;
+		std::future<void> hashing;
+		std::future<void> decoding;
+
+		uint64_t key = 0;
+		std::shared_ptr<EnvironmentMaps> maps;
+		int uploadedRows = 0;
+		int face = 0;
+		int irradianceFace = 0;
+
+		~PendingHdri() {
+			if (decoded) decoded->cancelled = true;
+		}
+	};
+
+	std::shared_ptr<EnvironmentMaps> maps;
+	std::unique_ptr<PendingHdri> pending;
+	std::string error;
 	Texture* brdfTexture;
 
 	Screen* cubeScreen;
 	Screen* quadScreen;
 	Program* program;
+	Program* convertProgram;
+	Program* prefilterProgram;
+	bool passesLinked = false;
 
 	std::vector<Light> lights;
 
 	GLuint fbo;
-	GLuint rbo;
 
 	std::string cubeVertSource;
 
@@ -58,7 +147,23 @@ private:
 
 	bool hasEnvMap;
 
-	void convertHdriToCubeMap(glm::mat4, glm::mat4[6]);
-	void calcIrradianceCubeMap(glm::mat4, glm::mat4[6]);
-	void calcPrefilterCubeMap(glm::mat4, glm::mat4[6]);
+	static void decodeHdri(std::string, int, DecodedHdri*);
+	static void projectIrradiance(const float*, int, int, int, glm::vec3[9], const std::atomic<bool>* cancelled = nullptr);
+	static std::vector<char> readCache(std::string, uint64_t, uint64_t, size_t);
+
+	uint64_t shaderHash(EnvironmentMaps*);
+	uint64_t mapsKey(uint64_t);
+	std::string cachePath(EnvironmentMaps*);
+	void writeCache(EnvironmentMaps*);
+
+	void stepPending(bool);
+	void advancePending(bool);
+	void swapPending();
+
+	void linkPasses();
+	void computeMaps(EnvironmentMaps*);
+	void convertCube(EnvironmentMaps*);
+	void prefilterFaces(EnvironmentMaps*, int, int, int);
+	void uploadFace(EnvironmentMaps*, const char*, int);
+	void irradianceFace(EnvironmentMaps*, int);
 };
\ No newline at end of file
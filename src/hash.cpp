@@ -0,0 +1,44 @@
+#include "hash.h"
+#include <fstream>
+#include <vector>
+
+Hash& Hash::Add(const void* data, size_t size) {
+	auto bytes = (const unsigned char*)data;
+	for (size_t i = 0; i < size; i++) {
+		Value ^= bytes[i];
+		Value *= 1099511628211ULL;
+	}
+
+	return *this;
+}
+
+Hash& Hash::Add(std::string const& value) {
+	Add(value.data(), value.size());
+	return Add((int)value.size());
+}
+
+Hash& Hash::Add(int value) {
+	return Add(&value, sizeof(int));
+}
+
+Hash& Hash::Add(float value) {
+	return Add(&value, sizeof(float));
+}
+
+Hash& Hash::Add(glm::vec3 value) {
+	return Add(value.x).Add(value.y).Add(value.z);
+}
+
+uint64_t HashFile(std::string path) {
+	std::ifstream file(path, std::ios::binary);
+	if (!file) return 0;
+
+	Hash hash;
+	std::vector<char> chunk(1 << 16);
+	while (file) {
+		file.read(chunk.data(), chunk.size());
+		hash.Add(chunk.data(), (size_t)file.gcount());
+	}
+
+	return hash.Value;
+}
@@ -0,0 +1,20 @@
+#include <string>
+#include <cstdint>
+#include <glm/glm.hpp>
+
+#pragma once
+
+// FNV-1a hash builder, used to key caches and to notice when render state changes.
+class Hash {
+public:
+	Hash& Add(const void*, size_t);
+	Hash& Add(std::string const&);
+	Hash& Add(int);
+	Hash& Add(float);
+	Hash& Add(glm::vec3);
+
+	uint64_t Value = 14695981039346656037ULL;
+};
+
+// hash of a file's contents, 0 when it cannot be read.
+uint64_t HashFile(std::string);
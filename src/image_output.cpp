@@ -0,0 +1,273 @@
+#include "image_output.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+#define EXR_FLOAT 2
+#define RLE_MIN_RUN 3
+#define RLE_MAX_RUN 127
+
+static std::string extensionOf(std::string path) {
+	auto dot = path.find_last_of('.');
+	if (dot == std::string::npos) return "";
+
+	std::string extension = path.substr(dot + 1);
+	std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+	return extension;
+}
+
+ImageOutput* ImageOutput::Create(std::string path, int width, int height, std::vector<std::string> channels, ExrCompression compression) {
+	auto extension = extensionOf(path);
+
+	if (extension == "exr") return new ExrOutput(path, width, height, channels, compression);
+	if (extension == "pfm") return new PfmOutput(path, width, height, channels);
+	if (extension == "hdr") return new HdrOutput(path, width, height, channels);
+
+	throw std::runtime_error(("Unsupported image format " + extension).c_str());
+}
+
+bool ImageOutput::IsSupported(std::string path) {
+	auto extension = extensionOf(path);
+	return extension == "exr" || extension == "pfm" || extension == "hdr";
+}
+
+// disks fill up, so a stream that went bad anywhere along the way fails the whole image.
+void ImageOutput::finish() {
+	bool written = file.good();
+	file.close();
+
+	if (!written) throw std::runtime_error("Unable to finish writing the image");
+}
+
+// ======================== EXR ========================
+// Single part scanline file, one line per block, FLOAT channels. The offset table is reserved up front
+// and filled in on Close once every block's position is known.
+template <typename T> static void put(std::vector<char>& out, T value) {
+	auto bytes = (const char*)&value;
+	out.insert(out.end(), bytes, bytes + sizeof(T));
+}
+
+static void putAttribute(std::vector<char>& out, std::string name, std::string type, std::vector<char> const& value) {
+	out.insert(out.end(), name.begin(), name.end());
+	out.push_back(0);
+	out.insert(out.end(), type.begin(), type.end());
+	out.push_back(0);
+	put<int32_t>(out, (int32_t)value.size());
+	out.insert(out.end(), value.begin(), value.end());
+}
+
+ExrOutput::ExrOutput(std::string path, int w, int h, std::vector<std::string> names, ExrCompression c) : compression(c) {
+	width = w;
+	height = h;
+	channels = (int)names.size();
+
+	file.open(path, std::ios::binary | std::ios::trunc);
+	if (!file) throw std::runtime_error(("Unable to open " + path).c_str());
+
+	// channels are stored in name order, both in the header and in every scanline.
+	for (int i = 0; i < channels; i++) order.push_back(i);
+	std::sort(order.begin(), order.end(), [&](int a, int b) { return names[a] < names[b]; });
+
+	std::vector<char> header;
+	put<int32_t>(header, 20000630);
+	put<int32_t>(header, 2);
+
+	std::vector<char> chlist;
+	for (int i : order) {
+		chlist.insert(chlist.end(), names[i].begin(), names[i].end());
+		chlist.push_back(0);
+		put<int32_t>(chlist, EXR_FLOAT);
+		put<int32_t>(chlist, 0);
+		put<int32_t>(chlist, 1);
+		put<int32_t>(chlist, 1);
+	}
+	chlist.push_back(0);
+
+	std::vector<char> box;
+	put<int32_t>(box, 0);
+	put<int32_t>(box, 0);
+	put<int32_t>(box, width - 1);
+	put<int32_t>(box, height - 1);
+
+	std::vector<char> one, center;
+	put<float>(one, 1.0f);
+	put<float>(center, 0.0f);
+	put<float>(center, 0.0f);
+
+	putAttribute(header, "channels", "chlist", chlist);
+	putAttribute(header, "compression", "compression", { (char)compression });
+	putAttribute(header, "dataWindow", "box2i", box);
+	putAttribute(header, "displayWindow", "box2i", box);
+	putAttribute(header, "lineOrder", "lineOrder", { 0 });
+	putAttribute(header, "pixelAspectRatio", "float", one);
+	putAttribute(header, "screenWindowCenter", "v2f", center);
+	putAttribute(header, "screenWindowWidth", "float", one);
+	header.push_back(0);
+
+	file.write(header.data(), header.size());
+	offsetTable = file.tellp();
+	offsets.assign(height, 0);
+	file.write((const char*)offsets.data(), offsets.size() * sizeof(unsigned long long));
+
+	scanline.resize((size_t)width * channels * sizeof(float));
+}
+
+void ExrOutput::WriteRows(const float *rows, int count) {
+	for (int r = 0; r < count && row < height; r++, row++) {
+		const float* planes = rows + (size_t)r * width * channels;
+		for (int c = 0; c < channels; c++) {
+			memcpy(&scanline[(size_t)c * width * sizeof(float)], planes + (size_t)order[c] * width, width * sizeof(float));
+		}
+
+		const char* data = scanline.data();
+		int32_t size = (int32_t)scanline.size();
+		if (compression == ExrCompression::Rle) {
+			int compressedSize = compress();
+			// a block that does not shrink is stored as is, readers tell by its size.
+			if (compressedSize < size) {
+				data = compressed.data();
+				size = compressedSize;
+			}
+		}
+
+		offsets[row] = (unsigned long long)file.tellp();
+		int32_t y = row;
+		file.write((const char*)&y, sizeof(int32_t));
+		file.write((const char*)&size, sizeof(int32_t));
+		file.write(data, size);
+	}
+}
+
+void ExrOutput::Close() {
+	file.seekp(offsetTable);
+	file.write((const char*)offsets.data(), offsets.size() * sizeof(unsigned long long));
+	finish();
+}
+
+// OpenEXR's RLE codec: bytes split into even and odd halves, delta encoded, then run length encoded.
+int ExrOutput::compress() {
+	size_t size = scanline.size();
+	reordered.resize(size);
+	compressed.resize(size + size / RLE_MAX_RUN + 2);
+
+	size_t half = (size + 1) / 2;
+	for (size_t i = 0; i < size; i++) {
+		reordered[(i % 2 == 0 ? 0 : half) + i / 2] = scanline[i];
+	}
+
+	auto bytes = (unsigned char*)reordered.data();
+	int previous = bytes[0];
+	for (size_t i = 1; i < size; i++) {
+		int current = bytes[i];
+		bytes[i] = (unsigned char)(current - previous + (128 + 256));
+		previous = current;
+	}
+
+	const char* in = reordered.data();
+	const char* end = in + size;
+	const char* runStart = in;
+	const char* runEnd = in + 1;
+	signed char* out = (signed char*)compressed.data();
+
+	while (runStart < end) {
+		while (runEnd < end && *runStart == *runEnd && runEnd - runStart - 1 < RLE_MAX_RUN) ++runEnd;
+
+		if (runEnd - runStart >= RLE_MIN_RUN) {
+			*out++ = (signed char)((runEnd - runStart) - 1);
+			*out++ = *(const signed char*)runStart;
+			runStart = runEnd;
+		} else {
+			while (runEnd < end
+				&& ((runEnd + 1 >= end || *runEnd != *(runEnd + 1)) || (runEnd + 2 >= end || *(runEnd + 1) != *(runEnd + 2)))
+				&& runEnd - runStart < RLE_MAX_RUN) ++runEnd;
+
+			*out++ = (signed char)(runStart - runEnd);
+			while (runStart < runEnd) *out++ = *(const signed char*)(runStart++);
+		}
+
+		++runEnd;
+	}
+
+	return (int)(out - (signed char*)compressed.data());
+}
+
+// ======================== PFM ========================
+// Little endian RGB floats stored bottom row first, rows are placed by seeking since the size is fixed.
+PfmOutput::PfmOutput(std::string path, int w, int h, std::vector<std::string> names) {
+	width = w;
+	height = h;
+	channels = (int)names.size();
+	if (channels < 3) throw std::runtime_error("PFM output needs three channels");
+
+	file.open(path, std::ios::binary | std::ios::trunc);
+	if (!file) throw std::runtime_error(("Unable to open " + path).c_str());
+
+	file << "PF\n" << width << " " << height << "\n-1.0\n";
+	dataStart = file.tellp();
+}
+
+void PfmOutput::WriteRows(const float *rows, int count) {
+	std::vector<float> rgb((size_t)width * 3);
+
+	for (int r = 0; r < count && row < height; r++, row++) {
+		const float* planes = rows + (size_t)r * width * channels;
+		for (int x = 0; x < width; x++) {
+			for (int c = 0; c < 3; c++) rgb[x * 3 + c] = planes[(size_t)c * width + x];
+		}
+
+		file.seekp(dataStart + (std::streamoff)(height - 1 - row) * width * 3 * sizeof(float));
+		file.write((const char*)rgb.data(), rgb.size() * sizeof(float));
+	}
+}
+
+void PfmOutput::Close() {
+	finish();
+}
+
+// ======================== Radiance HDR ========================
+// Flat (not run length encoded) RGBE scanlines, top row first.
+HdrOutput::HdrOutput(std::string path, int w, int h, std::vector<std::string> names) {
+	width = w;
+	height = h;
+	channels = (int)names.size();
+	if (channels < 3) throw std::runtime_error("HDR output needs three channels");
+
+	file.open(path, std::ios::binary | std::ios::trunc);
+	if (!file) throw std::runtime_error(("Unable to open " + path).c_str());
+
+	file << "#?RADIANCE\nFORMAT=32-bit_rle_rgbe\n\n-Y " << height << " +X " << width << "\n";
+}
+
+void HdrOutput::WriteRows(const float *rows, int count) {
+	std::vector<unsigned char> rgbe((size_t)width * 4);
+
+	for (int r = 0; r < count && row < height; r++, row++) {
+		const float* planes = rows + (size_t)r * width * channels;
+		for (int x = 0; x < width; x++) {
+			float red = std::max(0.0f, planes[x]);
+			float green = std::max(0.0f, planes[width + x]);
+			float blue = std::max(0.0f, planes[2 * width + x]);
+			float brightest = std::max(red, std::max(green, blue));
+
+			unsigned char* pixel = &rgbe[x * 4];
+			if (brightest < 1e-32f) {
+				pixel[0] = pixel[1] = pixel[2] = pixel[3] = 0;
+			} else {
+				int exponent;
+				float scale = frexpf(brightest, &exponent) * 256.0f / brightest;
+				pixel[0] = (unsigned char)(red * scale);
+				pixel[1] = (unsigned char)(green * scale);
+				pixel[2] = (unsigned char)(blue * scale);
+				pixel[3] = (unsigned char)(exponent + 128);
+			}
+		}
+
+		file.write((const char*)rgbe.data(), rgbe.size());
+	}
+}
+
+void HdrOutput::Close() {
+	finish();
+}
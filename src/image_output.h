@@ -0,0 +1,69 @@
+#include <string>
+#include <vector>
+#include <fstream>
+
+#pragma once
+
+enum class ExrCompression {
+	None = 0,
+	Rle = 1
+};
+
+// Streaming writers for linear float images. Rows arrive top to bottom, each one holding every channel
+// as a separate plane of width floats, so only the band being written is ever in memory. EXR keeps
+// all the named channels as layers, PFM and Radiance HDR keep the first three as RGB.
+class ImageOutput {
+public:
+	virtual ~ImageOutput() {}
+
+	virtual void WriteRows(const float *, int) = 0;
+	virtual void Close() = 0;
+
+	static ImageOutput* Create(std::string, int, int, std::vector<std::string>, ExrCompression = ExrCompression::Rle);
+	static bool IsSupported(std::string);
+protected:
+	std::ofstream file;
+	int width;
+	int height;
+	int channels;
+	int row = 0;
+
+	void finish();
+};
+
+class ExrOutput : public ImageOutput {
+public:
+	ExrOutput(std::string, int, int, std::vector<std::string>, ExrCompression);
+
+	void WriteRows(const float *, int);
+	void Close();
+private:
+	ExrCompression compression;
+	std::vector<int> order;
+	std::vector<unsigned long long> offsets;
+	std::streamoff offsetTable;
+
+	std::vector<char> scanline;
+	std::vector<char> reordered;
+	std::vector<char> compressed;
+
+	int compress();
+};
+
+class PfmOutput : public ImageOutput {
+public:
+	PfmOutput(std::string, int, int, std::vector<std::string>);
+
+	void WriteRows(const float *, int);
+	void Close();
+private:
+	std::streamoff dataStart;
+};
+
+class HdrOutput : public ImageOutput {
+public:
+	HdrOutput(std::string, int, int, std::vector<std::string>);
+
+	void WriteRows(const float *, int);
+	void Close();
+};
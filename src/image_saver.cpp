@@ -0,0 +1,189 @@
+#include "image_saver.h"
+#include <thread_pool.h>
+#include <chrono>
+#include <memory>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+
+// rows resolved and written per step of a float export.
+#define EXPORT_BAND 64
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb_image_write.h>
+
+ImageSaver::~ImageSaver() {
+	for (auto& save : pending) {
+		if (save.fence) glDeleteSync(save.fence);
+		if (save.encoding.valid()) save.encoding.wait();
+		glDeleteBuffers(1, &save.buffer);
+	}
+
+	if (!freeBuffers.empty()) glDeleteBuffers((GLsizei)freeBuffers.size(), freeBuffers.data());
+}
+
+// Reads the bound read framebuffer, the caller picks the attachment with glReadBuffer.
+void ImageSaver::Save(std::string path, int width, int height) {
+	size_t bytes = (size_t)width * height * 4;
+	GLuint buffer = beginRead(bytes);
+
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+
+	endRead(path, buffer, bytes, [=](std::vector<unsigned char>& pixels) {
+		// GL rows start at the bottom, image files at the top.
+		size_t stride = (size_t)width * 4;
+		std::vector<unsigned char> row(stride);
+		for (int y = 0; y < height / 2; y++) {
+			unsigned char* top = pixels.data() + y * stride;
+			unsigned char* bottom = pixels.data() + (height - 1 - y) * stride;
+			memcpy(row.data(), top, stride);
+			memcpy(top, bottom, stride);
+			memcpy(bottom, row.data(), stride);
+		}
+
+		if (!stbi_write_png(path.c_str(), width, height, 4, pixels.data(), (int)stride)) {
+			throw std::runtime_error(("Unable to write " + path).c_str());
+		}
+	}, false);
+}
+
+// Reads the bound read framebuffer like Save, but gives the RGBA rows, bottom first, to consume from
+// Poll instead of encoding them on the pool. Frames therefore arrive in order, and a consumer that
+// blocks holds back the render loop.
+void ImageSaver::Capture(std::string label, int width, int height, std::function<void(std::vector<unsigned char>&)> consume) {
+	size_t bytes = (size_t)width * height * 4;
+	GLuint buffer = beginRead(bytes);
+
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+
+	endRead(label, buffer, bytes, consume, true);
+}
+
+// Reads the listed attachments of the bound read framebuffer as RGBA floats, one width * height block
+// after another, and streams the image to disk band by band on the thread pool. resolveRows fills rows
+// [top, top + count) counted from the top of the image out of those blocks, each row laid out as one
+// plane per channel.
+void ImageSaver::Export(std::string path, int width, int height, std::vector<GLenum> attachments, std::vector<std::string> channels,
+	ExrCompression compression, std::function<void(const float *, int, int, float *)> resolveRows) {
+	size_t block = (size_t)width * height * 4 * sizeof(float);
+	GLuint buffer = beginRead(block * attachments.size());
+
+	for (size_t i = 0; i < attachments.size(); i++) {
+		glReadBuffer(attachments[i]);
+		glReadPixels(0, 0, width, height, GL_RGBA, GL_FLOAT, (void*)(block * i));
+	}
+
+	endRead(path, buffer, block * attachments.size(), [=](std::vector<unsigned char>& pixels) {
+		std::unique_ptr<ImageOutput> output(ImageOutput::Create(path, width, height, channels, compression));
+		std::vector<float> planes((size_t)width * channels.size() * EXPORT_BAND);
+
+		for (int top = 0; top < height; top += EXPORT_BAND) {
+			int count = std::min(EXPORT_BAND, height - top);
+			resolveRows((const float*)pixels.data(), top, count, planes.data());
+			output->WriteRows(planes.data(), count);
+		}
+
+		output->Close();
+	}, false);
+}
+
+GLuint ImageSaver::beginRead(size_t bytes) {
+	GLuint buffer;
+	if (freeBuffers.empty()) {
+		glGenBuffers(1, &buffer);
+	} else {
+		buffer = freeBuffers.back();
+		freeBuffers.pop_back();
+	}
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, buffer);
+	glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr)bytes, nullptr, GL_STREAM_READ);
+	return buffer;
+}
+
+void ImageSaver::endRead(std::string path, GLuint buffer, size_t bytes, std::function<void(std::vector<unsigned char>&)> encode, bool immediate) {
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	PendingSave save;
+	save.path = path;
+	save.buffer = buffer;
+	save.bytes = bytes;
+	save.encode = encode;
+	save.immediate = immediate;
+	save.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	pending.push_back(std::move(save));
+
+	if (immediate) return;
+
+	status = "Saving " + path;
+	failed = false;
+}
+
+void ImageSaver::Poll() {
+	// captures are handed over in order, so none go past one that is still in flight.
+	bool captureWaiting = false;
+
+	for (auto it = pending.begin(); it != pending.end();) {
+		if (it->fence) {
+			// the flush makes sure the fence gets submitted, batch renders poll without any other GL work.
+			if ((it->immediate && captureWaiting) || glClientWaitSync(it->fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0) == GL_TIMEOUT_EXPIRED) {
+				captureWaiting = captureWaiting || it->immediate;
+				++it;
+				continue;
+			}
+
+			glDeleteSync(it->fence);
+			it->fence = nullptr;
+
+			auto pixels = std::make_shared<std::vector<unsigned char>>(it->bytes);
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, it->buffer);
+			glGetBufferSubData(GL_PIXEL_PACK_BUFFER, 0, pixels->size(), pixels->data());
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+			freeBuffers.push_back(it->buffer);
+
+			if (it->immediate) {
+				it->encode(*pixels);
+				it = pending.erase(it);
+				continue;
+			}
+
+			auto encode = it->encode;
+			it->encoding = ThreadPool::Instance()->Submit([=]() {
+				encode(*pixels);
+			});
+		}
+
+		if (it->encoding.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+			++it;
+			continue;
+		}
+
+		try {
+			it->encoding.get();
+			status = "Saved " + it->path;
+		} catch (std::exception ex) {
+			status = ex.what();
+			failed = true;
+		}
+
+		it = pending.erase(it);
+	}
+}
+
+bool ImageSaver::IsBusy() {
+	return !pending.empty();
+}
+
+int ImageSaver::GetPendingCount() {
+	return (int)pending.size();
+}
+
+bool ImageSaver::HasFailed() {
+	return failed;
+}
+
+std::string ImageSaver::GetStatus() {
+	return status;
+}
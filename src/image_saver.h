@@ -0,0 +1,46 @@
+#include <glad/glad.h>
+#include <string>
+#include <list>
+#include <vector>
+#include <future>
+#include <functional>
+#include <image_output.h>
+
+#pragma once
+
+// Saves framebuffer contents without stalling the render loop. Pixels are read into a pixel buffer
+// object behind a fence, copied out once the GPU has finished and encoded on the thread pool, so the
+// next frame renders while the last one is written.
+class ImageSaver {
+public:
+	~ImageSaver();
+
+	void Save(std::string, int, int);
+	void Capture(std::string, int, int, std::function<void(std::vector<unsigned char>&)>);
+	void Export(std::string, int, int, std::vector<GLenum>, std::vector<std::string>, ExrCompression, std::function<void(const float *, int, int, float *)>);
+	void Poll();
+
+	bool IsBusy();
+	int GetPendingCount();
+	bool HasFailed();
+	std::string GetStatus();
+private:
+	struct PendingSave {
+		std::string path;
+		GLuint buffer;
+		size_t bytes;
+		GLsync fence;
+		std::function<void(std::vector<unsigned char>&)> encode;
+		// handed over on the GL thread as soon as the pixels are in, in the order they were read.
+		bool immediate;
+		std::future<void> encoding;
+	};
+
+	std::list<PendingSave> pending;
+	std::vector<GLuint> freeBuffers;
+	std::string status;
+	bool failed = false;
+
+	GLuint beginRead(size_t);
+	void endRead(std::string, GLuint, size_t, std::function<void(std::vector<unsigned char>&)>, bool);
+};
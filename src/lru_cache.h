@@ -0,0 +1,59 @@
+#include <list>
+#include <map>
+#include <memory>
+#include <utility>
+
+#pragma once
+
+// Keeps the most recently used values up to a fixed count. Values are shared so an evicted entry
+// stays alive for anyone still holding it, and is released with the last reference.
+template <typename K, typename V> class LruCache {
+public:
+	LruCache(size_t capacity) : Capacity(capacity) {}
+
+	std::shared_ptr<V> Get(K const& key) {
+		auto found = index.find(key);
+		if (found == index.end()) {
+			Misses++;
+			return nullptr;
+		}
+
+		entries.splice(entries.begin(), entries, found->second);
+		Hits++;
+		return found->second->second;
+	}
+
+	void Put(K const& key, std::shared_ptr<V> value) {
+		auto found = index.find(key);
+		if (found != index.end()) {
+			entries.erase(found->second);
+			index.erase(found);
+		}
+
+		entries.emplace_front(key, value);
+		index[key] = entries.begin();
+
+		while (entries.size() > Capacity) {
+			index.erase(entries.back().first);
+			entries.pop_back();
+		}
+	}
+
+	void Clear() {
+		entries.clear();
+		index.clear();
+	}
+
+	size_t GetSize() {
+		return entries.size();
+	}
+
+	size_t Capacity;
+	int Hits = 0;
+	int Misses = 0;
+private:
+	typedef std::list<std::pair<K, std::shared_ptr<V>>> EntryList;
+
+	EntryList entries;
+	std::map<K, typename EntryList::iterator> index;
+};
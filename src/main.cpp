@@ -5,25 +5,44 @@
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 #include <imgui.h>
-#include <backends\imgui_impl_opengl3.h>
-#include <backends\imgui_impl_glfw.h>
+#include <backends/imgui_impl_opengl3.h>
+#include <backends/imgui_impl_glfw.h>
 #include <ui/scene-ui.h>
 #include <screen.h>
 #include <glm/glm.hpp>
 #include <environment.h>
 #include <ui/camera-ui.h>
 #include <ui/environment-ui.h>
-#include <ui\stats-ui.h>
+#include <ui/stats-ui.h>
 
 #include "main.h"
 #include <project.h>
 #include <ImGuiFileDialog.h>
-#include <ui\project-ui.h>
+#include <ui/project-ui.h>
+#include <ui/animation-ui.h>
+#include <batch_render.h>
+#include <texture_loader.h>
 
 
 void checkPressedAndReleased(GLFWwindow*, int, bool*, bool*);
 
-int main() {
+int main(int argc, char **argv) {
+	if (argc > 1) {
+		BatchOptions options;
+		std::string error;
+		if (!BatchRender::Parse(argc, argv, options, error)) {
+			std::cerr << error << std::endl;
+			BatchRender::PrintUsage();
+			return 2;
+		}
+
+		return BatchRender::Run(options);
+	}
+
+#ifdef SDF_STUDIO_HEADLESS
+	BatchRender::PrintUsage();
+	return 2;
+#endif
 
 	if (!glfwInit()) {
 		std::cout << "Unable to initialize Window\n";
@@ -81,6 +100,7 @@ int main() {
 
 	StatsUI statsUI;
 	ProjectUI projectUI(&project, &sceneUI, &environmentUI, &cameraUI);
+	AnimationUI animationUI(&project, &projectUI);
 
 	bool showUI = true;
 
@@ -89,7 +109,8 @@ int main() {
 	bool pausePressed = false;
 
 	while (!glfwWindowShouldClose(window)) {
-		if (project.ProjectCamera->IsMoving || statsUI.KeepRunning || (projectUI.Offline && !project.ProjectScene->Pause)) {
+		if (project.ProjectCamera->IsMoving || statsUI.KeepRunning || (projectUI.Offline && !project.ProjectScene->Pause) || project.ProjectScene->IsSaving() || animationUI.IsPlaying()
+			|| TextureLoader::Instance()->IsBusy() || project.ProjectEnvironment->IsLoading()) {
 			glfwPollEvents();
 		} else {
 			glfwWaitEvents();
@@ -102,9 +123,18 @@ int main() {
 
 		project.ProjectCamera->HandleInput(window);
 		sceneUI.HandleInput(window);
+		project.ProjectScene->PollSaves();
+		TextureLoader::Instance()->Update();
+		project.ProjectEnvironment->Update();
+		animationUI.Update();
 
 		if (projectUI.Offline) {
-			project.ProjectScene->OfflineRender();
+			if (animationUI.Sequence.IsActive()) {
+				animationUI.Sequence.Step();
+			} else {
+				project.ProjectScene->OfflineRender();
+				project.UpdateCheckpoint();
+			}
 			project.ProjectScene->OfflineDisplay(WIDTH, HEIGHT);
 		}
 		else {
@@ -123,6 +153,7 @@ int main() {
 			statsUI.Render();
 
 			projectUI.Render();
+			animationUI.Render();
 
 			ImGui::Render();
 			ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
@@ -0,0 +1,207 @@
+#include "material_array.h"
+#include <scene.h>
+#include <hash.h>
+#include <texture_file.h>
+#include <texture_loader.h>
+#include <thread_pool.h>
+#include <algorithm>
+
+MaterialArray::MaterialArray(Screen *s, std::vector<SceneMaterial> *m) : screen(s), materials(m) {
+	packProgram = new Program();
+	albedo = new Texture();
+	surface = new Texture();
+	normal = new Texture();
+
+	glGenFramebuffers(1, &fbo);
+}
+
+MaterialArray::~MaterialArray() {
+	for (auto texture : { albedo, surface, normal }) {
+		texture->DeleteTexture();
+		delete texture;
+	}
+
+	delete packProgram;
+	glDeleteFramebuffers(1, &fbo);
+}
+
+void MaterialArray::Link(std::string vertSource, std::string packSource) {
+	packProgram->Reload()
+		.Attach(vertSource, GL_VERTEX_SHADER)
+		.Attach(packSource, GL_FRAGMENT_SHADER)
+		.Link();
+}
+
+void MaterialArray::SetLayers(std::vector<std::string> names) {
+	layers = names;
+}
+
+void MaterialArray::Use(Program *program) {
+	if (state() != packedState) pack();
+
+	program->Bind("materialAlbedo", albedo)
+		.Bind("materialSurface", surface)
+		.Bind("materialNormal", normal);
+}
+
+// Changes with the layer size, the compression setting and every layer's state.
+uint64_t MaterialArray::state() {
+	Hash hash;
+	hash.Add(LayerSize).Add(TextureLoader::Instance()->Compress ? 1 : 0);
+
+	for (int layer = 0; layer < (int)layers.size(); layer++) {
+		uint64_t value = layerState(layer);
+		hash.Add(&value, sizeof(value));
+	}
+
+	return hash.Value;
+}
+
+// Changes with the layer's name and its maps' texture names, which are replaced when a load finishes.
+uint64_t MaterialArray::layerState(int layer) {
+	Hash hash;
+	hash.Add(layers[layer]);
+
+	auto material = findMaterial(layer);
+	if (!material) return hash.Value;
+
+	for (auto map : { material->albedo, material->roughness, material->metal, material->normal, material->ambientOcclusion }) {
+		hash.Add(map ? (int)map->TextureId : -1);
+	}
+
+	return hash.Value;
+}
+
+SceneMaterial* MaterialArray::findMaterial(int layer) {
+	auto material = std::find_if(materials->begin(), materials->end(), [&](SceneMaterial& m) { return m.name == layers[layer]; });
+	return material == materials->end() ? nullptr : &*material;
+}
+
+void MaterialArray::allocate(int count, bool compress) {
+	Texture* targets[3] = { albedo, surface, normal };
+	GLenum formats[3] = { GL_COMPRESSED_RGB_S3TC_DXT1_EXT, GL_COMPRESSED_RGB_S3TC_DXT1_EXT, GL_COMPRESSED_RG_RGTC2 };
+
+	for (int i = 0; i < 3; i++) {
+		targets[i]->DeleteTexture();
+		targets[i]->Allocate2DArray(LayerSize, LayerSize, count, compress ? formats[i] : GL_RGBA8);
+	}
+
+	allocatedLayers = count;
+	allocatedSize = LayerSize;
+	allocatedCompressed = compress;
+	layerStates.assign(count, 0);
+}
+
+void MaterialArray::pack() {
+	packedState = state();
+
+	int count = std::max((int)layers.size(), 1);
+	bool compress = TextureLoader::Instance()->Compress;
+	if (count != allocatedLayers || LayerSize != allocatedSize || compress != allocatedCompressed) allocate(count, compress);
+
+	std::vector<int> dirty;
+	for (int layer = 0; layer < (int)layers.size(); layer++) {
+		uint64_t value = layerState(layer);
+		if (value == layerStates[layer]) continue;
+
+		layerStates[layer] = value;
+		dirty.push_back(layer);
+	}
+
+	if (dirty.empty()) return;
+
+	// compressed layers are drawn into a staging array of the three maps, which only lives for this pack.
+	Texture staging;
+	if (compress) staging.Allocate2DArray(LayerSize, LayerSize, 3, GL_RGBA8, false);
+
+	// packing happens in the middle of binding another program, whose state is put back afterwards.
+	GLint previousFbo, previousProgram, viewport[4];
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFbo);
+	glGetIntegerv(GL_CURRENT_PROGRAM, &previousProgram);
+	glGetIntegerv(GL_VIEWPORT, viewport);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	glViewport(0, 0, LayerSize, LayerSize);
+
+	GLenum attachments[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 };
+	glDrawBuffers(3, attachments);
+	packProgram->Activate();
+
+	Texture* targets[3] = { albedo, surface, normal };
+	size_t layerBytes = (size_t)LayerSize * LayerSize * 4;
+	std::vector<std::vector<unsigned char>> pixels(compress ? dirty.size() : 0);
+
+	for (size_t d = 0; d < dirty.size(); d++) {
+		int layer = dirty[d];
+		for (int i = 0; i < 3; i++) {
+			glFramebufferTextureLayer(GL_FRAMEBUFFER, attachments[i], compress ? staging.TextureId : targets[i]->TextureId, 0, compress ? i : layer);
+		}
+
+		auto material = findMaterial(layer);
+		Texture* maps[5] = {};
+		if (material) {
+			maps[0] = material->albedo;
+			maps[1] = material->roughness;
+			maps[2] = material->metal;
+			maps[3] = material->ambientOcclusion;
+			maps[4] = material->normal;
+		}
+
+		// a missing or unloaded map falls back to the shader's defaults.
+		const char* names[5] = { "albedo", "roughness", "metal", "ambientOcclusion", "normal" };
+		int present = 0;
+		for (int i = 0; i < 5; i++) {
+			if (!maps[i] || (int)maps[i]->TextureId <= 0) continue;
+
+			packProgram->Bind(names[i], maps[i]);
+			present |= 1 << i;
+		}
+
+		packProgram->Bind("present", present);
+		screen->DrawQuad();
+
+		if (compress) {
+			pixels[d].resize(layerBytes * 3);
+			glBindTexture(GL_TEXTURE_2D_ARRAY, staging.TextureId);
+			glGetTexImage(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels[d].data());
+		}
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, previousFbo);
+	glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+	glUseProgram(previousProgram);
+
+	if (!compress) {
+		for (auto texture : targets) {
+			glBindTexture(GL_TEXTURE_2D_ARRAY, texture->TextureId);
+			glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+		}
+
+		return;
+	}
+
+	staging.DeleteTexture();
+
+	// every map of every repacked layer is encoded with its mip chain on its own worker.
+	GLenum formats[3] = { GL_COMPRESSED_RGB_S3TC_DXT1_EXT, GL_COMPRESSED_RGB_S3TC_DXT1_EXT, GL_COMPRESSED_RG_RGTC2 };
+	std::vector<std::vector<unsigned char>> encoded(dirty.size() * 3);
+	ThreadPool::Instance()->ParallelFor((int)encoded.size(), [&](int i) {
+		TextureFile::Encode(pixels[i / 3].data() + layerBytes * (i % 3), LayerSize, LayerSize, 4, formats[i % 3], encoded[i]);
+	});
+
+	for (size_t i = 0; i < encoded.size(); i++) {
+		upload(targets[i % 3], formats[i % 3], dirty[i / 3], encoded[i]);
+	}
+}
+
+void MaterialArray::upload(Texture* texture, GLenum format, int layer, std::vector<unsigned char> const& blocks) {
+	glBindTexture(GL_TEXTURE_2D_ARRAY, texture->TextureId);
+
+	int levels = TextureFile::LevelCount(LayerSize, LayerSize);
+	for (int level = 0; level < levels; level++) {
+		int size = std::max(LayerSize >> level, 1);
+		glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, size, size, 1, format,
+			(GLsizei)TextureFile::LevelBytes(format, size, size),
+			blocks.data() + TextureFile::LevelOffset(format, LayerSize, LayerSize, level));
+	}
+}
@@ -0,0 +1,51 @@
+#include <program.h>
+#include <texture.h>
+#include <screen.h>
+#include <vector>
+#include <string>
+#include <cstdint>
+
+#pragma once
+
+struct SceneMaterial;
+
+// All material maps as layers of three texture arrays: albedo, roughness/metal/ambient occlusion packed
+// into one RGB surface map, and normal. Layer i belongs to the i-th material name the shader code was
+// generated with, so a compiled shader keeps matching its layers while materials are added or removed.
+// A layer is repacked on the GPU when one of its maps finishes loading. With texture compression on the
+// arrays are BC1 (albedo, surface) and BC5 (normal): layers are packed into a staging array, read back
+// and encoded on the thread pool.
+class MaterialArray {
+public:
+	MaterialArray(Screen *, std::vector<SceneMaterial> *);
+	~MaterialArray();
+
+	void Link(std::string, std::string);
+	void SetLayers(std::vector<std::string>);
+	void Use(Program *);
+
+	int LayerSize = 1024;
+private:
+	Screen* screen;
+	std::vector<SceneMaterial>* materials;
+	Program* packProgram;
+
+	Texture* albedo;
+	Texture* surface;
+	Texture* normal;
+
+	GLuint fbo;
+	std::vector<std::string> layers;
+	int allocatedLayers = 0;
+	int allocatedSize = 0;
+	bool allocatedCompressed = false;
+	uint64_t packedState = 0;
+	std::vector<uint64_t> layerStates;
+
+	uint64_t state();
+	uint64_t layerState(int);
+	SceneMaterial* findMaterial(int);
+	void allocate(int, bool);
+	void pack();
+	void upload(Texture*, GLenum, int, std::vector<unsigned char> const&);
+};
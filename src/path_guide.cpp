@@ -0,0 +1,91 @@
+#include "path_guide.h"
+
+// must match GUIDE_STRIDE in shaders/library/path_guide.glsl (64 direction bins + a running total)
+#define GUIDE_STRIDE 65
+#define FIRST_ITERATION_LENGTH 4
+#define LAST_ITERATION_LENGTH 128
+
+PathGuide::PathGuide() {
+	glGenBuffers(1, &sampleBuffer);
+	glGenBuffers(1, &trainBuffer);
+	Reset();
+}
+
+PathGuide::~PathGuide() {
+	glDeleteBuffers(1, &sampleBuffer);
+	glDeleteBuffers(1, &trainBuffer);
+}
+
+void PathGuide::Reset() {
+	if (allocatedCells != Cells) allocate();
+
+	GLuint zero = 0;
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, sampleBuffer);
+	glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, trainBuffer);
+	glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	Iteration = 0;
+	passes = 0;
+	iterationLength = FIRST_ITERATION_LENGTH;
+	training = true;
+}
+
+void PathGuide::Use(Program *program) {
+	if (Enabled != wasEnabled) {
+		wasEnabled = Enabled;
+		Reset();
+	}
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, sampleBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, trainBuffer);
+
+	program->Bind("useGuide", Enabled && Iteration > 0 ? 1 : 0)
+		.Bind("trainGuide", Enabled && training ? 1 : 0)
+		.Bind("guideCells", allocatedCells)
+		.Bind("guideCellSize", CellSize)
+		.Bind("guideFraction", GuideFraction);
+}
+
+void PathGuide::Update() {
+	if (!Enabled || !training) return;
+
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+	passes++;
+	if (passes < iterationLength) return;
+
+	// the finished iteration becomes the distribution we sample from, and training starts over
+	// with twice as many passes so each iteration learns from a better guided one.
+	GLsizeiptr size = (GLsizeiptr)allocatedCells * GUIDE_STRIDE * sizeof(GLuint);
+	glBindBuffer(GL_COPY_READ_BUFFER, trainBuffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, sampleBuffer);
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, size);
+
+	GLuint zero = 0;
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, trainBuffer);
+	glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	Iteration++;
+	passes = 0;
+	iterationLength *= 2;
+	training = iterationLength <= LAST_ITERATION_LENGTH;
+}
+
+size_t PathGuide::GetMemoryUsage() {
+	return 2 * (size_t)allocatedCells * GUIDE_STRIDE * sizeof(GLuint);
+}
+
+void PathGuide::allocate() {
+	GLsizeiptr size = (GLsizeiptr)Cells * GUIDE_STRIDE * sizeof(GLuint);
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, sampleBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, size, nullptr, GL_DYNAMIC_COPY);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, trainBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, size, nullptr, GL_DYNAMIC_COPY);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	allocatedCells = Cells;
+}
@@ -0,0 +1,35 @@
+#include <program.h>
+
+#pragma once
+
+// Hashed spatial grid of directional histograms used to guide diffuse bounces in the path tracer.
+// Training happens in iterations of doubling length, each one learning from the radiance of the
+// passes before it, until the distribution is frozen.
+class PathGuide {
+public:
+	PathGuide();
+	~PathGuide();
+
+	void Reset();
+	void Use(Program *);
+	void Update();
+
+	size_t GetMemoryUsage();
+
+	bool Enabled = false;
+	float GuideFraction = 0.5f;
+	float CellSize = 0.25f;
+	int Cells = 1 << 16;
+	int Iteration = 0;
+private:
+	GLuint sampleBuffer;
+	GLuint trainBuffer;
+
+	int allocatedCells = 0;
+	int passes = 0;
+	int iterationLength;
+	bool training;
+	bool wasEnabled = false;
+
+	void allocate();
+};
@@ -1,6 +1,10 @@
 #include <program.h>
-#include <glm\gtc\type_ptr.hpp>
+#include <glm/gtc/type_ptr.hpp>
 #include <vector>
+#include <algorithm>
+#include <stdexcept>
+
+std::vector<GLuint> Program::boundTextures;
 
 Program::~Program() {
 	glUseProgram(0);
@@ -14,6 +18,8 @@ Program& Program::Reload() {
 
 	for (GLuint shader : shaders) glDeleteShader(shader);
 	shaders.clear();
+	uniformLocations.clear();
+	samplerUnits.clear();
 	
 	program = glCreateProgram();
 
@@ -39,7 +45,7 @@ Program& Program::Attach(std::string src, GLenum type) {
 		glDeleteShader(shader);
 
 		fprintf(stderr, "error compile shader: \n%s\n", &errorLog[0]);
-		throw std::exception(errorLog.data());
+		throw std::runtime_error(errorLog.data());
 	}
 
 	shaders.push_back(shader);
@@ -62,9 +68,10 @@ Program& Program::Link() {
 		glGetProgramInfoLog(program, maxLength, &maxLength, &errorLog[0]);
 
 		fprintf(stderr, "error linking: %s \n", &errorLog[0]);
-		throw std::exception(errorLog.data());
+		throw std::runtime_error(errorLog.data());
 	}
 
+	assignSamplers();
 	return *this;
 }
 
@@ -73,6 +80,106 @@ Program& Program::Activate() {
 	return *this;
 }
 
+int Program::getUniformLocation(std::string const& name) {
+	auto found = uniformLocations.find(name);
+	if (found != uniformLocations.end()) return found->second;
+
+	// only complain the first time, most misses are uniforms the compiler optimized away.
+	int loc = glGetUniformLocation(program, name.c_str());
+	if (loc == -1) fprintf(stderr, "Unable to find uniform %s\n", name.c_str());
+
+	uniformLocations[name] = loc;
+	return loc;
+}
+
+Program& Program::Bind(std::string const& name, Texture* texture) {
+	auto found = samplerUnits.find(name);
+	if (found == samplerUnits.end()) return *this;
+
+	auto unit = found->second.unit;
+	if (unit >= boundTextures.size()) boundTextures.resize(unit + 1, 0);
+	if (boundTextures[unit] == texture->TextureId) return *this;
+
+	// glBindTextureUnit would need GL 4.5, the batch renderer also runs on 4.3 contexts.
+	glActiveTexture(GL_TEXTURE0 + unit);
+	glBindTexture(found->second.target, texture->TextureId);
+	glActiveTexture(GL_TEXTURE0);
+	boundTextures[unit] = texture->TextureId;
+	return *this;
+}
+
+// Called before a texture name is deleted, GL may hand the name out again for another texture.
+void Program::ForgetTexture(GLuint texture) {
+	for (auto& bound : boundTextures) {
+		if (bound == texture) bound = 0;
+	}
+}
+
+// Gives every active sampler (and sampler array element) its own unit from 1 up, set once here.
+void Program::assignSamplers() {
+	GLint maxUnits = 0, uniformCount = 0, maxName = 0;
+	glGetIntegerv(GL_MAX_COMBINED_TEXTURE_IMAGE_UNITS, &maxUnits);
+	glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &uniformCount);
+	glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxName);
+
+	samplerUnits.clear();
+	std::vector<GLchar> nameBuffer(std::max(maxName, 1));
+	GLuint unit = 1;
+
+	for (GLint i = 0; i < uniformCount; i++) {
+		GLint size = 0;
+		GLenum type = 0;
+		glGetActiveUniform(program, i, (GLsizei)nameBuffer.size(), nullptr, &size, &type, nameBuffer.data());
+
+		GLenum target = samplerTarget(type);
+		if (target == 0) continue;
+
+		// arrays are reported by their first element, "mats[0].maps[0]": only that last [0] indexes the
+		// sampler array, everything before it is part of the name.
+		std::string name(nameBuffer.data());
+		bool isArray = name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0;
+		auto base = isArray ? name.substr(0, name.size() - 3) : name;
+
+		if (unit + size > (GLuint)maxUnits) {
+			throw std::runtime_error(("Too many samplers, " + base + " needs a texture unit past " + std::to_string(maxUnits)).c_str());
+		}
+
+		std::vector<GLint> units(size);
+		for (GLint j = 0; j < size; j++) {
+			units[j] = unit;
+			samplerUnits[isArray ? base + "[" + std::to_string(j) + "]" : base] = { unit++, target };
+		}
+		if (isArray) samplerUnits[base] = { (GLuint)units[0], target };
+
+		glProgramUniform1iv(program, glGetUniformLocation(program, name.c_str()), size, units.data());
+	}
+}
+
+// The texture target a sampler type reads, 0 for uniforms that are not samplers.
+GLenum Program::samplerTarget(GLenum type) {
+	switch (type) {
+	case GL_SAMPLER_2D:
+	case GL_SAMPLER_2D_SHADOW:
+	case GL_INT_SAMPLER_2D:
+	case GL_UNSIGNED_INT_SAMPLER_2D:
+		return GL_TEXTURE_2D;
+	case GL_SAMPLER_2D_ARRAY:
+	case GL_SAMPLER_2D_ARRAY_SHADOW:
+	case GL_INT_SAMPLER_2D_ARRAY:
+	case GL_UNSIGNED_INT_SAMPLER_2D_ARRAY:
+		return GL_TEXTURE_2D_ARRAY;
+	case GL_SAMPLER_CUBE:
+	case GL_SAMPLER_CUBE_SHADOW:
+		return GL_TEXTURE_CUBE_MAP;
+	case GL_SAMPLER_3D:
+		return GL_TEXTURE_3D;
+	case GL_SAMPLER_BUFFER:
+		return GL_TEXTURE_BUFFER;
+	default:
+		return 0;
+	}
+}
+
 void Program::bind(GLuint loc, int value) {
 	glUniform1i(loc, value);
 }
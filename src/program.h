@@ -1,8 +1,9 @@
 #include <string>
-#include <glad\glad.h>
-#include <glm\glm.hpp>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
 #include <map>
 #include <vector>
+#include <texture.h>
 
 #pragma once
 
@@ -17,18 +18,35 @@ public:
 	Program& Activate();
 
 	template <typename T> Program& Bind(std::string const& name, T&& value) {
-		int loc = glGetUniformLocation(program, name.c_str());
+		int loc = getUniformLocation(name);
 		if (loc != -1)
 			bind(loc, std::forward<T>(value));
-		else
-			fprintf(stderr, "Unable to find uniform %s\n", name.c_str());
 
 		return *this;
 	}
 
+	// Samplers get their units when the program links, so binding a texture only touches its unit.
+	Program& Bind(std::string const&, Texture*);
+
+	static void ForgetTexture(GLuint);
+
 private:
+	struct SamplerUnit {
+		GLuint unit;
+		GLenum target;
+	};
+
 	GLuint program;
 	std::vector<GLuint> shaders;
+	std::map<std::string, int> uniformLocations;
+	std::map<std::string, SamplerUnit> samplerUnits;
+
+	// texture last bound to each unit by any program, unit 0 is left to uploads and ImGui.
+	static std::vector<GLuint> boundTextures;
+
+	int getUniformLocation(std::string const&);
+	void assignSamplers();
+	static GLenum samplerTarget(GLenum);
 
 	void bind(GLuint, int);
 	void bind(GLuint, float);
@@ -3,12 +3,20 @@
 #include <sstream>
 #include <vector>
 #include <algorithm>
+#include <hash.h>
+#include <texture_loader.h>
 
 void Project::NewScene() {
 	SavePath = "";
+	auto previousScene = ProjectScene;
+	auto previousEnvironment = ProjectEnvironment;
+	auto previousCamera = ProjectCamera;
+	auto previousAnimation = ProjectAnimation;
+
 	ProjectCamera = new Camera(glm::vec3(0, 0, -3), glm::vec3(0, 0, 1));
 	ProjectEnvironment = new Environment();
 	ProjectScene = new Scene(ProjectCamera, ProjectEnvironment);
+	ProjectAnimation = new Animation();
 
 	ProjectEnvironment->GetLights()->push_back({
 		LightType::Sunlight,
@@ -45,6 +53,16 @@ SubSurfaceMaterial getSubsurfaceMaterial(Material m, int mid) {
 	ProjectScene->SetShader(ProjectScene->ShaderSource);
 	ProjectScene->InitShader();
 	(*ProjectScene->GetUniforms())[0].valuesf[0] = 1.0;
+
+	deleteScene(previousScene, previousEnvironment, previousCamera, previousAnimation);
+}
+
+// The replaced project goes once the new one holds its textures, so shared ones stay in the cache.
+void Project::deleteScene(Scene* scene, Environment* environment, Camera* camera, Animation* animation) {
+	delete scene;
+	delete environment;
+	delete camera;
+	delete animation;
 }
 
 bool Project::SaveScene() {
@@ -53,10 +71,92 @@ bool Project::SaveScene() {
 	std::ofstream fileData;
 	fileData.open(SavePath, std::ios_base::trunc | std::ios_base::in | std::ios_base::out);
 
+	fileData << serializeScene();
+
+	fileData
+		<< ProjectCamera->Fov << " "
+		<< ProjectCamera->Exposure << " "
+		<< outGLM(ProjectCamera->Position) << " "
+		<< outGLM(ProjectCamera->Direction) << " "
+		<< ProjectCamera->DepthOfField << std::endl;
+
+	fileData << "END CAMERA" << std::endl;
+
+	fileData << ProjectAnimation->Duration << " " << ProjectAnimation->FrameRate << " " << ProjectAnimation->Time << std::endl;
+	for (auto& key : ProjectAnimation->CameraKeys) {
+		fileData << "camera " << key.time << " "
+			<< outGLM(key.position) << " "
+			<< outGLM(key.direction) << " "
+			<< key.fov << " " << key.depthOfField << std::endl;
+	}
+
+	for (auto& curve : ProjectAnimation->UniformCurves) {
+		for (auto& key : curve.keys) {
+			fileData << "uniform " << curve.name << " " << key.time;
+			for (auto value : key.values) fileData << " " << value;
+			fileData << std::endl;
+		}
+	}
+	fileData << "END ANIMATION";
+
+	fileData << std::endl;
+	fileData.close();
+
+	return true;
+}
+
+std::string Project::GetCheckpointPath() {
+	return SavePath.empty() ? "" : SavePath + ".checkpoint";
+}
+
+// Writes a checkpoint every CheckpointInterval seconds of offline rendering, called once per frame.
+void Project::UpdateCheckpoint() {
+	if (CheckpointInterval <= 0.0f || SavePath.empty()) return;
+
+	double now = glfwGetTime();
+	if (lastCheckpoint == 0.0) lastCheckpoint = now;
+	if (now - lastCheckpoint < CheckpointInterval) return;
+
+	lastCheckpoint = now;
+	ProjectScene->WriteCheckpoint(GetCheckpointPath(), checkpointHash());
+}
+
+void Project::WriteCheckpoint() {
+	if (SavePath.empty()) return;
+
+	lastCheckpoint = glfwGetTime();
+	ProjectScene->WriteCheckpoint(GetCheckpointPath(), checkpointHash());
+}
+
+// The state as it would be saved, so a checkpoint matches the project file it was rendered from. Exposure
+// is left out since it is only applied on display.
+uint64_t Project::checkpointHash() {
+	std::stringstream camera;
+	camera << ProjectCamera->Fov << " "
+		<< outGLM(ProjectCamera->Position) << " "
+		<< outGLM(ProjectCamera->Direction) << " "
+		<< ProjectCamera->DepthOfField << " "
+		<< ProjectScene->SceneTime;
+
+	return Hash().Add(serializeScene()).Add(camera.str()).Value;
+}
+
+std::string Project::outGLM(glm::vec3 v) {
+	return std::string(std::to_string(v.x) + " " + std::to_string(v.y) + " " + std::to_string(v.z));
+}
+
+// Everything up to the camera section of a project file.
+std::string Project::serializeScene() {
+	std::stringstream fileData;
+
 	fileData << ProjectScene->ShaderSource << std::endl;
 	fileData << "END CODE" << std::endl;
 
-	fileData << ProjectScene->FudgeFactor << " " << ProjectScene->MaxDistance << " " << ProjectScene->ResolutionScale << std::endl;
+	fileData << ProjectScene->FudgeFactor << " " << ProjectScene->MaxDistance << " " << ProjectScene->ResolutionScale
+		<< " " << ProjectScene->Guide->Enabled << " " << ProjectScene->Guide->GuideFraction
+		<< " " << ProjectScene->Caustics->Enabled << " " << ProjectScene->Caustics->InitialRadius
+		<< " " << ProjectScene->Caustics->Extent << " " << (int)ProjectScene->Backend
+		<< " " << outGLM(ProjectScene->Caustics->Center) << std::endl;
 	fileData << "END DEBUG" << std::endl;
 
 	for (auto& material : *ProjectScene->GetMaterials()) {
@@ -86,15 +186,13 @@ bool Project::SaveScene() {
 	fileData << "END UNIFORMS" << std::endl;
 
 	if (!ProjectEnvironment->HdriPath.empty()) {
-		fileData << ProjectEnvironment->HdriPath << " " << ProjectEnvironment->LightPathExposure << " " << ProjectEnvironment->UseIrradianceForBackground << std::endl;
+		fileData << ProjectEnvironment->HdriPath << " " << ProjectEnvironment->LightPathExposure << " " << ProjectEnvironment->UseIrradianceForBackground
+			<< " " << ProjectEnvironment->PrefilterSize << " " << ProjectEnvironment->PrefilterSamples << " " << ProjectEnvironment->HdriWidth
+			<< " " << ProjectEnvironment->UseSphericalHarmonics << std::endl;
 	}
 
 	fileData << "END ENV" << std::endl;
 
-	auto outGLM = [&](glm::vec3 v) {
-		return std::string(std::to_string(v.x) + " " + std::to_string(v.y) + " " + std::to_string(v.z));
-	};
-	
 	for (auto &light : *ProjectEnvironment->GetLights()) {
 		fileData 
 			<< (int)light.type << " " 
@@ -106,19 +204,7 @@ bool Project::SaveScene() {
 
 	fileData << "END LIGHTS" << std::endl;
 
-	fileData
-		<< ProjectCamera->Fov << " "
-		<< ProjectCamera->Exposure << " "
-		<< outGLM(ProjectCamera->Position) << " "
-		<< outGLM(ProjectCamera->Direction) << " "
-		<< ProjectCamera->DepthOfField << std::endl;
-
-	fileData << "END CAMERA";
-
-	fileData << std::endl;
-	fileData.close();
-
-	return true;
+	return fileData.str();
 }
 
 enum class ReadMode {
@@ -128,16 +214,22 @@ enum class ReadMode {
 	Materials,
 	HdirPath,
 	Lights,
-	Camera
+	Camera,
+	Animation
 };
 
 void Project::LoadScene(std::string filePath) {
 	SavePath = filePath;
+	auto previousScene = ProjectScene;
+	auto previousEnvironment = ProjectEnvironment;
+	auto previousCamera = ProjectCamera;
+	auto previousAnimation = ProjectAnimation;
 
 	std::fstream fileData;
 	ProjectCamera = new Camera(glm::vec3(0, 0, -3), glm::vec3(0, 0, 1));
 	ProjectEnvironment = new Environment();
 	ProjectScene = new Scene(ProjectCamera, ProjectEnvironment);
+	ProjectAnimation = new Animation();
 
 	ReadMode CurrentReadMode = ReadMode::Code;
 
@@ -165,7 +257,16 @@ void Project::LoadScene(std::string filePath) {
 					CurrentReadMode = ReadMode::Materials;
 					ProjectScene->UpdateResolution();
 				} else {
-					ss >> ProjectScene->FudgeFactor >> ProjectScene->MaxDistance >> ProjectScene->ResolutionScale;
+					int backend = (int)ProjectScene->Backend;
+					ss >> ProjectScene->FudgeFactor >> ProjectScene->MaxDistance >> ProjectScene->ResolutionScale
+						>> ProjectScene->Guide->Enabled >> ProjectScene->Guide->GuideFraction
+						>> ProjectScene->Caustics->Enabled >> ProjectScene->Caustics->InitialRadius
+						>> ProjectScene->Caustics->Extent >> backend;
+					ProjectScene->Backend = (RenderBackend)backend;
+
+					// older projects end at the backend and keep the caustic center at the origin.
+					glm::vec3 center;
+					if (ss >> center.x >> center.y >> center.z) ProjectScene->Caustics->Center = center;
 				}
 				break;
 			case ReadMode::Materials:
@@ -198,29 +299,13 @@ void Project::LoadScene(std::string filePath) {
 					SceneMaterial material;
 					material.name = name;
 
-					material.albedo = new Texture();
 					material.albedoPath = findByType("_albedo");
-					material.albedo->LoadFromFile2D(material.albedoPath);
-
-					material.roughness = new Texture();
 					material.roughnessPath = findByType("_rough");
-					material.roughness->LoadFromFile2D(material.roughnessPath);
-
-					material.metal = new Texture();
 					material.metalPath = findByType("_metal");
-					material.metal->LoadFromFile2D(material.metalPath);
-
-					material.normal = new Texture();
 					material.normalPath = findByType("_normal");
-					material.normal->LoadFromFile2D(material.normalPath);
-
-					material.ambientOcclusion = new Texture();
 					material.ambientOcclusionPath = findByType("_ao");
-					material.ambientOcclusion->LoadFromFile2D(material.ambientOcclusionPath);
-
-					material.height = new Texture();
 					material.heightPath = findByType("_height");
-					material.height->LoadFromFile2D(material.heightPath);
+					Scene::LoadMaterialTextures(material);
 
 					ProjectScene->GetMaterials()->push_back(material);
 
@@ -266,6 +351,18 @@ void Project::LoadScene(std::string filePath) {
 					ss >> path >> exposure >> useIrr;
 					ProjectEnvironment->LightPathExposure = exposure;
 					ProjectEnvironment->UseIrradianceForBackground = useIrr;
+
+					// older projects stop after useIrr, prefilterSamples or hdriWidth and keep the defaults.
+					int prefilterSize, prefilterSamples, hdriWidth;
+					bool useSH;
+					if (ss >> prefilterSize >> prefilterSamples) {
+						ProjectEnvironment->PrefilterSize = prefilterSize;
+						ProjectEnvironment->PrefilterSamples = prefilterSamples;
+					}
+					if (ss >> hdriWidth) ProjectEnvironment->HdriWidth = hdriWidth;
+					if (ss >> useSH) ProjectEnvironment->UseSphericalHarmonics = useSH;
+					ProjectEnvironment->ClampSettings();
+
 					ProjectEnvironment->SetHDRI(path);
 					ProjectEnvironment->PreRender();
 				}
@@ -297,15 +394,55 @@ void Project::LoadScene(std::string filePath) {
 				}
 				break;
 			case ReadMode::Camera:
-				if (line != "END CAMERA") {
+				if (line == "END CAMERA") {
+					CurrentReadMode = ReadMode::Animation;
+				} else {
 					ss >> ProjectCamera->Fov >> ProjectCamera->Exposure;
 					ProjectCamera->Position = inGLM();
 					ProjectCamera->Direction = inGLM();
 					ss >> ProjectCamera->DepthOfField;
 				}
 				break;
+			case ReadMode::Animation:
+				if (line != "END ANIMATION") {
+					std::string kind;
+					ss >> kind;
+
+					if (kind == "camera") {
+						CameraKey key;
+						ss >> key.time;
+						key.position = inGLM();
+						key.direction = inGLM();
+						ss >> key.fov >> key.depthOfField;
+						ProjectAnimation->CameraKeys.push_back(key);
+					} else if (kind == "uniform") {
+						std::string name;
+						UniformKey key;
+						ss >> name >> key.time;
+						for (int i = 0; i < 16; i++) ss >> key.values[i];
+
+						auto curve = std::find_if(ProjectAnimation->UniformCurves.begin(), ProjectAnimation->UniformCurves.end(),
+							[&](UniformCurve& c) { return c.name == name; });
+						if (curve == ProjectAnimation->UniformCurves.end()) {
+							ProjectAnimation->UniformCurves.push_back({ name });
+							curve = ProjectAnimation->UniformCurves.end() - 1;
+						}
+						curve->keys.push_back(key);
+					} else {
+						std::stringstream(line) >> ProjectAnimation->Duration >> ProjectAnimation->FrameRate >> ProjectAnimation->Time;
+					}
+				}
+				break;
 			}
 		}
 	}
 
+	ProjectScene->SceneTime = ProjectAnimation->Time;
+	deleteScene(previousScene, previousEnvironment, previousCamera, previousAnimation);
+
+	// a resumed render can't have placeholders blended into it.
+	if (std::ifstream(GetCheckpointPath()).good()) TextureLoader::Instance()->Finish();
+
+	lastCheckpoint = 0.0;
+	ProjectScene->ResumeCheckpoint(GetCheckpointPath(), checkpointHash());
 }
@@ -1,15 +1,31 @@
 #include <scene.h>
+#include <animation.h>
 #pragma once
 
 class Project {
 public:
-	Scene* ProjectScene;
-	Environment* ProjectEnvironment;
-	Camera* ProjectCamera;
+	Scene* ProjectScene = nullptr;
+	Environment* ProjectEnvironment = nullptr;
+	Camera* ProjectCamera = nullptr;
+	Animation* ProjectAnimation = nullptr;
 
 	std::string SavePath;
 
 	void NewScene();
 	bool SaveScene();
 	void LoadScene(std::string);
+
+	std::string GetCheckpointPath();
+	void UpdateCheckpoint();
+	void WriteCheckpoint();
+
+	// seconds of offline rendering between checkpoints, 0 turns them off.
+	float CheckpointInterval = 300.0f;
+private:
+	double lastCheckpoint = 0.0;
+
+	void deleteScene(Scene*, Environment*, Camera*, Animation*);
+	std::string serializeScene();
+	uint64_t checkpointHash();
+	std::string outGLM(glm::vec3);
 };
\ No newline at end of file
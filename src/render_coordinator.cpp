@@ -0,0 +1,261 @@
+#include "render_coordinator.h"
+#include <tcp_socket.h>
+#include <checkpoint.h>
+#include <cache_file.h>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <stdexcept>
+
+RenderCoordinator::RenderCoordinator(BatchOptions o) : options(o) {
+}
+
+bool RenderCoordinator::Run(std::function<void(float)> progress, std::string& status) {
+	int width = options.Width, height = options.Height, size = options.TileSize;
+	int columns = (width + size - 1) / size;
+	int rows = (height + size - 1) / size;
+
+	// tiles go from the top row down like a poster, their offsets are GL pixels from the bottom left.
+	for (int ty = 0; ty < rows; ty++) {
+		for (int tx = 0; tx < columns; tx++) {
+			Tile tile;
+			tile.x = tx * size;
+			tile.width = std::min(size, width - tile.x);
+			tile.height = std::min(size, height - ty * size);
+			tile.y = height - ty * size - tile.height;
+			tiles.push_back(tile);
+		}
+	}
+
+	// with fewer tiles than workers the samples are split as well, so each worker gets about two units.
+	int tileCount = (int)tiles.size();
+	int splits = std::max(1, (2 * (int)options.Workers.size() + tileCount - 1) / tileCount);
+	int chunk = (options.Samples + splits - 1) / splits;
+
+	for (int i = 0; i < tileCount; i++) {
+		for (int first = 0; first < options.Samples; first += chunk) {
+			queue.push_back({ i, first, std::min(chunk, options.Samples - first) });
+			tiles[i].pending++;
+		}
+	}
+
+	int units = (int)queue.size();
+
+	std::vector<std::string> channels;
+	std::vector<RenderOutput> outputs;
+	Scene::ExportLayers(ExportAovs, channels, outputs);
+
+	// rows stream to a temporary file that replaces the destination only once the render is complete.
+	std::string temporary = TemporaryPath(options.OutputPath);
+	std::unique_ptr<ImageOutput> output;
+	try {
+		output.reset(ImageOutput::Create(temporary, width, height, channels, Compression));
+	} catch (std::exception ex) {
+		std::remove(temporary.c_str());
+		status = ex.what();
+		return false;
+	}
+
+	liveWorkers = (int)options.Workers.size();
+	std::vector<std::thread> threads;
+	for (auto& address : options.Workers) threads.emplace_back(&RenderCoordinator::work, this, address);
+
+	int row = 0;
+	int seen = -1;
+	bool failed = false;
+	{
+		std::unique_lock<std::mutex> lock(stateMutex);
+		while (row < rows) {
+			stateChanged.wait(lock, [&]() { return finishedUnits != seen || liveWorkers == 0; });
+			seen = finishedUnits;
+
+			while (row < rows && rowFinished(row, columns)) {
+				lock.unlock();
+				try {
+					writeRow(output.get(), row, columns, outputs, (int)channels.size());
+				} catch (std::exception ex) {
+					lastError = ex.what();
+					failed = true;
+				}
+				lock.lock();
+
+				if (failed) break;
+				row++;
+			}
+
+			progress((float)finishedUnits / units);
+			if (failed || (row < rows && liveWorkers == 0)) {
+				failed = true;
+				break;
+			}
+		}
+
+		stopping = true;
+	}
+
+	stateChanged.notify_all();
+	for (auto& thread : threads) thread.join();
+
+	if (failed) {
+		output.reset();
+		std::remove(temporary.c_str());
+		status = lastError.empty() ? "No workers left" : lastError;
+		return false;
+	}
+
+	try {
+		output->Close();
+		output.reset();
+		if (!RenameOver(temporary, options.OutputPath)) throw std::runtime_error(("Unable to replace " + options.OutputPath).c_str());
+	} catch (std::exception ex) {
+		output.reset();
+		std::remove(temporary.c_str());
+		status = ex.what();
+		return false;
+	}
+
+	status = "Saved " + options.OutputPath;
+	return true;
+}
+
+void RenderCoordinator::work(std::string address) {
+	while (true) {
+		WorkUnit unit;
+		{
+			std::unique_lock<std::mutex> lock(stateMutex);
+			stateChanged.wait(lock, [this]() { return !queue.empty() || stopping; });
+			if (stopping) return;
+
+			unit = queue.front();
+			queue.pop_front();
+		}
+
+		std::vector<float> targets;
+		std::string error;
+		bool rendered = request(address, unit, targets, error);
+
+		std::lock_guard<std::mutex> lock(stateMutex);
+		if (!rendered) {
+			std::cerr << "Dropping worker " << address << ": " << error << std::endl;
+			lastError = address + ": " + error;
+			queue.push_front(unit);
+			liveWorkers--;
+			stateChanged.notify_all();
+			return;
+		}
+
+		merge(tiles[unit.tile], targets);
+		tiles[unit.tile].pending--;
+		finishedUnits++;
+		stateChanged.notify_all();
+	}
+}
+
+bool RenderCoordinator::request(std::string address, WorkUnit unit, std::vector<float>& targets, std::string& error) {
+	auto colon = address.rfind(':');
+	if (colon == std::string::npos) {
+		error = "workers are given as host:port";
+		return false;
+	}
+
+	auto& tile = tiles[unit.tile];
+	std::string body = "project " + options.ProjectPath + "\n"
+		+ "size " + std::to_string(options.Width) + "x" + std::to_string(options.Height) + "\n"
+		+ "region " + std::to_string(tile.x) + " " + std::to_string(tile.y) + " "
+		+ std::to_string(tile.width) + " " + std::to_string(tile.height) + "\n"
+		+ "first " + std::to_string(unit.first) + "\n"
+		+ "spp " + std::to_string(unit.count) + "\n";
+
+	std::string host = address.substr(0, colon);
+	// workers send a progress line after every pass, so the timeout only has to cover one pass.
+	auto connection = TcpSocket::Connect(host, atoi(address.c_str() + colon + 1), options.WorkerTimeout);
+	if (connection == TcpSocket::Invalid) {
+		error = "unable to connect";
+		return false;
+	}
+
+	TcpSocket::Send(connection, "POST /region HTTP/1.1\r\nHost: " + host + "\r\nContent-Length: "
+		+ std::to_string(body.size()) + "\r\n\r\n" + body);
+
+	std::string response;
+	std::vector<char> buffer(1 << 16);
+	int received;
+	while ((received = TcpSocket::Receive(connection, buffer.data(), (int)buffer.size())) > 0) {
+		response.append(buffer.data(), received);
+	}
+	TcpSocket::Close(connection);
+
+	auto headerEnd = response.find("\r\n\r\n");
+	if (response.compare(0, 12, "HTTP/1.1 200") != 0 || headerEnd == std::string::npos) {
+		error = headerEnd == std::string::npos ? "no response" : response.substr(headerEnd + 4);
+		return false;
+	}
+
+	// progress lines come first, then either an error or the targets behind a "region id bytes" line.
+	size_t position = headerEnd + 4;
+	while (position < response.size()) {
+		auto end = response.find('\n', position);
+		if (end == std::string::npos) break;
+
+		std::string line = response.substr(position, end - position);
+		position = end + 1;
+
+		if (line.compare(0, 6, "error ") == 0) {
+			error = line;
+			return false;
+		}
+
+		if (line.compare(0, 7, "region ") != 0) continue;
+
+		size_t bytes = (size_t)atoll(line.c_str() + line.rfind(' ') + 1);
+		size_t expected = (size_t)tile.width * tile.height * 16 * sizeof(float);
+		if (bytes != expected || response.size() - position < bytes) {
+			error = "truncated region";
+			return false;
+		}
+
+		targets.resize(bytes / sizeof(float));
+		memcpy(targets.data(), response.data() + position, bytes);
+		return true;
+	}
+
+	error = "no region in the response";
+	return false;
+}
+
+// The targets are sums with their sample counts in alpha, so merging ranges is a plain add.
+void RenderCoordinator::merge(Tile& tile, std::vector<float> const& targets) {
+	if (tile.targets.empty()) {
+		tile.targets = targets;
+		return;
+	}
+
+	Checkpoint::Accumulate(tile.targets, targets, false);
+}
+
+bool RenderCoordinator::rowFinished(int row, int columns) {
+	for (int tx = 0; tx < columns; tx++) {
+		if (tiles[row * columns + tx].pending > 0) return false;
+	}
+
+	return true;
+}
+
+void RenderCoordinator::writeRow(ImageOutput* output, int row, int columns, std::vector<RenderOutput> const& outputs, int channels) {
+	int width = options.Width;
+	int height = tiles[row * columns].height;
+	std::vector<float> planes((size_t)width * channels * height);
+
+	for (int tx = 0; tx < columns; tx++) {
+		auto& tile = tiles[row * columns + tx];
+		Scene::ResolveRows(outputs, tile.targets.data(), tile.width, tile.height, 0, tile.height, false, planes.data(), width, tile.x);
+
+		tile.targets.clear();
+		tile.targets.shrink_to_fit();
+	}
+
+	output->WriteRows(planes.data(), height);
+}
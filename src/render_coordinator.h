@@ -0,0 +1,57 @@
+#include <batch_render.h>
+#include <image_output.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+#pragma once
+
+// Spreads one render over worker processes started with --serve. The image is cut into tiles and
+// the samples into ranges, every (tile, range) unit goes to whichever worker is free, and the raw
+// sums that come back are added per tile. A worker that fails hands its unit back to the queue and
+// is dropped. Each row of tiles is written out as soon as all of its units are in.
+class RenderCoordinator {
+public:
+	RenderCoordinator(BatchOptions);
+
+	bool Run(std::function<void(float)>, std::string&);
+
+	bool ExportAovs = true;
+	ExrCompression Compression = ExrCompression::Rle;
+private:
+	struct Tile {
+		int x;
+		int y;
+		int width;
+		int height;
+
+		int pending = 0;
+		std::vector<float> targets;
+	};
+
+	struct WorkUnit {
+		int tile;
+		int first;
+		int count;
+	};
+
+	BatchOptions options;
+
+	std::vector<Tile> tiles;
+	std::deque<WorkUnit> queue;
+	std::mutex stateMutex;
+	std::condition_variable stateChanged;
+	int liveWorkers = 0;
+	int finishedUnits = 0;
+	bool stopping = false;
+	std::string lastError;
+
+	void work(std::string);
+	bool request(std::string, WorkUnit, std::vector<float>&, std::string&);
+	void merge(Tile&, std::vector<float> const&);
+	bool rowFinished(int, int);
+	void writeRow(ImageOutput*, int, int, std::vector<RenderOutput> const&, int);
+};
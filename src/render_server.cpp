@@ -0,0 +1,333 @@
+#include "render_server.h"
+#include <hash.h>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cstring>
+#include <tcp_socket.h>
+#include <texture_loader.h>
+
+#define REQUEST_LIMIT (1 << 20)
+
+RenderServer::WarmProject::~WarmProject() {
+	delete project.ProjectScene;
+	delete project.ProjectEnvironment;
+	delete project.ProjectCamera;
+	delete project.ProjectAnimation;
+}
+
+// each warm project keeps its full resolution accumulation targets, so only a few are held.
+RenderServer::RenderServer(int p) : port(p), listener(TcpSocket::Invalid), projects(4) {
+}
+
+RenderServer::~RenderServer() {
+	if (listener != TcpSocket::Invalid) TcpSocket::Close(listener);
+	if (acceptThread.joinable()) acceptThread.detach();
+}
+
+// Serves on 127.0.0.1 until the process is stopped, rendering on the calling (GL) thread.
+int RenderServer::Run() {
+	listener = TcpSocket::Listen(port);
+	if (listener == TcpSocket::Invalid) {
+		std::cerr << "Unable to listen on port " << port << std::endl;
+		return 1;
+	}
+
+	std::cout << "Listening on 127.0.0.1:" << port << std::endl;
+	acceptThread = std::thread(&RenderServer::accept, this);
+
+	while (true) {
+		RenderJob job;
+		{
+			std::unique_lock<std::mutex> lock(jobsMutex);
+			jobsChanged.wait(lock, [this]() { return !jobs.empty(); });
+
+			// highest priority first, oldest first among equals.
+			auto next = std::max_element(jobs.begin(), jobs.end(), [](RenderJob const& a, RenderJob const& b) {
+				return a.priority < b.priority || (a.priority == b.priority && a.id > b.id);
+			});
+
+			job = *next;
+			jobs.erase(next);
+		}
+
+		render(job);
+	}
+
+	return 0;
+}
+
+void RenderServer::accept() {
+	while (true) {
+		auto connection = TcpSocket::Accept(listener);
+		if (connection == TcpSocket::Invalid) return;
+
+		std::thread(&RenderServer::receive, this, connection).detach();
+	}
+}
+
+// Reads one HTTP request and queues the job it describes, the GL thread answers and closes it.
+void RenderServer::receive(uintptr_t connection) {
+	std::string request;
+	size_t headerEnd = std::string::npos;
+	size_t contentLength = 0;
+	char buffer[4096];
+
+	while (true) {
+		if (headerEnd != std::string::npos && request.size() >= headerEnd + 4 + contentLength) break;
+		if (request.size() > REQUEST_LIMIT) break;
+
+		int received = TcpSocket::Receive(connection, buffer, sizeof(buffer));
+		if (received <= 0) {
+			TcpSocket::Close(connection);
+			return;
+		}
+
+		request.append(buffer, received);
+		if (headerEnd == std::string::npos && (headerEnd = request.find("\r\n\r\n")) != std::string::npos) {
+			std::string headers = request.substr(0, headerEnd);
+			std::transform(headers.begin(), headers.end(), headers.begin(), ::tolower);
+
+			auto length = headers.find("content-length:");
+			if (length != std::string::npos) contentLength = (size_t)atol(headers.c_str() + length + 15);
+		}
+	}
+
+	std::string method, path;
+	std::stringstream(request) >> method >> path;
+
+	auto respond = [&](std::string status, std::string body) {
+		TcpSocket::Send(connection, "HTTP/1.1 " + status + "\r\nContent-Type: text/plain\r\nConnection: close\r\n\r\n" + body);
+	};
+
+	if (method != "POST" || (path != "/render" && path != "/region")) {
+		respond("404 Not Found", "jobs are POSTed to /render or /region\n");
+		TcpSocket::Close(connection);
+		return;
+	}
+
+	RenderJob job;
+	job.region = path == "/region";
+
+	std::string error;
+	if (headerEnd == std::string::npos || !parseJob(request.substr(headerEnd + 4, contentLength), job, error)) {
+		respond("400 Bad Request", "error " + error + "\n");
+		TcpSocket::Close(connection);
+		return;
+	}
+
+	job.connection = connection;
+	respond("200 OK", "");
+
+	size_t waiting;
+	{
+		std::lock_guard<std::mutex> lock(jobsMutex);
+		job.id = nextId++;
+		jobs.push_back(job);
+		waiting = jobs.size();
+	}
+
+	TcpSocket::Send(connection, "queued " + std::to_string(job.id) + " " + std::to_string(waiting) + "\n");
+	jobsChanged.notify_one();
+}
+
+// One "key value..." pair per line, the keys follow the command line options where they overlap.
+bool RenderServer::parseJob(std::string const& body, RenderJob& job, std::string& error) {
+	std::stringstream lines(body);
+	std::string line;
+
+	while (std::getline(lines, line)) {
+		if (!line.empty() && line.back() == '\r') line.pop_back();
+		if (line.empty() || line[0] == '#') continue;
+
+		std::stringstream ss(line);
+		std::string key;
+		ss >> key;
+
+		if (key == "project") ss >> job.options.ProjectPath;
+		else if (key == "out") ss >> job.options.OutputPath;
+		else if (key == "spp") ss >> job.options.Samples;
+		else if (key == "tile") ss >> job.options.TileSize;
+		else if (key == "priority") ss >> job.priority;
+		else if (key == "fov") ss >> job.fov;
+		else if (key == "exposure") ss >> job.exposure;
+		else if (key == "dof") ss >> job.depthOfField;
+		else if (key == "time") ss >> job.time;
+		else if (key == "first") ss >> job.firstSample;
+		else if (key == "region") ss >> job.rect.x >> job.rect.y >> job.rect.z >> job.rect.w;
+		else if (key == "size") {
+			std::string size;
+			ss >> size;
+			if (sscanf(size.c_str(), "%dx%d", &job.options.Width, &job.options.Height) != 2) {
+				error = "size should look like 640x360";
+				return false;
+			}
+		} else if (key == "camera") {
+			ss >> job.position.x >> job.position.y >> job.position.z
+				>> job.direction.x >> job.direction.y >> job.direction.z;
+			job.hasCamera = true;
+		} else if (key == "uniform") {
+			UniformOverride uniform;
+			float value;
+
+			ss >> uniform.name;
+			while (ss >> value) uniform.values.push_back(value);
+			job.uniforms.push_back(uniform);
+		} else {
+			error = "unknown key " + key;
+			return false;
+		}
+
+		if (ss.fail() && !ss.eof()) {
+			error = "bad value for " + key;
+			return false;
+		}
+	}
+
+	if (job.region) {
+		auto rect = job.rect;
+		if (job.options.ProjectPath.empty()) error = "project is required";
+		else if (job.options.Samples <= 0 || job.firstSample < 0) error = "spp should be positive";
+		else if (rect.x < 0 || rect.y < 0 || rect.z <= 0 || rect.w <= 0
+			|| rect.x + rect.z > job.options.Width || rect.y + rect.w > job.options.Height) error = "region should be inside size";
+
+		return error.empty();
+	}
+
+	if (job.options.ProjectPath.empty() || job.options.OutputPath.empty()) error = "project and out are required";
+	else if (job.options.Samples <= 0) error = "spp should be positive";
+	else if (job.options.Width <= 0 || job.options.Height <= 0) error = "size should be positive";
+	else if (job.options.TileSize < 16) error = "tile should be at least 16";
+	else if (!ImageOutput::IsSupported(job.options.OutputPath)
+		&& BatchRender::ResolutionScaleFor(job.options.Width, job.options.Height) < 0) {
+		error = "png output is limited to the window resolutions";
+	}
+
+	return error.empty();
+}
+
+std::shared_ptr<RenderServer::WarmProject> RenderServer::load(std::string path, bool& warm, std::string& error) {
+	std::ifstream file(path, std::ios::binary);
+	if (!file) {
+		error = "unable to open " + path;
+		return nullptr;
+	}
+
+	std::string contents((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	uint64_t key = Hash().Add(contents).Value;
+
+	auto cached = projects.Get(key);
+	warm = cached != nullptr;
+	if (warm) return cached;
+
+	auto loaded = std::make_shared<WarmProject>();
+	try {
+		loaded->project.LoadScene(path);
+		TextureLoader::Instance()->Finish();
+	} catch (std::exception ex) {
+		error = ex.what();
+		return nullptr;
+	}
+
+	auto scene = loaded->project.ProjectScene;
+	if (!scene->GetCompileError().empty()) {
+		error = scene->GetCompileError();
+		return nullptr;
+	}
+
+	auto camera = loaded->project.ProjectCamera;
+	loaded->position = camera->Position;
+	loaded->direction = camera->Direction;
+	loaded->fov = camera->Fov;
+	loaded->exposure = camera->Exposure;
+	loaded->depthOfField = camera->DepthOfField;
+	loaded->time = scene->SceneTime;
+	loaded->uniforms = *scene->GetUniforms();
+
+	projects.Put(key, loaded);
+	return loaded;
+}
+
+void RenderServer::render(RenderJob& job) {
+	auto id = std::to_string(job.id);
+	bool warm = false;
+	std::string error;
+
+	auto loaded = load(job.options.ProjectPath, warm, error);
+	if (!loaded) {
+		TcpSocket::Send(job.connection, "error " + id + " " + error + "\n");
+		TcpSocket::Close(job.connection);
+		return;
+	}
+
+	TcpSocket::Send(job.connection, "started " + id + (warm ? " warm" : " cold") + "\n");
+
+	auto scene = loaded->project.ProjectScene;
+	auto camera = loaded->project.ProjectCamera;
+
+	camera->Position = loaded->position;
+	camera->Direction = loaded->direction;
+	camera->Fov = loaded->fov;
+	camera->Exposure = job.exposure >= 0.0f ? job.exposure : loaded->exposure;
+	camera->DepthOfField = loaded->depthOfField;
+	*scene->GetUniforms() = loaded->uniforms;
+
+	// an animated frame is posed first, explicit overrides still win over its keys.
+	scene->SceneTime = job.time >= 0.0f ? job.time : loaded->time;
+	if (job.time >= 0.0f) loaded->project.ProjectAnimation->Apply(job.time, camera, scene->GetUniforms());
+
+	if (job.hasCamera) {
+		camera->Position = job.position;
+		camera->Direction = glm::normalize(job.direction);
+	}
+	if (job.fov >= 0.0f) camera->Fov = job.fov;
+	if (job.depthOfField >= 0.0f) camera->DepthOfField = job.depthOfField;
+	for (auto& uniform : job.uniforms) {
+		auto found = std::find_if(scene->GetUniforms()->begin(), scene->GetUniforms()->end(), [&](SceneUniform& s) {
+			return s.name == uniform.name;
+		});
+
+		if (found == scene->GetUniforms()->end()) {
+			TcpSocket::Send(job.connection, "warning " + id + " no uniform named " + uniform.name + "\n");
+			continue;
+		}
+
+		for (size_t i = 0; i < uniform.values.size() && i < 16; i++) {
+			found->valuesf[i] = uniform.values[i];
+			found->valuesi[i] = (int)uniform.values[i];
+		}
+	}
+
+	if (job.region) {
+		// a line after every pass, the coordinator takes a quiet worker for a dead one.
+		auto targets = scene->RenderRegion(glm::ivec2(job.options.Width, job.options.Height), job.rect, job.firstSample, job.options.Samples,
+			[&](float progress) {
+			TcpSocket::Send(job.connection, "progress " + id + " " + std::to_string((int)(progress * 100.0f)) + "\n");
+		});
+		if (targets.empty()) {
+			TcpSocket::Send(job.connection, "error " + id + " the project is not ready\n");
+		} else {
+			size_t bytes = targets.size() * sizeof(float);
+			TcpSocket::Send(job.connection, "region " + id + " " + std::to_string(bytes) + "\n");
+			TcpSocket::Send(job.connection, targets.data(), bytes);
+		}
+
+		TcpSocket::Close(job.connection);
+		return;
+	}
+
+	int lastReported = -1;
+	std::string status;
+	scene->ResetAccumulation();
+	bool rendered = BatchRender::Render(scene, job.options, [&](float progress) {
+		int percent = (int)(progress * 100.0f);
+		if (percent / 5 == lastReported / 5) return;
+
+		lastReported = percent;
+		TcpSocket::Send(job.connection, "progress " + id + " " + std::to_string(percent) + "\n");
+	}, status);
+
+	TcpSocket::Send(job.connection, (rendered ? "done " : "error ") + id + " " + status + "\n");
+	TcpSocket::Close(job.connection);
+}
@@ -0,0 +1,82 @@
+#include <project.h>
+#include <batch_render.h>
+#include <lru_cache.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+
+#pragma once
+
+struct UniformOverride {
+	std::string name;
+	std::vector<float> values;
+};
+
+struct RenderJob {
+	int id;
+	int priority = 0;
+	uintptr_t connection;
+
+	BatchOptions options;
+	bool hasCamera = false;
+	glm::vec3 position;
+	glm::vec3 direction;
+	float fov = -1.0f;
+	float exposure = -1.0f;
+	float depthOfField = -1.0f;
+	float time = -1.0f;
+	std::vector<UniformOverride> uniforms;
+
+	// region jobs return raw accumulation targets instead of writing a file.
+	bool region = false;
+	glm::ivec4 rect;
+	int firstSample = 0;
+};
+
+// Long lived render process on localhost. Jobs are POSTed to /render as "key value" lines naming
+// a project file and its overrides, run highest priority first on the GL thread, and answered
+// with a stream of progress lines. Loaded projects stay warm in an LRU keyed by the project file's
+// contents, so their programs, textures and environments are only built once. Jobs POSTed to
+// /region render a sample range of one region for a RenderCoordinator and answer with its targets.
+class RenderServer {
+public:
+	RenderServer(int);
+	~RenderServer();
+
+	int Run();
+private:
+	// a loaded project along with the camera and uniforms it was saved with, restored before every job.
+	struct WarmProject {
+		~WarmProject();
+
+		Project project;
+		glm::vec3 position;
+		glm::vec3 direction;
+		float fov;
+		float exposure;
+		float depthOfField;
+		float time;
+		std::vector<SceneUniform> uniforms;
+	};
+
+	int port;
+	uintptr_t listener;
+	std::thread acceptThread;
+
+	std::vector<RenderJob> jobs;
+	std::mutex jobsMutex;
+	std::condition_variable jobsChanged;
+	int nextId = 1;
+
+	LruCache<uint64_t, WarmProject> projects;
+
+	void accept();
+	void receive(uintptr_t);
+	bool parseJob(std::string const&, RenderJob&, std::string&);
+
+	std::shared_ptr<WarmProject> load(std::string, bool&, std::string&);
+	void render(RenderJob&);
+};
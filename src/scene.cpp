@@ -4,9 +4,14 @@
 #include <streambuf>
 #include <sstream>
 #include <algorithm>
-
-#define STB_IMAGE_WRITE_IMPLEMENTATION
-#include <stb_image_write.h>
+#include <chrono>
+#include <limits>
+#include <hash.h>
+#include <checkpoint.h>
+#include <thread_pool.h>
+#include <texture_loader.h>
+#include <texture_cache.h>
+#include <stdexcept>
 
 
 Scene::Scene(Camera *c, Environment *e) : camera(c), environment(e) {
@@ -15,11 +20,23 @@ Scene::Scene(Camera *c, Environment *e) : camera(c), environment(e) {
 
 	offlineRenderProgram = new Program();
 	offlineDisplayProgram = new Program();
+	causticProgram = new Program();
 
 	screen = new Screen();
-	BrdfTexture = new Texture();
 	mainImage = new Texture();
 	offlineRender = new Texture();
+	offlineAlbedo = new Texture();
+	offlineNormal = new Texture();
+	offlineData = new Texture();
+	denoisedImage = new Texture();
+	Guide = new PathGuide();
+	Caustics = new CausticPhotons();
+	Denoising = new Denoiser();
+	Temporal = new TemporalFilter(screen);
+	MaterialMaps = new MaterialArray(screen, &sceneMaterials);
+	saver = new ImageSaver();
+	Poster = new TileRenderer();
+	wavefront = new WavefrontRenderer();
 
 	screen->PrepareQuad();
 
@@ -27,6 +44,10 @@ Scene::Scene(Camera *c, Environment *e) : camera(c), environment(e) {
 	rendererSource = getShaderSource("realtime_renderer");
 	offlineRenderSource = getShaderSource("offline_renderer");
 	brdfSource = getShaderSource("utils/precomputed_brdf");
+	causticSource = getShaderSource("caustic_photons");
+
+	Temporal->Link(vertSource, getShaderSource("svgf_reproject"), getShaderSource("svgf_atrous"));
+	MaterialMaps->Link(vertSource, getShaderSource("material_pack"));
 
 	librarySources = {
 		{ "<<NOISE>>", getShaderSource("library/noise") },
@@ -34,15 +55,52 @@ Scene::Scene(Camera *c, Environment *e) : camera(c), environment(e) {
 		{ "<<RAY_TRACE>>", getShaderSource("library/ray_trace") },
 		{ "<<MATERIALS>>", getShaderSource("library/materials") },
 		{ "<<DEBUG>>", getShaderSource("library/debug") },
-		{ "<<LIGHTING>>", getShaderSource("library/pbr_lighting") }
+		{ "<<LIGHTING>>", getShaderSource("library/pbr_lighting") },
+		{ "<<SAMPLING>>", getShaderSource("library/sampling") },
+		{ "<<PATH_GUIDE>>", getShaderSource("library/path_guide") },
+		{ "<<CAUSTICS>>", getShaderSource("library/caustics") },
+		{ "<<WAVEFRONT>>", getShaderSource("wavefront/common") },
+		{ "<<AOV>>", getShaderSource("library/aov") }
 	};
 
 	ready = false;
+	causticReady = false;
+	wavefrontReady = false;
 	renderBrdf();
 	ResolutionScale = 0;
 	UpdateResolution();
 }
 
+Scene::~Scene() {
+	if (checkpointWrite.valid()) checkpointWrite.wait();
+
+	for (auto program : { renderProgram, displayProgram, offlineRenderProgram, offlineDisplayProgram, causticProgram }) {
+		delete program;
+	}
+
+	for (auto texture : { mainImage, offlineRender, offlineAlbedo, offlineNormal, offlineData, denoisedImage }) {
+		texture->DeleteTexture();
+		delete texture;
+	}
+
+	for (auto& material : sceneMaterials) ReleaseMaterialTextures(material);
+
+	delete Guide;
+	delete Caustics;
+	delete Denoising;
+	delete Temporal;
+	delete MaterialMaps;
+	delete saver;
+	delete Poster;
+	delete wavefront;
+	delete screen;
+
+	glDeleteFramebuffers(1, &fbo);
+	glDeleteFramebuffers(1, &offlineFbo);
+	glDeleteFramebuffers(1, &renderFbo);
+	glDeleteRenderbuffers(1, &renderRbo);
+}
+
 void Scene::Render() {
 	if (ready && !Pause) {
 		auto res = getResolution();
@@ -56,18 +114,19 @@ void Scene::Render() {
 			.Bind("eye", camera->Position)
 			.Bind("fov", camera->Fov)
 			.Bind("exposure", camera->Exposure)
-			.Bind("brdf", BrdfTexture->Use2D())
+			.Bind("brdf", BrdfTexture)
 			.Bind("fudge", FudgeFactor)
 			.Bind("maxDistance", MaxDistance)
 			.Bind("maxIterations", MaxIterations)
 			.Bind("useDebugPlane", UseDebugPlane ? 1 : 0)
 			.Bind("debugPlaneHeight", DebugPlaneHeight)
-			.Bind("showRayMarchAmount", ShowRayAmount ? 1 : 0);
+			.Bind("showRayMarchAmount", ShowRayAmount ? 1 : 0)
+			.Bind("sceneTime", SceneTime);
 
 		environment->Use(renderProgram);
 
 		for (auto u : sceneUniforms) bindUniform(u, renderProgram);
-		for (auto t : sceneMaterials) bindMaterial(t, renderProgram);
+		MaterialMaps->Use(renderProgram);
 	}
 
 
@@ -76,40 +135,260 @@ void Scene::Render() {
 
 void Scene::OfflineRender() {
 	if (ready && !Pause) {
-		auto res = getResolution();
-		glBindFramebuffer(GL_FRAMEBUFFER, offlineFbo);
-		glViewport(0, 0, res.x, res.y);
-		glClear(GL_DEPTH_BUFFER_BIT);
+		resetStaleCaches();
 
-		offlineRenderProgram->Activate()
-			.Bind("resolution", res)
-			.Bind("camera", camera->GetViewMatrix())
-			.Bind("eye", camera->Position)
-			.Bind("fov", camera->Fov)
-			.Bind("fudge", FudgeFactor)
-			.Bind("maxDistance", MaxDistance)
-			.Bind("maxIterations", MaxIterations)
-			.Bind("time", (float)glfwGetTime())
-			.Bind("dof", camera->DepthOfField)
-			.Bind("lastPass", offlineRender->Use2D())
-			.Bind("shouldReset", camera->IsMoving ? 1 : 0);
+		if (camera->IsMoving) Caustics->Reset();
+		emitCaustics();
 
-		environment->Use(offlineRenderProgram, true);
+		if (Poster->IsActive()) {
+			renderPosterPass();
+			return;
+		}
 
-		for (auto u : sceneUniforms) bindUniform(u, offlineRenderProgram);
-		for (auto t : sceneMaterials) bindMaterial(t, offlineRenderProgram);
+		// samples taken with placeholder textures, or under the previous environment's maps, are thrown away
+		// once the new ones are in.
+		if (textureGeneration != TextureLoader::Instance()->Generation || environmentGeneration != environment->Generation) {
+			textureGeneration = TextureLoader::Instance()->Generation;
+			environmentGeneration = environment->Generation;
+			ResetAccumulation();
+		}
 
-		screen->DrawQuad();
+		// interactive mode keeps only the newest sample, the temporal filter does the accumulating.
+		bool reset = camera->IsMoving || Temporal->Enabled || resetRequested;
+		resetRequested = false;
+
+		// the wavefront backend falls back to the megakernel while it cannot be used.
+		if (Backend != RenderBackend::Wavefront || !pathTracePass(RenderBackend::Wavefront, reset)) {
+			pathTracePass(RenderBackend::Megakernel, reset);
+			Guide->Update();
+		}
+
+		if (Temporal->Enabled) {
+			Temporal->Filter(offlineRender, offlineAlbedo, offlineNormal, offlineData, camera);
+		}
+
+		// a fresh accumulation is a new run as far as merging checkpoints goes.
+		if (OfflineRenderAmounts == 0) runIds.assign(1, Checkpoint::NewRunId());
 		OfflineRenderAmounts++;
 	}
 }
 
+float Scene::Benchmark(RenderBackend backend, int passes) {
+	if (!ready || passes <= 0) return std::numeric_limits<float>::quiet_NaN();
+
+	// only the path tracing is timed, guide updates and caustic emission are left out. The warm up pass
+	// keeps kernel compilation and buffer allocation out of the timing, and finds an unusable backend.
+	resetStaleCaches();
+	if (!pathTracePass(backend, true)) return std::numeric_limits<float>::quiet_NaN();
+	glFinish();
+
+	auto start = std::chrono::high_resolution_clock::now();
+	for (int i = 0; i < passes; i++) pathTracePass(backend, false);
+	glFinish();
+	auto end = std::chrono::high_resolution_clock::now();
+
+	// the targets now hold benchmark samples.
+	ResetAccumulation();
+
+	return std::chrono::duration<float, std::milli>(end - start).count() / passes;
+}
+
+// One sample per pixel into the offline targets, false when the backend cannot be used.
+bool Scene::pathTracePass(RenderBackend backend, bool reset) {
+	auto res = getResolution();
+	if (backend == RenderBackend::Wavefront) {
+		if (!prepareWavefront()) return false;
+
+		wavefront->Render({ offlineRender, offlineAlbedo, offlineNormal, offlineData }, res, reset, [&](Program* kernel) {
+			bindPathTraceUniforms(kernel);
+		});
+		return true;
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, offlineFbo);
+	glViewport(0, 0, res.x, res.y);
+	glClear(GL_DEPTH_BUFFER_BIT);
+
+	offlineRenderProgram->Activate()
+		.Bind("lastPass", offlineRender)
+		.Bind("lastAlbedo", offlineAlbedo)
+		.Bind("lastNormal", offlineNormal)
+		.Bind("lastData", offlineData)
+		.Bind("shouldReset", reset ? 1 : 0)
+		.Bind("tileOffset", glm::vec2(0.0f))
+		.Bind("fullResolution", res)
+		.Bind("focusDistance", -1.0f);
+
+	bindPathTraceUniforms(offlineRenderProgram);
+	Guide->Use(offlineRenderProgram);
+
+	screen->DrawQuad();
+	return true;
+}
+
+Texture* Scene::GetOutput(RenderOutput output) {
+	switch (output) {
+	case RenderOutput::Albedo:
+		return offlineAlbedo;
+	case RenderOutput::Normal:
+		return offlineNormal;
+	case RenderOutput::Depth:
+	case RenderOutput::MaterialId:
+		return offlineData;
+	default:
+		return offlineRender;
+	}
+}
+
+// Reads an output back as averaged RGBA floats, bottom row first like the texture itself.
+std::vector<float> Scene::ReadOutput(RenderOutput output) {
+	auto texture = GetOutput(output);
+	std::vector<float> pixels((size_t)texture->Width * texture->Height * 4);
+
+	glBindTexture(GL_TEXTURE_2D, texture->TextureId);
+	glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, pixels.data());
+
+	for (size_t i = 0; i < pixels.size(); i += 4) {
+		auto value = ResolveOutput(output, &pixels[i]);
+		pixels[i] = value.x;
+		pixels[i + 1] = value.y;
+		pixels[i + 2] = value.z;
+		pixels[i + 3] = 1.0f;
+	}
+
+	// the first pixel holds the focus plane distance rather than a sample.
+	if (pixels.size() >= 8) std::copy(pixels.begin() + 4, pixels.begin() + 8, pixels.begin());
+
+	return pixels;
+}
+
+// Writes the sample averaged accumulation, or the temporal filter's output when it is on, and optionally
+// every AOV as extra layers, as linear floats.
+void Scene::ExportRender(std::string path) {
+	auto res = getResolution();
+	int width = (int)res.x, height = (int)res.y;
+
+	std::vector<std::string> channels;
+	std::vector<RenderOutput> outputs;
+	ExportLayers(ExportAovs, channels, outputs);
+
+	// the beauty layer is what the viewport shows, so the filtered image stands in for the accumulation
+	// while the targets are read. It is already averaged, with 1 in alpha.
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, offlineFbo);
+	if (Temporal->Enabled) glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, displayedBeauty()->TextureId, 0);
+
+	saver->Export(path, width, height, { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2, GL_COLOR_ATTACHMENT3 },
+		channels, ExportCompression, [=](const float* targets, int top, int count, float* planes) {
+		ResolveRows(outputs, targets, width, height, height - top - count, count, true, planes, width, 0);
+	});
+
+	if (Temporal->Enabled) glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, offlineRender->TextureId, 0);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+}
+
+void Scene::StartPoster(std::string path, int width, int height) {
+	if (!ready) return;
+
+	// tiles render once each, so none may be drawn with placeholders.
+	TextureLoader::Instance()->Finish();
+
+	std::vector<std::string> channels;
+	ExportLayers(ExportAovs, channels, posterOutputs);
+	Poster->Start(path, width, height, channels, ExportCompression);
+	if (!Poster->IsActive()) return;
+
+	Poster->FocusDistance = measureFocus(Poster->GetFullResolution());
+}
+
+// Renders passes [first, first + count) of one region of a width x height image, seeded by pass index
+// and starting from an empty guide and photon map, so any process renders the same samples. progress
+// hears the fraction done after each finished pass. Returns the raw targets (sums with the sample count
+// in alpha) one RGBA block per output after another, rows bottom first.
+std::vector<float> Scene::RenderRegion(glm::ivec2 full, glm::ivec4 region, int first, int count, std::function<void(float)> progress) {
+	std::vector<float> targets;
+	if (!ready || Poster->IsActive()) return targets;
+
+	int tileSize = Poster->TileSize;
+	Poster->TileSize = std::max(region.z, region.w);
+	Poster->Reserve();
+	Poster->TileSize = tileSize;
+
+	resetStaleCaches();
+	Guide->Reset();
+	Caustics->Reset();
+	float focus = measureFocus(full);
+	auto targetSize = glm::vec2(Poster->GetTarget(0)->Width, Poster->GetTarget(0)->Height);
+
+	for (int i = 0; i < count; i++) {
+		sampleSeed = first + i;
+		emitCaustics();
+
+		glBindFramebuffer(GL_FRAMEBUFFER, Poster->GetFramebuffer());
+		glViewport(0, 0, region.z, region.w);
+		glClear(GL_DEPTH_BUFFER_BIT);
+
+		offlineRenderProgram->Activate();
+		bindPathTraceUniforms(offlineRenderProgram);
+		offlineRenderProgram->Bind("resolution", targetSize)
+			.Bind("tileOffset", glm::vec2(region.x, region.y))
+			.Bind("fullResolution", glm::vec2(full))
+			.Bind("focusDistance", focus)
+			.Bind("lastPass", Poster->GetTarget(0))
+			.Bind("lastAlbedo", Poster->GetTarget(1))
+			.Bind("lastNormal", Poster->GetTarget(2))
+			.Bind("lastData", Poster->GetTarget(3))
+			.Bind("shouldReset", i == 0 ? 1 : 0);
+		Guide->Use(offlineRenderProgram);
+
+		screen->DrawQuad();
+		Guide->Update();
+
+		glFinish();
+		progress((float)(i + 1) / count);
+	}
+	sampleSeed = -1;
+
+	size_t block = (size_t)region.z * region.w * 4;
+	targets.resize(block * 4);
+
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, Poster->GetFramebuffer());
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	for (int i = 0; i < 4; i++) {
+		glReadBuffer(GL_COLOR_ATTACHMENT0 + i);
+		glReadPixels(0, 0, region.z, region.w, GL_RGBA, GL_FLOAT, targets.data() + block * i);
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	return targets;
+}
+
+void Scene::DenoiseRender() {
+	auto res = getResolution();
+	auto denoised = Denoising->Denoise(
+		ReadOutput(RenderOutput::Beauty),
+		ReadOutput(RenderOutput::Albedo),
+		ReadOutput(RenderOutput::Normal),
+		(int)res.x, (int)res.y);
+
+	glBindTexture(GL_TEXTURE_2D, denoisedImage->TextureId);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, (int)res.x, (int)res.y, GL_RGBA, GL_FLOAT, denoised.data());
+	denoisedSamples = OfflineRenderAmounts;
+}
+
+int Scene::GetDenoisedSamples() {
+	return denoisedSamples;
+}
+
+size_t Scene::GetWavefrontMemoryUsage() {
+	return wavefront->GetMemoryUsage();
+}
+
 void Scene::Display(int width, int height) {
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
 	glViewport(0, 0, width, height);
 	glClear(GL_DEPTH_BUFFER_BIT);
 
-	displayProgram->Activate().Bind("mainImage", mainImage->Use2D());
+	displayProgram->Activate().Bind("mainImage", mainImage);
 
 	screen->DrawQuad();
 }
@@ -119,9 +398,8 @@ void Scene::OfflineDisplay(int width, int height) {
 	glViewport(0, 0, width, height);
 	glClear(GL_DEPTH_BUFFER_BIT);
 
-	offlineDisplayProgram->Activate()
-		.Bind("lastPass", offlineRender->Use2D())
-		.Bind("exposure", camera->Exposure);
+	bool preview = ShowDenoisedPreview && denoisedSamples >= 0 && DisplayOutput == RenderOutput::Beauty;
+	bindOfflineDisplay(displayedBeauty(), preview ? denoisedImage : nullptr);
 
 	screen->DrawQuad();
 }
@@ -160,6 +438,11 @@ bool Scene::InitShader() {
 			.Attach(vertSource, GL_VERTEX_SHADER)
 			.Attach(offlineCode, GL_FRAGMENT_SHADER)
 			.Link();
+		Guide->Reset();
+		Caustics->Reset();
+		Temporal->Reset();
+		causticReady = false;
+		wavefrontReady = false;
 		
 		compileError.clear();
 		ready = true;
@@ -195,6 +478,7 @@ std::string Scene::GetUniformErrors() {
 
 void Scene::UpdateResolution() {
 	OfflineRenderAmounts = 0;
+	denoisedSamples = -1;
 	auto res = getResolution();
 
 	mainImage->DeleteTexture();
@@ -203,6 +487,11 @@ void Scene::UpdateResolution() {
 	offlineRender->DeleteTexture();
 	offlineRender->Allocate2D(res.x, res.y, false);
 
+	for (auto output : { offlineAlbedo, offlineNormal, offlineData, denoisedImage }) {
+		output->DeleteTexture();
+		output->Allocate2D(res.x, res.y, false);
+	}
+
 	auto source = getShaderSource("image_frag");
 	displayProgram->Reload()
 		.Attach(vertSource, GL_VERTEX_SHADER)
@@ -220,10 +509,18 @@ void Scene::UpdateResolution() {
 	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
 	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, mainImage->TextureId, 0);
 
+	Temporal->Allocate(res.x, res.y);
+
 	glDeleteFramebuffers(1, &offlineFbo);
 	glGenFramebuffers(1, &offlineFbo);
 	glBindFramebuffer(GL_FRAMEBUFFER, offlineFbo);
 	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, offlineRender->TextureId, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, offlineAlbedo->TextureId, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, offlineNormal->TextureId, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT3, GL_TEXTURE_2D, offlineData->TextureId, 0);
+
+	GLenum offlineAttachments[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2, GL_COLOR_ATTACHMENT3 };
+	glDrawBuffers(4, offlineAttachments);
 
 	glDeleteFramebuffers(1, &renderFbo);
 	glGenFramebuffers(1, &renderFbo);
@@ -232,62 +529,429 @@ void Scene::UpdateResolution() {
 	glDeleteRenderbuffers(1, &renderRbo);
 	glGenRenderbuffers(1, &renderRbo);
 	glBindRenderbuffer(GL_RENDERBUFFER, renderRbo);
-	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA, 1920, 1080);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, res.x, res.y);
 	glBindRenderbuffer(GL_RENDERBUFFER, 0);
 	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderRbo);
+	resetRequested = true;
+}
+
+// Starts the next offline pass from scratch, for when the camera or uniforms are changed by code.
+void Scene::ResetAccumulation() {
+	OfflineRenderAmounts = 0;
+	denoisedSamples = -1;
+	resetRequested = true;
+	Caustics->Reset();
 }
 
 void Scene::SaveRender(std::string path) {
-	auto size = getResolution();
-	int bufferSize = 1920 * 1080 * 4;
-	std::vector<char> buffer(bufferSize);
+	if (ImageOutput::IsSupported(path)) {
+		ExportRender(path);
+		return;
+	}
+
+	auto res = getResolution();
+	drawRenderTarget();
+	saver->Save(path, res.x, res.y);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+// Hands the displayed render to consume as 8-bit RGBA rows, bottom first, once it has been read back.
+void Scene::CaptureRender(std::string label, std::function<void(std::vector<unsigned char>&)> consume) {
+	auto res = getResolution();
+	drawRenderTarget();
+	saver->Capture(label, res.x, res.y, consume);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+// Tonemaps the offline render (denoised when enabled) into renderFbo and leaves it bound for reading.
+void Scene::drawRenderTarget() {
+	auto res = getResolution();
 
 	glBindFramebuffer(GL_FRAMEBUFFER, renderFbo);
-	glViewport(0, 0, 1920, 1080);
-	glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+	glViewport(0, 0, res.x, res.y);
 	glClear(GL_DEPTH_BUFFER_BIT);
 
-	offlineDisplayProgram->Activate()
-		.Bind("lastPass", offlineRender->Use2D())
-		.Bind("exposure", camera->Exposure);
+	bool denoise = Denoising->Enabled && DisplayOutput == RenderOutput::Beauty;
+	if (denoise) DenoiseRender();
+	bindOfflineDisplay(denoise ? denoisedImage : displayedBeauty(), nullptr);
 
 	screen->DrawQuad();
+	glReadBuffer(GL_COLOR_ATTACHMENT0);
+}
 
-	glPixelStorei(GL_PACK_ALIGNMENT, 4);
-	glReadBuffer(GL_FRONT);
+void Scene::PollSaves() {
+	saver->Poll();
+}
 
+bool Scene::IsSaving() {
+	return saver->IsBusy();
+}
 
-	glReadPixels(0, 0, 1920, 1080, GL_RGBA, GL_UNSIGNED_BYTE, buffer.data());
-	stbi_flip_vertically_on_write(true);
-	stbi_write_png(path.c_str(), 1920, 1080, 4, buffer.data(), 4 * 1920);
+int Scene::GetPendingSaves() {
+	return saver->GetPendingCount();
+}
 
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+std::string Scene::GetSaveStatus() {
+	return saver->GetStatus();
+}
+
+bool Scene::SaveFailed() {
+	return saver->HasFailed();
+}
+
+// Copies the offline targets and writes them on the pool. Only plain accumulation is saved, poster
+// passes and temporal filtering don't keep their sums in these targets.
+void Scene::WriteCheckpoint(std::string path, uint64_t stateHash) {
+	pollCheckpoint();
+	if (path.empty() || !ready || Poster->IsActive() || Temporal->Enabled || OfflineRenderAmounts <= 0) return;
+	if (checkpointWrite.valid()) return;
+
+	auto checkpoint = std::make_shared<Checkpoint>();
+	checkpoint->StateHash = stateHash;
+	checkpoint->RunIds = runIds;
+	checkpoint->Width = offlineRender->Width;
+	checkpoint->Height = offlineRender->Height;
+	checkpoint->Samples = OfflineRenderAmounts;
+
+	size_t block = (size_t)checkpoint->Width * checkpoint->Height * 4;
+	checkpoint->Targets.resize(block * 4);
+
+	int i = 0;
+	for (auto target : { offlineRender, offlineAlbedo, offlineNormal, offlineData }) {
+		glBindTexture(GL_TEXTURE_2D, target->TextureId);
+		glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, checkpoint->Targets.data() + block * i++);
+	}
+
+	checkpointSamples = checkpoint->Samples;
+	checkpointStatus = "Writing checkpoint at " + std::to_string(checkpointSamples) + " samples";
+	checkpointWrite = ThreadPool::Instance()->Submit([checkpoint, path]() {
+		checkpoint->Write(path);
+	});
+}
+
+// Continues from a checkpoint written for the same state and resolution, anything else is ignored.
+bool Scene::ResumeCheckpoint(std::string path, uint64_t stateHash) {
+	if (path.empty() || !ready) return false;
+
+	std::ifstream exists(path);
+	if (!exists) return false;
+	exists.close();
+
+	Checkpoint checkpoint;
+	try {
+		checkpoint.Read(path);
+	} catch (std::exception ex) {
+		checkpointStatus = ex.what();
+		return false;
+	}
+
+	if (checkpoint.StateHash != stateHash) {
+		checkpointStatus = "Checkpoint is from a different version of the project";
+		return false;
+	}
+
+	if (checkpoint.Width != offlineRender->Width || checkpoint.Height != offlineRender->Height) {
+		checkpointStatus = "Checkpoint is from a different resolution";
+		return false;
+	}
+
+	// rebuilt now so the first pass after resuming doesn't find the state changed and drop the samples.
+	resetStaleCaches();
+
+	size_t block = (size_t)checkpoint.Width * checkpoint.Height * 4;
+	int i = 0;
+	for (auto target : { offlineRender, offlineAlbedo, offlineNormal, offlineData }) {
+		glBindTexture(GL_TEXTURE_2D, target->TextureId);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, checkpoint.Width, checkpoint.Height, GL_RGBA, GL_FLOAT, checkpoint.Targets.data() + block * i++);
+	}
+
+	OfflineRenderAmounts = checkpoint.Samples;
+	runIds = checkpoint.RunIds;
+	textureGeneration = TextureLoader::Instance()->Generation;
+	environmentGeneration = environment->Generation;
+	denoisedSamples = -1;
+	resetRequested = false;
+	checkpointStatus = "Resumed at " + std::to_string(checkpoint.Samples) + " samples";
+	return true;
+}
+
+std::string Scene::GetCheckpointStatus() {
+	pollCheckpoint();
+	return checkpointStatus;
+}
+
+void Scene::pollCheckpoint() {
+	if (!checkpointWrite.valid() || checkpointWrite.wait_for(std::chrono::seconds(0)) != std::future_status::ready) return;
+
+	try {
+		checkpointWrite.get();
+		checkpointStatus = "Checkpoint written at " + std::to_string(checkpointSamples) + " samples";
+	} catch (std::exception ex) {
+		checkpointStatus = ex.what();
+	}
 }
 
 
+// The LUT only depends on the BRDF, so the first scene renders it and the rest share it.
+static Texture* sharedBrdf = nullptr;
+
 void Scene::renderBrdf() {
+	if (sharedBrdf != nullptr) {
+		BrdfTexture = sharedBrdf;
+		return;
+	}
+
+	BrdfTexture = new Texture();
 	BrdfTexture->Allocate2D();
 
 	renderProgram->Reload()
-		.Attach(vertSource, GL_VERTEX_SHADER)
-		.Attach(brdfSource, GL_FRAGMENT_SHADER)
+		.Attach(brdfSource, GL_COMPUTE_SHADER)
 		.Link()
 		.Activate();
 
+	glBindImageTexture(0, BrdfTexture->TextureId, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RG16F);
+	glDispatchCompute(BrdfTexture->Width / 8, BrdfTexture->Height / 8, 1);
+	glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
 
-	glGenFramebuffers(1, &fbo);
+	renderProgram->Reload();
+	sharedBrdf = BrdfTexture;
+}
 
-	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, BrdfTexture->TextureId, 0);
+bool Scene::prepareCaustics() {
+	if (causticReady) return true;
+
+	try {
+		causticProgram->Reload()
+			.Attach(updateSourceToCode(causticSource), GL_COMPUTE_SHADER)
+			.Link();
+
+		causticReady = true;
+	} catch (std::exception ex) {
+		compileError = ex.what();
+		Caustics->Enabled = false;
+	}
+
+	return causticReady;
+}
+
+bool Scene::prepareWavefront() {
+	if (wavefrontReady) return true;
+
+	try {
+		wavefront->Link([&](std::string kernel) {
+			return updateSourceToCode(getShaderSource("wavefront/" + kernel));
+		});
+
+		wavefrontReady = true;
+	} catch (std::exception ex) {
+		compileError = ex.what();
+		Backend = RenderBackend::Megakernel;
+	}
+
+	return wavefrontReady;
+}
+
+void Scene::bindPathTraceUniforms(Program *program) {
+	auto res = getResolution();
+	program->Bind("resolution", res)
+		.Bind("camera", camera->GetViewMatrix())
+		.Bind("eye", camera->Position)
+		.Bind("fov", camera->Fov)
+		.Bind("fudge", FudgeFactor)
+		.Bind("maxDistance", MaxDistance)
+		.Bind("maxIterations", MaxIterations)
+		.Bind("time", sampleSeed >= 0 ? (float)sampleSeed : (float)glfwGetTime())
+		.Bind("sceneTime", SceneTime)
+		.Bind("dof", camera->DepthOfField);
+
+	environment->Use(program, true);
+
+	for (auto u : sceneUniforms) bindUniform(u, program);
+	MaterialMaps->Use(program);
+
+	Caustics->Use(program);
+}
 
-	glViewport(0, 0, 512, 512);
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+// Reads count rows from GL row bottom of the bound read framebuffer, whose attachments are laid out like
+// offlineFbo's, into top first rows holding one plane of rowWidth floats per channel.
+void Scene::readOutputRows(std::vector<RenderOutput> const& outputs, int width, int bottom, int count, bool hasFocusPixel,
+	float* planes, int rowWidth, int column) {
+	size_t block = (size_t)width * count * 4;
+	std::vector<float> band(block * 4);
+
+	for (auto output : outputs) {
+		// depth and material id share an attachment, so only read it once.
+		if (output == RenderOutput::MaterialId) continue;
+
+		int attachment = outputAttachment(output);
+		glReadBuffer(GL_COLOR_ATTACHMENT0 + attachment);
+		glReadPixels(0, bottom, width, count, GL_RGBA, GL_FLOAT, band.data() + block * attachment);
+	}
+
+	ResolveRows(outputs, band.data(), width, count, 0, count, hasFocusPixel && bottom == 0, planes, rowWidth, column);
+}
+
+// Resolves count rows from GL row bottom of targets held in memory, one RGBA block of width * height per
+// offlineFbo attachment, into top first rows holding one plane of rowWidth floats per channel, written
+// from column on. Also resolves tiles that came back from render workers.
+void Scene::ResolveRows(std::vector<RenderOutput> const& outputs, const float* targets, int width, int height, int bottom, int count,
+	bool hasFocusPixel, float* planes, int rowWidth, int column) {
+	int channels = 0;
+	for (auto output : outputs) channels += output == RenderOutput::Depth || output == RenderOutput::MaterialId ? 1 : 3;
+
+	size_t block = (size_t)width * height * 4;
+	int plane = 0;
+
+	for (auto output : outputs) {
+		const float* target = targets + block * outputAttachment(output);
+		int components = output == RenderOutput::Depth || output == RenderOutput::MaterialId ? 1 : 3;
+
+		for (int r = 0; r < count; r++) {
+			int y = bottom + count - 1 - r;
+			float* row = planes + (size_t)r * rowWidth * channels + column;
+
+			for (int x = 0; x < width; x++) {
+				// the first pixel holds the focus plane distance rather than a sample.
+				int source = hasFocusPixel && y == 0 && x == 0 ? 1 : x;
+				auto value = ResolveOutput(output, &target[((size_t)y * width + source) * 4]);
+
+				for (int c = 0; c < components; c++) row[(size_t)(plane + c) * rowWidth + x] = value[c];
+			}
+		}
+
+		plane += components;
+	}
+}
+
+int Scene::outputAttachment(RenderOutput output) {
+	return output == RenderOutput::Beauty ? 0
+		: output == RenderOutput::Albedo ? 1
+		: output == RenderOutput::Normal ? 2
+		: 3;
+}
+
+// the guide and photons are world space, so only changes to what is lit rebuild them. The samples taken
+// with the old photon map or caustic settings are thrown away with them.
+void Scene::resetStaleCaches() {
+	auto stateHash = sceneStateHash();
+	if (stateHash != guideStateHash) {
+		guideStateHash = stateHash;
+		Guide->Reset();
+		ResetAccumulation();
+	}
+}
+
+void Scene::emitCaustics() {
+	if (!Caustics->Enabled || !prepareCaustics()) return;
+
+	causticProgram->Activate()
+		.Bind("fudge", FudgeFactor)
+		.Bind("maxDistance", MaxDistance)
+		.Bind("maxIterations", MaxIterations)
+		.Bind("sceneTime", SceneTime);
+
+	environment->UseLights(causticProgram, true);
+
+	for (auto u : sceneUniforms) bindUniform(u, causticProgram);
+	MaterialMaps->Use(causticProgram);
+
+	// seeded like the path tracing pass, so region renders emit the same photons on every worker.
+	Caustics->Emit(causticProgram, sampleSeed >= 0 ? (float)sampleSeed : (float)glfwGetTime());
+}
+
+// Tiles cannot measure the focus plane themselves, so one pixel is traced into the poster target
+// up front for all of them.
+float Scene::measureFocus(glm::vec2 fullResolution) {
+	glBindFramebuffer(GL_FRAMEBUFFER, Poster->GetFramebuffer());
+	glViewport(0, 0, 1, 1);
+
+	offlineRenderProgram->Activate();
+	bindPathTraceUniforms(offlineRenderProgram);
+	offlineRenderProgram->Bind("tileOffset", glm::vec2(0.0f))
+		.Bind("fullResolution", fullResolution)
+		.Bind("focusDistance", -1.0f)
+		.Bind("shouldReset", 1);
 	screen->DrawQuad();
+
+	float focus[4];
+	glReadBuffer(GL_COLOR_ATTACHMENT0);
+	glReadPixels(0, 0, 1, 1, GL_RGBA, GL_FLOAT, focus);
+
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	return focus[0];
+}
 
-	glDeleteFramebuffers(1, &fbo);
-	renderProgram->Reload();
+void Scene::renderPosterPass() {
+	auto size = Poster->GetTileSize();
+	auto targetSize = glm::vec2(Poster->GetTarget(0)->Width, Poster->GetTarget(0)->Height);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, Poster->GetFramebuffer());
+	glViewport(0, 0, size.x, size.y);
+	glClear(GL_DEPTH_BUFFER_BIT);
+
+	offlineRenderProgram->Activate();
+	bindPathTraceUniforms(offlineRenderProgram);
+	offlineRenderProgram->Bind("resolution", targetSize)
+		.Bind("tileOffset", Poster->GetTileOffset())
+		.Bind("fullResolution", Poster->GetFullResolution())
+		.Bind("focusDistance", Poster->FocusDistance)
+		.Bind("lastPass", Poster->GetTarget(0))
+		.Bind("lastAlbedo", Poster->GetTarget(1))
+		.Bind("lastNormal", Poster->GetTarget(2))
+		.Bind("lastData", Poster->GetTarget(3))
+		.Bind("shouldReset", Poster->ShouldReset() ? 1 : 0);
+	Guide->Use(offlineRenderProgram);
+
+	screen->DrawQuad();
+	Guide->Update();
+
+	if (Poster->FinishPass()) {
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, Poster->GetFramebuffer());
+		Poster->FinishTile([&](float* planes, int rowWidth, int column) {
+			readOutputRows(posterOutputs, (int)size.x, 0, (int)size.y, false, planes, rowWidth, column);
+		});
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void Scene::ExportLayers(bool aovs, std::vector<std::string>& channels, std::vector<RenderOutput>& outputs) {
+	channels = { "R", "G", "B" };
+	outputs = { RenderOutput::Beauty };
+
+	if (aovs) {
+		channels.insert(channels.end(), { "albedo.R", "albedo.G", "albedo.B", "normal.X", "normal.Y", "normal.Z", "depth.Z", "materialId.R" });
+		outputs.insert(outputs.end(), { RenderOutput::Albedo, RenderOutput::Normal, RenderOutput::Depth, RenderOutput::MaterialId });
+	}
+}
+
+// Turns one accumulated pixel of an output's target into its value.
+glm::vec3 Scene::ResolveOutput(RenderOutput output, const float* rgba) {
+	float samples = std::max(rgba[3], 1.0f);
+	glm::vec3 value(rgba[0], rgba[1], rgba[2]);
+
+	if (output == RenderOutput::Depth) return glm::vec3(value.x / samples);
+	if (output == RenderOutput::MaterialId) return glm::vec3(value.y);
+	if (output == RenderOutput::Normal) return glm::length(value) > 0.0f ? glm::normalize(value) : value;
+
+	return value / samples;
+}
+
+Texture* Scene::displayedBeauty() {
+	return Temporal->Enabled ? Temporal->GetOutput() : offlineRender;
+}
 
+void Scene::bindOfflineDisplay(Texture *beauty, Texture *compare) {
+	offlineDisplayProgram->Activate()
+		.Bind("lastPass", beauty)
+		.Bind("comparePass", compare ? compare : beauty)
+		.Bind("comparePosition", compare ? 0.5f : -1.0f)
+		.Bind("exposure", camera->Exposure)
+		.Bind("aov", (int)DisplayOutput)
+		.Bind("aovPass", GetOutput(DisplayOutput))
+		.Bind("maxDistance", MaxDistance);
 }
 
 void Scene::bindUniform(SceneUniform uniform, Program *program) {
@@ -312,13 +976,25 @@ void Scene::bindUniform(SceneUniform uniform, Program *program) {
 	}
 }
 
-void Scene::bindMaterial(SceneMaterial texture, Program *program) {
-	if (texture.albedo->TextureId > 0) program->Bind(texture.name + ".albedo", texture.albedo->Use2D());
-	if (texture.roughness->TextureId > 0) program->Bind(texture.name + ".roughness", texture.roughness->Use2D());
-	if (texture.metal->TextureId > 0) program->Bind(texture.name + ".metal", texture.metal->Use2D());
-	if (texture.normal->TextureId > 0) program->Bind(texture.name + ".normal", texture.normal->Use2D());
-	if (texture.ambientOcclusion->TextureId > 0) program->Bind(texture.name + ".ambientOcclusion", texture.ambientOcclusion->Use2D());
-	if (texture.height->TextureId > 0) program->Bind(texture.name + ".height", texture.height->Use2D());
+// Creates the material's textures and queues its files on the texture loader, placeholders are
+// neutral for each map until the files are in.
+void Scene::LoadMaterialTextures(SceneMaterial& material) {
+	auto cache = TextureCache::Instance();
+
+	material.albedo = cache->Acquire(material.albedoPath);
+	material.roughness = cache->Acquire(material.roughnessPath);
+	material.metal = cache->Acquire(material.metalPath, glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+	material.normal = cache->Acquire(material.normalPath, glm::vec4(0.5f, 0.5f, 1.0f, 1.0f), TextureKind::Normal);
+	material.ambientOcclusion = cache->Acquire(material.ambientOcclusionPath, glm::vec4(1.0f));
+}
+
+void Scene::ReleaseMaterialTextures(SceneMaterial& material) {
+	for (auto texture : { material.albedo, material.roughness, material.metal, material.normal, material.ambientOcclusion }) {
+		if (texture) TextureCache::Instance()->Release(texture);
+	}
+
+	material.albedo = material.roughness = material.metal = nullptr;
+	material.normal = material.ambientOcclusion = nullptr;
 }
 
 void Scene::getUniformsFromSource() {
@@ -337,7 +1013,7 @@ void Scene::getUniformsFromSource() {
 			int res = sscanf(line.c_str(), "uniform %s %[^;]; // SceneUniform %f,%f", typeName, name, &min, &max);
 
 			if (res < 4) {
-				throw std::exception("Was not able to properly parse uniform variable\n");
+				throw std::runtime_error("Was not able to properly parse uniform variable\n");
 			}
 
 			namesInSource.push_back(name);
@@ -377,12 +1053,19 @@ void Scene::getUniformsFromSource() {
 	);
 }
 
+// Materials become constant layer indices into the material arrays, in the order the arrays are packed.
 std::string Scene::addMaterialsToCode() {
-	std::string textureUniform = "";
-	for (auto texture : sceneMaterials) {
-		textureUniform += "uniform PBRTexture " + texture.name + ";\n";
+	std::string textureUniform = "uniform sampler2DArray materialAlbedo;\n"
+		"uniform sampler2DArray materialSurface;\n"
+		"uniform sampler2DArray materialNormal;\n";
+
+	std::vector<std::string> layers;
+	for (auto& texture : sceneMaterials) {
+		textureUniform += "const PBRTexture " + texture.name + " = PBRTexture(" + std::to_string(layers.size()) + ");\n";
+		layers.push_back(texture.name);
 	}
 
+	MaterialMaps->SetLayers(layers);
 	return textureUniform;
 }
 
@@ -406,6 +1089,30 @@ SceneUniform Scene::createUniform(std::string typeName, std::string name, float
 	return s;
 }
 
+uint64_t Scene::sceneStateHash() {
+	Hash hash;
+	hash.Add(ShaderSource)
+		.Add(FudgeFactor)
+		.Add(MaxDistance)
+		.Add(MaxIterations)
+		.Add(SceneTime)
+		.Add(environment->HdriPath)
+		.Add(environment->Generation)
+		.Add(environment->LightPathExposure)
+		.Add(environment->UseIrradianceForBackground ? 1 : 0)
+		.Add(environment->UseSphericalHarmonics ? 1 : 0)
+		.Add(Caustics->Enabled ? 1 : 0)
+		.Add(Caustics->Center)
+		.Add(Caustics->Extent)
+		.Add(Caustics->InitialRadius);
+
+	for (auto& u : sceneUniforms) hash.Add(u.valuesf, sizeof(u.valuesf)).Add(u.valuesi, sizeof(u.valuesi));
+	for (auto& m : sceneMaterials) hash.Add(m.name).Add(m.albedoPath);
+	for (auto& l : *environment->GetLights()) hash.Add((int)l.type).Add(l.position).Add(l.color);
+
+	return hash.Value;
+}
+
 glm::vec2 Scene::getResolution() {
 	if (ResolutionScale == 0) return glm::vec2(1920, 1080);
 	else if (ResolutionScale == 1) return glm::vec2(1600, 900);
@@ -422,10 +1129,10 @@ std::string Scene::getShaderSource(std::string shaderPath) {
 std::string Scene::updateSourceToCode(std::string code) {
 	std::string newCode = code;
 	auto start_pos = newCode.find("<<USER_CODE>>");
-	newCode.replace(start_pos, 13, ShaderSource);
+	if (start_pos != std::string::npos) newCode.replace(start_pos, 13, ShaderSource);
 
 	start_pos = newCode.find("<<TEXTURES>>");
-	newCode.replace(start_pos, 12, addMaterialsToCode());
+	if (start_pos != std::string::npos) newCode.replace(start_pos, 12, addMaterialsToCode());
 
 	for (auto const& x : librarySources) {
 		auto libStartPos = newCode.find(x.first);
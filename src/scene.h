@@ -3,7 +3,17 @@
 #include <camera.h>
 #include <screen.h>
 #include <environment.h>
+#include <path_guide.h>
+#include <caustics.h>
+#include <wavefront.h>
+#include <denoiser.h>
+#include <temporal_filter.h>
+#include <material_array.h>
+#include <image_saver.h>
+#include <tile_renderer.h>
 #include <map>
+#include <future>
+#include <functional>
 
 #pragma once
 
@@ -18,6 +28,19 @@ enum class UniformType {
 	Matrix4
 };
 
+enum class RenderBackend {
+	Megakernel = 0,
+	Wavefront
+};
+
+enum class RenderOutput {
+	Beauty = 0,
+	Albedo,
+	Normal,
+	Depth,
+	MaterialId
+};
+
 struct SceneUniform {
 	std::string name;
 	UniformType type;
@@ -47,8 +70,8 @@ struct SceneMaterial {
 	std::string ambientOcclusionPath;
 	Texture* ambientOcclusion;
 
+	// kept for the project file, nothing renders displacement so the map is never loaded.
 	std::string heightPath;
-	Texture* height;
 
 	bool operator==(SceneMaterial m) const {
 		return m.albedoPath == albedoPath;
@@ -58,6 +81,7 @@ struct SceneMaterial {
 class Scene {
 public:
 	Scene(Camera *, Environment *);
+	~Scene();
 
 	bool SetShader(std::string);
 	void SetEnvironment(std::string);
@@ -70,16 +94,49 @@ public:
 	void OfflineDisplay(int, int);
 
 	void SaveRender(std::string);
+	void CaptureRender(std::string, std::function<void(std::vector<unsigned char>&)>);
+	void ExportRender(std::string);
+	void StartPoster(std::string, int, int);
+	std::vector<float> RenderRegion(glm::ivec2, glm::ivec4, int, int, std::function<void(float)>);
+	void PollSaves();
+	bool IsSaving();
+	int GetPendingSaves();
+	std::string GetSaveStatus();
+	bool SaveFailed();
+	void WriteCheckpoint(std::string, uint64_t);
+	bool ResumeCheckpoint(std::string, uint64_t);
+	std::string GetCheckpointStatus();
+	void DenoiseRender();
+	// milliseconds per path tracing pass, NaN when the backend cannot run.
+	float Benchmark(RenderBackend, int);
 
 	std::string GetCompileError();
 	std::string GetUniformErrors();
 
 	std::vector<SceneUniform>* GetUniforms();
 	std::vector<SceneMaterial>* GetMaterials();
+	size_t GetWavefrontMemoryUsage();
+
+	Texture* GetOutput(RenderOutput);
+	std::vector<float> ReadOutput(RenderOutput);
+	int GetDenoisedSamples();
 
 	void UpdateResolution();
+	void ResetAccumulation();
+
+	static void LoadMaterialTextures(SceneMaterial&);
+	static void ReleaseMaterialTextures(SceneMaterial&);
+	static void ExportLayers(bool, std::vector<std::string>&, std::vector<RenderOutput>&);
+	static glm::vec3 ResolveOutput(RenderOutput, const float *);
+	static void ResolveRows(std::vector<RenderOutput> const&, const float *, int, int, int, int, bool, float *, int, int);
 
 	Texture* BrdfTexture;
+	PathGuide* Guide;
+	CausticPhotons* Caustics;
+	Denoiser* Denoising;
+	TemporalFilter* Temporal;
+	MaterialArray* MaterialMaps;
+	TileRenderer* Poster;
 	std::string ShaderSource = "";
 
 	float DebugPlaneHeight = -10.0f;
@@ -90,12 +147,23 @@ public:
 	int MaxIterations = 300;
 	bool ShowRayAmount = false;
 	bool Pause = false;
+	bool ShowDenoisedPreview = false;
+	bool ExportAovs = true;
+	ExrCompression ExportCompression = ExrCompression::Rle;
 	int OfflineRenderAmounts = 0;
+	// seconds into the animation, shaders see it as sceneTime.
+	float SceneTime = 0.0f;
+	RenderBackend Backend = RenderBackend::Megakernel;
+	RenderOutput DisplayOutput = RenderOutput::Beauty;
 private:
 	Program* renderProgram;
 	Program* displayProgram;
 	Program* offlineRenderProgram;
 	Program* offlineDisplayProgram;
+	Program* causticProgram;
+
+	WavefrontRenderer* wavefront;
+	ImageSaver* saver;
 
 	Screen* screen;
 	Camera* camera;
@@ -103,6 +171,10 @@ private:
 
 	Texture* mainImage;
 	Texture* offlineRender;
+	Texture* offlineAlbedo;
+	Texture* offlineNormal;
+	Texture* offlineData;
+	Texture* denoisedImage;
 	
 	std::vector<SceneUniform> sceneUniforms;
 	std::vector<SceneMaterial> sceneMaterials;
@@ -114,17 +186,44 @@ private:
 	std::string rendererSource;
 	std::string offlineRenderSource;
 	std::string brdfSource;
+	std::string causticSource;
 
 	std::map<std::string, std::string> librarySources;
 
-	GLuint fbo, offlineFbo, renderFbo, renderRbo;
+	GLuint fbo = 0, offlineFbo = 0, renderFbo = 0, renderRbo = 0;
 
 	bool ready;
+	bool causticReady;
+	bool wavefrontReady;
+	bool resetRequested = true;
+	int sampleSeed = -1;
+	int denoisedSamples = -1;
+	int textureGeneration = 0;
+	int environmentGeneration = 0;
+	std::vector<RenderOutput> posterOutputs;
+	uint64_t guideStateHash = 0;
+	std::vector<uint64_t> runIds;
+	std::future<void> checkpointWrite;
+	std::string checkpointStatus;
+	int checkpointSamples = 0;
 
 	void renderBrdf();
+	bool prepareCaustics();
+	bool prepareWavefront();
+	void bindPathTraceUniforms(Program *);
+	void bindOfflineDisplay(Texture *, Texture *);
+	Texture* displayedBeauty();
+	bool pathTracePass(RenderBackend, bool);
+	void drawRenderTarget();
+	void readOutputRows(std::vector<RenderOutput> const&, int, int, int, bool, float *, int, int);
+	static int outputAttachment(RenderOutput);
+	void renderPosterPass();
+	void resetStaleCaches();
+	void emitCaustics();
+	float measureFocus(glm::vec2);
+	void pollCheckpoint();
 
 	void bindUniform(SceneUniform, Program *);
-	void bindMaterial(SceneMaterial, Program *);
 
 	void getUniformsFromSource();
 	std::string addMaterialsToCode();
@@ -132,6 +231,7 @@ private:
 	SceneUniform createUniform(std::string, std::string, float, float);
 
 	glm::vec2 getResolution();
+	uint64_t sceneStateHash();
 
 	std::string getShaderSource(std::string);
 
@@ -1,6 +1,12 @@
 
 #include <screen.h>
 
+Screen::~Screen() {
+	glDeleteVertexArrays(1, &vao);
+	glDeleteBuffers(1, &vbo);
+	glDeleteBuffers(1, &ebo);
+}
+
 void Screen::PrepareQuad() {
 	GLfloat vertices[] = {
 	  1.0f,  1.0f, 0.0f, 1.0f, 1.0f,
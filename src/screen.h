@@ -5,11 +5,13 @@
 
 class Screen {
 public:
+	~Screen();
+
 	void PrepareQuad();
 	void DrawQuad();
 
 	void PrepareCube();
 	void DrawCube();
 private:
-	GLuint ebo, vbo, vao;
+	GLuint ebo = 0, vbo = 0, vao = 0;
 };
\ No newline at end of file
@@ -0,0 +1,152 @@
+#include "sequence_renderer.h"
+#include <image_output.h>
+#include <cstdio>
+
+SequenceRenderer::SequenceRenderer(Project* p) : project(p) {
+}
+
+// Renders frames first to last inclusive to pattern, see FramePath.
+void SequenceRenderer::Start(std::string path, int first, int last) {
+	pattern = path;
+	firstFrame = first;
+	lastFrame = std::max(first, last);
+	frame = firstFrame;
+
+	active = true;
+	frameStarted = false;
+	finishing = false;
+	Failed = false;
+	status = "Rendering " + std::to_string(lastFrame - firstFrame + 1) + " frames";
+
+	stream = nullptr;
+	if (!VideoStream::IsStream(path)) return;
+
+	auto beauty = project->ProjectScene->GetOutput(RenderOutput::Beauty);
+	stream = std::make_shared<VideoStream>();
+	try {
+		stream->Open(path, beauty->Width, beauty->Height, project->ProjectAnimation->FrameRate);
+	} catch (std::exception ex) {
+		fail(ex.what());
+	}
+}
+
+// One pass of the current frame, called once per loop iteration in place of OfflineRender.
+void SequenceRenderer::Step() {
+	auto scene = project->ProjectScene;
+	auto animation = project->ProjectAnimation;
+
+	// the failure flag belongs to the last save, so it only means something once a frame was handed over.
+	scene->PollSaves();
+	if (frame > firstFrame && scene->SaveFailed()) {
+		fail(scene->GetSaveStatus());
+		return;
+	}
+
+	if (stream && stream->HasFailed()) {
+		fail(stream->GetStatus());
+		return;
+	}
+
+	if (finishing) {
+		if (scene->IsSaving()) return;
+
+		finishing = false;
+		status = "Rendered frames " + std::to_string(firstFrame) + " to " + std::to_string(lastFrame);
+		if (stream) {
+			stream->Close();
+			status = stream->GetStatus();
+		}
+		return;
+	}
+
+	if (!active || scene->Pause) return;
+
+	if (!frameStarted) {
+		// the saver still holds too many frames, let it catch up before starting another.
+		if (scene->IsSaving() && scene->GetPendingSaves() >= FramesInFlight) return;
+
+		float time = (float)frame / animation->FrameRate;
+		animation->Time = time;
+		animation->Apply(time, project->ProjectCamera, scene->GetUniforms());
+		scene->SceneTime = time;
+		scene->ResetAccumulation();
+
+		frameStarted = true;
+		frameStart = glfwGetTime();
+	}
+
+	scene->OfflineRender();
+
+	bool outOfTime = SecondsPerFrame > 0.0f && glfwGetTime() - frameStart >= SecondsPerFrame;
+	if (scene->OfflineRenderAmounts < SamplesPerFrame && !outOfTime) return;
+
+	if (stream) {
+		// the stream is shared with the capture, a cancelled sequence may still have frames in the saver.
+		auto target = stream;
+		scene->CaptureRender("frame " + std::to_string(frame), [target](std::vector<unsigned char>& pixels) {
+			target->Push(pixels);
+		});
+	} else {
+		scene->SaveRender(FramePath(pattern, frame));
+	}
+	frameStarted = false;
+
+	if (++frame > lastFrame) {
+		active = false;
+		finishing = true;
+	}
+}
+
+void SequenceRenderer::Cancel() {
+	if (!active) return;
+
+	active = false;
+	finishing = false;
+	status = "Cancelled at frame " + std::to_string(frame);
+	if (stream) stream->Close();
+}
+
+bool SequenceRenderer::IsActive() {
+	return active || finishing;
+}
+
+float SequenceRenderer::GetProgress() {
+	float frames = (float)(lastFrame - firstFrame + 1);
+	float current = frameStarted ? std::min((float)project->ProjectScene->OfflineRenderAmounts / SamplesPerFrame, 1.0f) : 0.0f;
+
+	return std::min((frame - firstFrame + current) / frames, 1.0f);
+}
+
+std::string SequenceRenderer::GetStatus() {
+	if (active) return "Frame " + std::to_string(frame) + " of " + std::to_string(firstFrame) + "-" + std::to_string(lastFrame);
+	return status;
+}
+
+// Replaces the last run of # in pattern with the zero padded frame number, or adds one before the
+// extension when there is none.
+std::string SequenceRenderer::FramePath(std::string const& pattern, int frame) {
+	auto end = pattern.find_last_of('#');
+	if (end == std::string::npos) {
+		auto dot = pattern.find_last_of('.');
+		char number[16];
+		snprintf(number, sizeof(number), "_%04d", frame);
+		return dot == std::string::npos ? pattern + number : pattern.substr(0, dot) + number + pattern.substr(dot);
+	}
+
+	auto start = end;
+	while (start > 0 && pattern[start - 1] == '#') start--;
+
+	std::string number = std::to_string(frame);
+	if (number.size() < end - start + 1) number.insert(0, end - start + 1 - number.size(), '0');
+
+	return pattern.substr(0, start) + number + pattern.substr(end + 1);
+}
+
+void SequenceRenderer::fail(std::string error) {
+	active = false;
+	finishing = false;
+	frameStarted = false;
+	Failed = true;
+	status = error;
+	if (stream) stream->Close();
+}
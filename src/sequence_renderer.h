@@ -0,0 +1,49 @@
+#include <project.h>
+#include <video_stream.h>
+#include <string>
+#include <memory>
+
+#pragma once
+
+// Renders the project's animation frame by frame through the offline accumulation. Each frame is
+// posed, accumulated to SamplesPerFrame (or until SecondsPerFrame runs out) and handed to the image
+// saver, whose readback and encoding run while the next frame renders. At most FramesInFlight
+// frames wait on the saver, so a slow encoder holds the GPU back instead of piling up memory.
+// Targets VideoStream accepts get one raw stream instead of numbered images.
+class SequenceRenderer {
+public:
+	SequenceRenderer(Project*);
+
+	void Start(std::string, int, int);
+	void Step();
+	void Cancel();
+
+	bool IsActive();
+	float GetProgress();
+	std::string GetStatus();
+
+	static std::string FramePath(std::string const&, int);
+
+	int SamplesPerFrame = 256;
+	// 0 renders every frame to SamplesPerFrame.
+	float SecondsPerFrame = 0.0f;
+	int FramesInFlight = 2;
+
+	// set when a frame could not be written.
+	bool Failed = false;
+private:
+	Project* project;
+	std::shared_ptr<VideoStream> stream;
+
+	std::string pattern;
+	std::string status;
+	int firstFrame = 0;
+	int lastFrame = 0;
+	int frame = 0;
+	bool active = false;
+	bool frameStarted = false;
+	bool finishing = false;
+	double frameStart = 0.0;
+
+	void fail(std::string);
+};
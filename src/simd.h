@@ -0,0 +1,51 @@
+#pragma once
+
+// Four float lanes for the CPU image loops. SSE2 where the compiler targets it, plain arrays elsewhere
+// (aarch64 render nodes), with the same helpers either way.
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+
+typedef __m128 float4;
+
+static inline float4 load4(const float* p) { return _mm_loadu_ps(p); }
+static inline void store4(float* p, float4 a) { _mm_storeu_ps(p, a); }
+static inline float4 splat4(float v) { return _mm_set1_ps(v); }
+static inline float4 set4(float x, float y, float z, float w) { return _mm_setr_ps(x, y, z, w); }
+static inline float4 zero4() { return _mm_setzero_ps(); }
+static inline float4 add4(float4 a, float4 b) { return _mm_add_ps(a, b); }
+static inline float4 sub4(float4 a, float4 b) { return _mm_sub_ps(a, b); }
+static inline float4 mul4(float4 a, float4 b) { return _mm_mul_ps(a, b); }
+static inline float4 div4(float4 a, float4 b) { return _mm_div_ps(a, b); }
+static inline float4 max4(float4 a, float4 b) { return _mm_max_ps(a, b); }
+
+// sum of the first three lanes, the fourth is alpha and never takes part in the weights.
+static inline float dot3(float4 a, float4 b) {
+	__m128 m = _mm_mul_ps(a, b);
+	__m128 y = _mm_shuffle_ps(m, m, _MM_SHUFFLE(1, 1, 1, 1));
+	__m128 z = _mm_shuffle_ps(m, m, _MM_SHUFFLE(2, 2, 2, 2));
+	return _mm_cvtss_f32(_mm_add_ss(_mm_add_ss(m, y), z));
+}
+#else
+#include <algorithm>
+
+struct float4 {
+	float v[4];
+};
+
+static inline float4 load4(const float* p) { return { { p[0], p[1], p[2], p[3] } }; }
+static inline void store4(float* p, float4 a) { for (int i = 0; i < 4; i++) p[i] = a.v[i]; }
+static inline float4 splat4(float v) { return { { v, v, v, v } }; }
+static inline float4 set4(float x, float y, float z, float w) { return { { x, y, z, w } }; }
+static inline float4 zero4() { return splat4(0.0f); }
+static inline float4 add4(float4 a, float4 b) { return { { a.v[0] + b.v[0], a.v[1] + b.v[1], a.v[2] + b.v[2], a.v[3] + b.v[3] } }; }
+static inline float4 sub4(float4 a, float4 b) { return { { a.v[0] - b.v[0], a.v[1] - b.v[1], a.v[2] - b.v[2], a.v[3] - b.v[3] } }; }
+static inline float4 mul4(float4 a, float4 b) { return { { a.v[0] * b.v[0], a.v[1] * b.v[1], a.v[2] * b.v[2], a.v[3] * b.v[3] } }; }
+static inline float4 div4(float4 a, float4 b) { return { { a.v[0] / b.v[0], a.v[1] / b.v[1], a.v[2] / b.v[2], a.v[3] / b.v[3] } }; }
+static inline float4 max4(float4 a, float4 b) {
+	return { { std::max(a.v[0], b.v[0]), std::max(a.v[1], b.v[1]), std::max(a.v[2], b.v[2]), std::max(a.v[3], b.v[3]) } };
+}
+
+static inline float dot3(float4 a, float4 b) {
+	return a.v[0] * b.v[0] + a.v[1] * b.v[1] + a.v[2] * b.v[2];
+}
+#endif
@@ -0,0 +1,118 @@
+#include "tcp_socket.h"
+#include <cstring>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+typedef SOCKET NativeSocket;
+#else
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <netdb.h>
+#include <unistd.h>
+#define INVALID_SOCKET (-1)
+#define closesocket close
+typedef int NativeSocket;
+#endif
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+const uintptr_t TcpSocket::Invalid = (uintptr_t)INVALID_SOCKET;
+
+static void startup() {
+#ifdef _WIN32
+	static bool started = false;
+	if (started) return;
+
+	WSADATA data;
+	WSAStartup(MAKEWORD(2, 2), &data);
+	started = true;
+#endif
+}
+
+// Listens on 127.0.0.1 only, nothing here is authenticated.
+uintptr_t TcpSocket::Listen(int port) {
+	startup();
+
+	NativeSocket handle = socket(AF_INET, SOCK_STREAM, 0);
+	if (handle == INVALID_SOCKET) return Invalid;
+
+	int reuse = 1;
+	setsockopt(handle, SOL_SOCKET, SO_REUSEADDR, (const char*)&reuse, sizeof(reuse));
+
+	sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_port = htons((unsigned short)port);
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	if (bind(handle, (sockaddr*)&address, sizeof(address)) != 0 || listen(handle, 16) != 0) {
+		closesocket(handle);
+		return Invalid;
+	}
+
+	return (uintptr_t)handle;
+}
+
+uintptr_t TcpSocket::Accept(uintptr_t listener) {
+	return (uintptr_t)accept((NativeSocket)listener, nullptr, nullptr);
+}
+
+// timeoutSeconds bounds every later receive, so a worker that hangs is treated like one that died.
+uintptr_t TcpSocket::Connect(std::string host, int port, int timeoutSeconds) {
+	startup();
+
+	addrinfo hints;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_STREAM;
+
+	addrinfo* found = nullptr;
+	if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &found) != 0) return Invalid;
+
+	NativeSocket handle = socket(found->ai_family, found->ai_socktype, found->ai_protocol);
+	if (handle != INVALID_SOCKET && connect(handle, found->ai_addr, (int)found->ai_addrlen) != 0) {
+		closesocket(handle);
+		handle = INVALID_SOCKET;
+	}
+	freeaddrinfo(found);
+
+	if (handle != INVALID_SOCKET && timeoutSeconds > 0) {
+#ifdef _WIN32
+		DWORD timeout = timeoutSeconds * 1000;
+#else
+		timeval timeout = { timeoutSeconds, 0 };
+#endif
+		setsockopt(handle, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout));
+	}
+
+	return (uintptr_t)handle;
+}
+
+bool TcpSocket::Send(uintptr_t connection, const void* data, size_t size) {
+	auto bytes = (const char*)data;
+	size_t sent = 0;
+	while (sent < size) {
+		int count = send((NativeSocket)connection, bytes + sent, (int)(size - sent), MSG_NOSIGNAL);
+		if (count <= 0) return false;
+
+		sent += count;
+	}
+
+	return true;
+}
+
+bool TcpSocket::Send(uintptr_t connection, std::string const& text) {
+	return Send(connection, text.data(), text.size());
+}
+
+int TcpSocket::Receive(uintptr_t connection, char* buffer, int size) {
+	return recv((NativeSocket)connection, buffer, size, 0);
+}
+
+void TcpSocket::Close(uintptr_t connection) {
+	closesocket((NativeSocket)connection);
+}
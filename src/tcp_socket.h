@@ -0,0 +1,19 @@
+#include <string>
+#include <cstdint>
+
+#pragma once
+
+// Blocking TCP helpers over BSD sockets or Winsock, handles are the native socket cast to uintptr_t.
+class TcpSocket {
+public:
+	static uintptr_t Listen(int);
+	static uintptr_t Accept(uintptr_t);
+	static uintptr_t Connect(std::string, int, int timeoutSeconds = 0);
+
+	static bool Send(uintptr_t, const void *, size_t);
+	static bool Send(uintptr_t, std::string const&);
+	static int Receive(uintptr_t, char *, int);
+	static void Close(uintptr_t);
+
+	static const uintptr_t Invalid;
+};
@@ -0,0 +1,134 @@
+#include "temporal_filter.h"
+#include <algorithm>
+
+TemporalFilter::TemporalFilter(Screen *s) : screen(s) {
+	reprojectProgram = new Program();
+	atrousProgram = new Program();
+
+	for (int i = 0; i < 2; i++) {
+		history[i] = new Texture();
+		moments[i] = new Texture();
+		filtered[i] = new Texture();
+	}
+
+	previousNormal = new Texture();
+	previousData = new Texture();
+	output = new Texture();
+
+	glGenFramebuffers(1, &fbo);
+}
+
+TemporalFilter::~TemporalFilter() {
+	glDeleteFramebuffers(1, &fbo);
+}
+
+void TemporalFilter::Link(std::string vertSource, std::string reprojectSource, std::string atrousSource) {
+	reprojectProgram->Reload()
+		.Attach(vertSource, GL_VERTEX_SHADER)
+		.Attach(reprojectSource, GL_FRAGMENT_SHADER)
+		.Link();
+
+	atrousProgram->Reload()
+		.Attach(vertSource, GL_VERTEX_SHADER)
+		.Attach(atrousSource, GL_FRAGMENT_SHADER)
+		.Link();
+}
+
+void TemporalFilter::Allocate(int w, int h) {
+	width = w;
+	height = h;
+
+	Texture* textures[] = { history[0], history[1], moments[0], moments[1], filtered[0], filtered[1], previousNormal, previousData, output };
+	for (auto texture : textures) {
+		texture->DeleteTexture();
+		texture->Allocate2D(width, height, false);
+	}
+
+	Reset();
+}
+
+void TemporalFilter::Reset() {
+	hasHistory = false;
+}
+
+Texture* TemporalFilter::Filter(Texture *color, Texture *albedo, Texture *normal, Texture *data, Camera *camera) {
+	glm::vec2 res(width, height);
+	glViewport(0, 0, width, height);
+
+	int previous = 1 - current;
+	target(history[current], moments[current]);
+	reprojectProgram->Activate()
+		.Bind("resolution", res)
+		.Bind("camera", camera->GetViewMatrix())
+		.Bind("eye", camera->Position)
+		.Bind("fov", camera->Fov)
+		.Bind("previousCamera", previousCamera)
+		.Bind("previousEye", previousEye)
+		.Bind("previousFov", previousFov)
+		.Bind("hasHistory", hasHistory ? 1 : 0)
+		.Bind("colorPass", color)
+		.Bind("albedoPass", albedo)
+		.Bind("normalPass", normal)
+		.Bind("dataPass", data)
+		.Bind("previousColor", history[previous])
+		.Bind("previousMoments", moments[previous])
+		.Bind("previousNormal", previousNormal)
+		.Bind("previousData", previousData)
+		.Bind("minAlpha", MinAlpha)
+		.Bind("maxHistory", MaxHistory);
+	screen->DrawQuad();
+
+	Texture* source = history[current];
+	int passes = std::max(1, Iterations);
+	for (int i = 0; i < passes; i++) {
+		bool last = i == passes - 1;
+		Texture* destination = last ? output : filtered[i % 2];
+
+		target(destination);
+		atrousProgram->Activate()
+			.Bind("resolution", res)
+			.Bind("stepSize", 1 << i)
+			.Bind("finalPass", last ? 1 : 0)
+			.Bind("colorPass", source)
+			.Bind("albedoPass", albedo)
+			.Bind("normalPass", normal)
+			.Bind("dataPass", data)
+			.Bind("colorPhi", ColorPhi)
+			.Bind("normalPhi", NormalPhi)
+			.Bind("depthPhi", DepthPhi);
+		screen->DrawQuad();
+
+		// like SVGF the first level is what the next frame reprojects, it is less noisy than the raw history.
+		if (i == 0 && !last) copy(destination, history[current]);
+		source = destination;
+	}
+
+	copy(normal, previousNormal);
+	copy(data, previousData);
+
+	previousCamera = camera->GetViewMatrix();
+	previousEye = camera->Position;
+	previousFov = camera->Fov;
+	hasHistory = true;
+	current = previous;
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	return output;
+}
+
+Texture* TemporalFilter::GetOutput() {
+	return output;
+}
+
+void TemporalFilter::target(Texture *first, Texture *second) {
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, first->TextureId, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, second ? second->TextureId : 0, 0);
+
+	GLenum attachments[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+	glDrawBuffers(second ? 2 : 1, attachments);
+}
+
+void TemporalFilter::copy(Texture *from, Texture *to) {
+	glCopyImageSubData(from->TextureId, GL_TEXTURE_2D, 0, 0, 0, 0, to->TextureId, GL_TEXTURE_2D, 0, 0, 0, 0, width, height, 1);
+}
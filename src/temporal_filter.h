@@ -0,0 +1,53 @@
+#include <program.h>
+#include <texture.h>
+#include <screen.h>
+#include <camera.h>
+
+#pragma once
+
+// Spatiotemporal variance-guided filter for 1 spp interactive path tracing. The sample's illumination is
+// reprojected onto the history with depth and the previous camera, then smoothed by a-trous passes
+// steered by the per pixel variance and the normal, depth and material id outputs.
+class TemporalFilter {
+public:
+	TemporalFilter(Screen *);
+	~TemporalFilter();
+
+	void Link(std::string, std::string, std::string);
+	void Allocate(int, int);
+	void Reset();
+
+	Texture* Filter(Texture *, Texture *, Texture *, Texture *, Camera *);
+	Texture* GetOutput();
+
+	bool Enabled = false;
+	int Iterations = 5;
+	float ColorPhi = 4.0f;
+	float NormalPhi = 128.0f;
+	float DepthPhi = 1.0f;
+	float MinAlpha = 0.2f;
+	float MaxHistory = 32.0f;
+private:
+	Screen* screen;
+	Program* reprojectProgram;
+	Program* atrousProgram;
+
+	Texture* history[2];
+	Texture* moments[2];
+	Texture* previousNormal;
+	Texture* previousData;
+	Texture* filtered[2];
+	Texture* output;
+
+	GLuint fbo;
+	int width = 0, height = 0;
+	int current = 0;
+	bool hasHistory = false;
+
+	glm::mat3 previousCamera;
+	glm::vec3 previousEye;
+	float previousFov;
+
+	void target(Texture *, Texture * = nullptr);
+	void copy(Texture *, Texture *);
+};
@@ -1,17 +1,17 @@
 #include "texture.h"
+#include <texture_loader.h>
+#include <texture_file.h>
+#include <program.h>
+#include <algorithm>
+#include <stdexcept>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 
-int Texture::CurrentTextureUnit = 0;
-
 Texture::Texture() {
 	Width = 0;
 	Height = 0;
 	TextureId = -1;
-
-	TextureUnit = CurrentTextureUnit;
-	CurrentTextureUnit++;
 }
 
 void Texture::LoadHDRIFromFile2D(std::string file) {
@@ -34,7 +34,7 @@ void Texture::LoadHDRIFromFile2D(std::string file) {
 		Height = height;
 		stbi_image_free(data);
 	} else {
-		throw std::exception("Unable to load image");
+		throw std::runtime_error("Unable to load image");
 	}
 }
 
@@ -61,15 +61,16 @@ void Texture::LoadFromFile2D(std::string file) {
 
 		stbi_image_free(data);
 	} else {
-		throw std::exception(("Unable to read image: " + file).c_str());
+		throw std::runtime_error(("Unable to read image: " + file).c_str());
 	}
 }
 
+// RGBA so compute passes can write the faces as images.
 void Texture::AllocateCube(int width, int height, bool generateMipMap) {
 	glGenTextures(1, &TextureId);
 	glBindTexture(GL_TEXTURE_CUBE_MAP, TextureId);
 	for (GLuint i = 0; i < 6; i++) 
-		glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB16F, width, height, 0, GL_RGB, GL_FLOAT, nullptr);
+		glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGBA16F, width, height, 0, GL_RGBA, GL_FLOAT, nullptr);
 
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
@@ -88,7 +89,7 @@ void Texture::Allocate2D(int width, int height, bool rg) {
 	glGenTextures(1, &TextureId);
 	glBindTexture(GL_TEXTURE_2D, TextureId);
 	if (rg) {
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, width, height, 0, GL_RG, GL_FLOAT, 0);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16F, width, height, 0, GL_RG, GL_FLOAT, 0);
 	} else {
 		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, width, height, 0, GL_RGBA, GL_FLOAT, 0);
 	}
@@ -102,16 +103,41 @@ void Texture::Allocate2D(int width, int height, bool rg) {
 	Height = height;
 }
 
-int Texture::Use2D() {
-	glActiveTexture(GL_TEXTURE0 + TextureUnit);
+// RGB16F storage for HDR images uploaded a band of rows at a time.
+void Texture::Allocate2DHalf(int width, int height) {
+	glGenTextures(1, &TextureId);
 	glBindTexture(GL_TEXTURE_2D, TextureId);
-	return TextureUnit;
+	glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGB16F, width, height);
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+	Width = width;
+	Height = height;
+	Bytes = (size_t)width * height * 6;
 }
 
-int Texture::UseCube() {
-	glActiveTexture(GL_TEXTURE0 + TextureUnit);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, TextureId);
-	return TextureUnit;
+// RGBA8 layers with a full mip chain, repeating like loaded images.
+// RGBA8 layers are rendered into, block compressed ones are filled with glCompressedTexSubImage3D.
+void Texture::Allocate2DArray(int width, int height, int layers, GLenum format, bool mipmaps) {
+	int levels = mipmaps ? TextureFile::LevelCount(width, height) : 1;
+
+	glGenTextures(1, &TextureId);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, TextureId);
+	glTexStorage3D(GL_TEXTURE_2D_ARRAY, levels, format, width, height, layers);
+
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, mipmaps ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+	Width = width;
+	Height = height;
+	Bytes = TextureFile::BlockBytes(format) > 0
+		? TextureFile::LevelOffset(format, width, height, levels) * layers
+		: (size_t)width * height * layers * 4 * (mipmaps ? 4 : 3) / 3;
 }
 
 void Texture::GenerateMipmap() {
@@ -120,5 +146,7 @@ void Texture::GenerateMipmap() {
 }
 
 void Texture::DeleteTexture() {
+	TextureLoader::Instance()->Cancel(this);
+	Program::ForgetTexture(TextureId);
 	glDeleteTextures(1, &TextureId);
 }
@@ -10,20 +10,18 @@ public:
 	void LoadHDRIFromFile2D(std::string);
 	void LoadFromFile2D(std::string);
 	void Allocate2D(int width=512, int height=512, bool rg = true);
+	void Allocate2DHalf(int width, int height);
 	void AllocateCube(int width, int height, bool generateMipMap = false);
-
-	int Use2D();
-	int UseCube();
+	void Allocate2DArray(int width, int height, int layers, GLenum format = GL_RGBA8, bool mipmaps = true);
 
 	void GenerateMipmap();
 
 	void DeleteTexture();
 
 	GLuint TextureId;
-	int TextureUnit;
 
 	int Width;
 	int Height;
-private:
-	static int CurrentTextureUnit;
+	// video memory of a loaded image and its mipmaps, 0 for render targets.
+	size_t Bytes = 0;
 };
\ No newline at end of file
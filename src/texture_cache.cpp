@@ -0,0 +1,99 @@
+#include "texture_cache.h"
+#include <texture_loader.h>
+#include <sys/stat.h>
+
+// Returns the shared texture for path, queuing a load on a miss. Paths that can't be cached (empty or
+// missing files) get a texture of their own, which Release deletes.
+Texture* TextureCache::Acquire(std::string path, glm::vec4 placeholder, TextureKind kind) {
+	std::string key = keyFor(path, kind);
+	if (key.empty()) {
+		auto texture = new Texture();
+		TextureLoader::Instance()->Load(texture, path, placeholder, kind);
+		return texture;
+	}
+
+	auto found = entries.find(key);
+	if (found != entries.end()) {
+		found->second.references++;
+		Hits++;
+		return found->second.texture;
+	}
+
+	auto texture = new Texture();
+	TextureLoader::Instance()->Load(texture, path, placeholder, kind);
+
+	entries[key] = { texture, 1, 0 };
+	keys[texture] = key;
+	Misses++;
+
+	Trim();
+	return texture;
+}
+
+void TextureCache::Release(Texture* texture) {
+	auto key = keys.find(texture);
+	if (key == keys.end()) {
+		texture->DeleteTexture();
+		delete texture;
+		return;
+	}
+
+	auto& entry = entries[key->second];
+	if (--entry.references <= 0) {
+		entry.references = 0;
+		entry.released = ++releases;
+	}
+
+	Trim();
+}
+
+// Evicts the least recently released textures until the cache fits its budget.
+void TextureCache::Trim() {
+	while (GetResidentBytes() > Budget) {
+		auto oldest = entries.end();
+		for (auto it = entries.begin(); it != entries.end(); ++it) {
+			if (it->second.references > 0) continue;
+			if (oldest == entries.end() || it->second.released < oldest->second.released) oldest = it;
+		}
+
+		if (oldest == entries.end()) return;
+
+		auto texture = oldest->second.texture;
+		keys.erase(texture);
+		entries.erase(oldest);
+
+		texture->DeleteTexture();
+		delete texture;
+	}
+}
+
+size_t TextureCache::GetResidentBytes() {
+	size_t bytes = 0;
+	for (auto& entry : entries) bytes += entry.second.texture->Bytes;
+	return bytes;
+}
+
+size_t TextureCache::GetUnusedBytes() {
+	size_t bytes = 0;
+	for (auto& entry : entries) {
+		if (entry.second.references == 0) bytes += entry.second.texture->Bytes;
+	}
+	return bytes;
+}
+
+int TextureCache::GetResidentCount() {
+	return (int)entries.size();
+}
+
+TextureCache* TextureCache::Instance() {
+	static TextureCache cache;
+	return &cache;
+}
+
+std::string TextureCache::keyFor(std::string const& path, TextureKind kind) {
+	struct stat info;
+	if (path.empty() || stat(path.c_str(), &info) != 0) return "";
+
+	return path + "|" + std::to_string((long long)info.st_mtime) + "|" + std::to_string((long long)info.st_size)
+		+ (kind == TextureKind::Normal ? "|normal" : "");
+}
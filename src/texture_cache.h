@@ -0,0 +1,41 @@
+#include <texture.h>
+#include <texture_loader.h>
+#include <glm/glm.hpp>
+#include <string>
+#include <map>
+#include <cstdint>
+
+#pragma once
+
+// Shares material textures between materials and projects. Entries are keyed by path, modification
+// time and size, so an edited file loads again, and counted by the materials holding them. Released
+// textures stay resident while the cache is within Budget bytes, least recently released go first
+// beyond that. Textures still in use are never evicted.
+class TextureCache {
+public:
+	Texture* Acquire(std::string, glm::vec4 = glm::vec4(0.5f, 0.5f, 0.5f, 1.0f), TextureKind = TextureKind::Color);
+	void Release(Texture*);
+	void Trim();
+
+	size_t GetResidentBytes();
+	size_t GetUnusedBytes();
+	int GetResidentCount();
+
+	static TextureCache* Instance();
+
+	size_t Budget = (size_t)1024 << 20;
+	int Hits = 0;
+	int Misses = 0;
+private:
+	struct Entry {
+		Texture* texture;
+		int references;
+		uint64_t released;
+	};
+
+	std::map<std::string, Entry> entries;
+	std::map<Texture*, std::string> keys;
+	uint64_t releases = 0;
+
+	static std::string keyFor(std::string const&, TextureKind);
+};
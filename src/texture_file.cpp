@@ -0,0 +1,177 @@
+#include "texture_file.h"
+#include <cache_file.h>
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+
+#define STB_DXT_IMPLEMENTATION
+#include <stb_dxt.h>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#define TEXTURE_FILE_VERSION 1
+
+TextureFile::~TextureFile() {
+#ifdef _WIN32
+	if (mapping) UnmapViewOfFile(mapping);
+	if (mappingHandle) CloseHandle(mappingHandle);
+	if (file) CloseHandle(file);
+#else
+	if (mapping) munmap((void*)mapping, mappingSize);
+#endif
+}
+
+size_t TextureFile::LevelOffset(GLenum format, int width, int height, int level) {
+	size_t offset = 0;
+	for (int i = 0; i < level; i++) {
+		offset += LevelBytes(format, std::max(width >> i, 1), std::max(height >> i, 1));
+	}
+
+	return offset;
+}
+
+TextureFile::Header TextureFile::Describe(uint64_t sourceHash, GLenum format, int width, int height) {
+	Header header = { { 'S', 'D', 'F', 'T' }, TEXTURE_FILE_VERSION, sourceHash, format, width, height, LevelCount(width, height) };
+	return header;
+}
+
+// Maps the cached file, null when it is missing, truncated or made from a different source.
+std::shared_ptr<TextureFile> TextureFile::Open(std::string path, uint64_t sourceHash) {
+	auto texture = std::make_shared<TextureFile>();
+
+#ifdef _WIN32
+	texture->file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (texture->file == INVALID_HANDLE_VALUE) {
+		texture->file = nullptr;
+		return nullptr;
+	}
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(texture->file, &size) || size.QuadPart < (LONGLONG)sizeof(Header)) return nullptr;
+
+	texture->mappingHandle = CreateFileMappingA(texture->file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!texture->mappingHandle) return nullptr;
+
+	texture->mappingSize = (size_t)size.QuadPart;
+	texture->mapping = (const unsigned char*)MapViewOfFile(texture->mappingHandle, FILE_MAP_READ, 0, 0, 0);
+#else
+	int file = open(path.c_str(), O_RDONLY);
+	if (file < 0) return nullptr;
+
+	struct stat status;
+	if (fstat(file, &status) != 0 || status.st_size < (off_t)sizeof(Header)) {
+		close(file);
+		return nullptr;
+	}
+
+	texture->mappingSize = (size_t)status.st_size;
+	void* mapped = mmap(nullptr, texture->mappingSize, PROT_READ, MAP_PRIVATE, file, 0);
+	close(file);
+	texture->mapping = mapped == MAP_FAILED ? nullptr : (const unsigned char*)mapped;
+#endif
+
+	if (!texture->mapping) return nullptr;
+
+	memcpy(&texture->Info, texture->mapping, sizeof(Header));
+	auto& info = texture->Info;
+	if (memcmp(info.magic, "SDFT", 4) != 0 || info.version != TEXTURE_FILE_VERSION || info.sourceHash != sourceHash) return nullptr;
+	if (info.width <= 0 || info.height <= 0 || info.levels != LevelCount(info.width, info.height)) return nullptr;
+	if (BlockBytes(info.format) == 0 || sizeof(Header) + LevelOffset(info.format, info.width, info.height, info.levels) > texture->mappingSize) return nullptr;
+
+	texture->Data = texture->mapping + sizeof(Header);
+	return texture;
+}
+
+bool TextureFile::Write(std::string path, Header const& header, std::vector<unsigned char> const& data) {
+	return WriteCacheFile(path, &header, sizeof(Header), data.data(), data.size());
+}
+
+std::string TextureFile::PathFor(std::string directory, uint64_t sourceHash, GLenum format) {
+	char name[48];
+	snprintf(name, sizeof(name), "%016llx_%04x.sdftex", (unsigned long long)sourceHash, format & 0xffff);
+	return directory + "/" + name;
+}
+
+int TextureFile::LevelCount(int width, int height) {
+	int levels = 1;
+	while ((std::max(width, height) >> levels) > 0) levels++;
+	return levels;
+}
+
+size_t TextureFile::LevelBytes(GLenum format, int width, int height) {
+	return (size_t)((width + 3) / 4) * ((height + 3) / 4) * BlockBytes(format);
+}
+
+int TextureFile::BlockBytes(GLenum format) {
+	switch (format) {
+	case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+	case GL_COMPRESSED_RED_RGTC1:
+		return 8;
+	case GL_COMPRESSED_RG_RGTC2:
+		return 16;
+	default:
+		return 0;
+	}
+}
+
+// Box filters the full mip chain and block compresses every level. Pixels are 1 (BC4) or 4 (BC1,
+// BC5 from red and green) bytes each, edge blocks repeat the last row and column.
+void TextureFile::Encode(const unsigned char* pixels, int width, int height, int channels, GLenum format, std::vector<unsigned char>& out) {
+	std::vector<unsigned char> level(pixels, pixels + (size_t)width * height * channels);
+	out.clear();
+
+	for (int w = width, h = height;; ) {
+		int blockBytes = BlockBytes(format);
+		for (int by = 0; by < h; by += 4) {
+			for (int bx = 0; bx < w; bx += 4) {
+				unsigned char block[64];
+				for (int y = 0; y < 4; y++) {
+					for (int x = 0; x < 4; x++) {
+						auto source = &level[((size_t)std::min(by + y, h - 1) * w + std::min(bx + x, w - 1)) * channels];
+						int i = y * 4 + x;
+
+						if (format == GL_COMPRESSED_RED_RGTC1) block[i] = source[0];
+						else if (format == GL_COMPRESSED_RG_RGTC2) { block[i * 2] = source[0]; block[i * 2 + 1] = source[1]; }
+						else memcpy(block + i * 4, source, 4);
+					}
+				}
+
+				unsigned char encoded[16];
+				if (format == GL_COMPRESSED_RED_RGTC1) stb_compress_bc4_block(encoded, block);
+				else if (format == GL_COMPRESSED_RG_RGTC2) stb_compress_bc5_block(encoded, block);
+				else stb_compress_dxt_block(encoded, block, 0, STB_DXT_HIGHQUAL);
+
+				out.insert(out.end(), encoded, encoded + blockBytes);
+			}
+		}
+
+		if (w == 1 && h == 1) break;
+
+		int nw = std::max(w / 2, 1), nh = std::max(h / 2, 1);
+		std::vector<unsigned char> next((size_t)nw * nh * channels);
+		for (int y = 0; y < nh; y++) {
+			for (int x = 0; x < nw; x++) {
+				int x0 = std::min(x * 2, w - 1), x1 = std::min(x * 2 + 1, w - 1);
+				int y0 = std::min(y * 2, h - 1), y1 = std::min(y * 2 + 1, h - 1);
+
+				for (int c = 0; c < channels; c++) {
+					int sum = level[((size_t)y0 * w + x0) * channels + c] + level[((size_t)y0 * w + x1) * channels + c]
+						+ level[((size_t)y1 * w + x0) * channels + c] + level[((size_t)y1 * w + x1) * channels + c];
+					next[((size_t)y * nw + x) * channels + c] = (unsigned char)((sum + 2) / 4);
+				}
+			}
+		}
+
+		level.swap(next);
+		w = nw;
+		h = nh;
+	}
+}
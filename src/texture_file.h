@@ -0,0 +1,51 @@
+#include <glad/glad.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+#pragma once
+
+// S3TC is an extension the glad loader was not generated with.
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+
+// A mip chain in a block compressed format, cached on disk per source image. Files are named by the
+// source's content hash, so an edited image never matches an old entry, and are memory mapped when
+// read back so loading one costs little more than the upload.
+class TextureFile {
+public:
+	struct Header {
+		char magic[4];
+		uint32_t version;
+		uint64_t sourceHash;
+		uint32_t format;
+		int32_t width;
+		int32_t height;
+		int32_t levels;
+	};
+
+	~TextureFile();
+
+	Header Info;
+	const unsigned char* Data = nullptr;
+
+	static Header Describe(uint64_t, GLenum, int, int);
+	static std::shared_ptr<TextureFile> Open(std::string, uint64_t);
+	static bool Write(std::string, Header const&, std::vector<unsigned char> const&);
+	static std::string PathFor(std::string, uint64_t, GLenum);
+
+	static int LevelCount(int, int);
+	static size_t LevelOffset(GLenum, int, int, int);
+	static size_t LevelBytes(GLenum, int, int);
+	static int BlockBytes(GLenum);
+	static void Encode(const unsigned char*, int, int, int, GLenum, std::vector<unsigned char>&);
+private:
+	const unsigned char* mapping = nullptr;
+	size_t mappingSize = 0;
+#ifdef _WIN32
+	void* file = nullptr;
+	void* mappingHandle = nullptr;
+#endif
+};
@@ -0,0 +1,308 @@
+#include "texture_loader.h"
+#include <program.h>
+#include <thread_pool.h>
+#include <hash.h>
+#include <stb_image.h>
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+// the staging ring is split in slots, each one filled by a single band and fenced until the GPU has copied it.
+#define STAGING_SLOTS 8
+#define STAGING_SLOT_SIZE (4 << 20)
+
+TextureLoader::Image::~Image() {
+	if (pixels) stbi_image_free(pixels);
+}
+
+int TextureLoader::Image::levels() {
+	return format ? TextureFile::LevelCount(width, height) : 1;
+}
+
+const unsigned char* TextureLoader::Image::blocks() {
+	return file ? file->Data : encoded.data();
+}
+
+TextureLoader::~TextureLoader() {
+	for (auto& load : pending) {
+		if (load.decoding.valid()) load.decoding.wait();
+	}
+}
+
+// Gives texture a placeholder now and queues path to replace it, textures without a path are left alone.
+void TextureLoader::Load(Texture* texture, std::string path, glm::vec4 placeholder, TextureKind kind) {
+	if (path.empty()) return;
+	Cancel(texture);
+
+	unsigned char color[4];
+	for (int i = 0; i < 4; i++) color[i] = (unsigned char)(glm::clamp(placeholder[i], 0.0f, 1.0f) * 255.0f + 0.5f);
+
+	glGenTextures(1, &texture->TextureId);
+	glBindTexture(GL_TEXTURE_2D, texture->TextureId);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, color);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	texture->Width = 1;
+	texture->Height = 1;
+	texture->Bytes = 4;
+
+	PendingLoad load;
+	load.texture = texture;
+	load.path = path;
+	load.image = std::make_shared<Image>();
+
+	auto image = load.image;
+	GLenum oneChannel = Compress ? compressedFormat(1, kind) : 0;
+	GLenum fourChannel = Compress ? compressedFormat(4, kind) : 0;
+	std::string directory = CacheDirectory;
+
+	load.decoding = ThreadPool::Instance()->Submit([image, path, oneChannel, fourChannel, directory]() {
+		// the flip flag is global by default, HDRIs set it on the GL thread.
+		stbi_set_flip_vertically_on_load_thread(0);
+
+		int channels = 0;
+		if (!stbi_info(path.c_str(), &image->width, &image->height, &channels)) {
+			throw std::runtime_error(("Unable to read image: " + path).c_str());
+		}
+
+		// single channel maps stay single channel, everything else is expanded to RGBA.
+		image->channels = channels == 1 ? 1 : 4;
+		GLenum format = image->channels == 1 ? oneChannel : fourChannel;
+
+		uint64_t hash = format ? HashFile(path) : 0;
+		std::string cachePath = TextureFile::PathFor(directory, hash, format);
+		if (hash) {
+			image->file = TextureFile::Open(cachePath, hash);
+			if (image->file) {
+				image->format = format;
+				return;
+			}
+		}
+
+		image->pixels = stbi_load(path.c_str(), &image->width, &image->height, &channels, image->channels);
+		if (!image->pixels) throw std::runtime_error(("Unable to read image: " + path).c_str());
+		if (!format) return;
+
+		TextureFile::Encode(image->pixels, image->width, image->height, image->channels, format, image->encoded);
+		image->format = format;
+		stbi_image_free(image->pixels);
+		image->pixels = nullptr;
+
+		// a cache that can't be written only costs the next load its encode.
+		if (hash) TextureFile::Write(cachePath, TextureFile::Describe(hash, format, image->width, image->height), image->encoded);
+	});
+
+	pending.push_back(std::move(load));
+}
+
+// Drops a queued load, for textures about to be deleted. A decode in flight finishes unseen.
+void TextureLoader::Cancel(Texture* texture) {
+	for (auto it = pending.begin(); it != pending.end();) {
+		if (it->texture != texture) {
+			++it;
+			continue;
+		}
+
+		if (it->target) glDeleteTextures(1, &it->target);
+		it = pending.erase(it);
+	}
+}
+
+// Uploads decoded images until the frame's budget is spent, called once per frame on the GL thread.
+void TextureLoader::Update() {
+	auto start = std::chrono::high_resolution_clock::now();
+	auto spent = [&]() {
+		return std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	};
+
+	for (auto it = pending.begin(); it != pending.end();) {
+		if (!it->decoded) {
+			if (it->decoding.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+				++it;
+				continue;
+			}
+
+			try {
+				it->decoding.get();
+				it->decoded = true;
+			} catch (std::exception ex) {
+				// the placeholder stays, as a failed synchronous load left the texture empty.
+				error = ex.what();
+				it = pending.erase(it);
+				continue;
+			}
+		}
+
+		while (it->uploadedLevel < it->image->levels()) {
+			if (spent() >= UploadBudget || !uploadBand(*it)) return;
+		}
+
+		finishLoad(*it);
+		it = pending.erase(it);
+	}
+}
+
+// Decodes and uploads everything queued before returning, for renders that can't show placeholders.
+void TextureLoader::Finish() {
+	float budget = UploadBudget;
+	UploadBudget = std::numeric_limits<float>::max();
+
+	while (!pending.empty()) {
+		for (auto& load : pending) {
+			if (load.decoding.valid()) load.decoding.wait();
+		}
+
+		Update();
+	}
+
+	UploadBudget = budget;
+}
+
+bool TextureLoader::IsBusy() {
+	return !pending.empty();
+}
+
+int TextureLoader::GetPendingCount() {
+	return (int)pending.size();
+}
+
+std::string TextureLoader::GetError() {
+	return error;
+}
+
+TextureLoader* TextureLoader::Instance() {
+	static TextureLoader loader;
+	return &loader;
+}
+
+// Persistent mapping needs GL 4.4, older contexts upload straight from the decoded pixels.
+bool TextureLoader::allocateStaging() {
+	if (staging) return true;
+	if (!GLAD_GL_VERSION_4_4) return false;
+
+	GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	glGenBuffers(1, &stagingBuffer);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, stagingBuffer);
+	glBufferStorage(GL_PIXEL_UNPACK_BUFFER, (GLsizeiptr)STAGING_SLOTS * STAGING_SLOT_SIZE, nullptr, flags);
+	staging = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, (GLsizeiptr)STAGING_SLOTS * STAGING_SLOT_SIZE, flags);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	slots.resize(STAGING_SLOTS);
+	for (int i = 0; i < STAGING_SLOTS; i++) slots[i].offset = (size_t)i * STAGING_SLOT_SIZE;
+	return staging != nullptr;
+}
+
+// Copies the next band of rows, false when every staging slot is still being read by the GPU.
+// Compressed chains go level by level in whole rows of 4x4 blocks.
+bool TextureLoader::uploadBand(PendingLoad& load) {
+	auto image = load.image;
+	int width = std::max(image->width >> load.uploadedLevel, 1);
+	int height = std::max(image->height >> load.uploadedLevel, 1);
+	int blockBytes = TextureFile::BlockBytes(image->format);
+
+	size_t rowBytes = image->format ? (size_t)((width + 3) / 4) * blockBytes : (size_t)width * image->channels;
+	int rowHeight = image->format ? 4 : 1;
+	GLenum format = image->channels == 1 ? GL_RED : GL_RGBA;
+
+	if (!load.target) {
+		int levels = TextureFile::LevelCount(image->width, image->height);
+		GLenum storage = image->format ? image->format : image->channels == 1 ? GL_R8 : GL_RGBA8;
+
+		glGenTextures(1, &load.target);
+		glBindTexture(GL_TEXTURE_2D, load.target);
+		glTexStorage2D(GL_TEXTURE_2D, levels, storage, image->width, image->height);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	}
+
+	int bandRows = std::max((int)(STAGING_SLOT_SIZE / rowBytes), 1) * rowHeight;
+	int rows = std::min(height - load.uploadedRows, bandRows);
+	size_t bytes = rowBytes * ((rows + rowHeight - 1) / rowHeight);
+
+	const unsigned char* source = image->format
+		? image->blocks() + TextureFile::LevelOffset(image->format, image->width, image->height, load.uploadedLevel) + rowBytes * (load.uploadedRows / 4)
+		: image->pixels + rowBytes * load.uploadedRows;
+
+	auto upload = [&](const void* data) {
+		if (image->format) glCompressedTexSubImage2D(GL_TEXTURE_2D, load.uploadedLevel, 0, load.uploadedRows, width, rows, image->format, (GLsizei)bytes, data);
+		else glTexSubImage2D(GL_TEXTURE_2D, 0, 0, load.uploadedRows, width, rows, format, GL_UNSIGNED_BYTE, data);
+	};
+
+	glBindTexture(GL_TEXTURE_2D, load.target);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+	if (allocateStaging() && bytes <= STAGING_SLOT_SIZE) {
+		auto& slot = slots[nextSlot];
+		if (slot.fence) {
+			if (glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0) == GL_TIMEOUT_EXPIRED) {
+				glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+				return false;
+			}
+
+			glDeleteSync(slot.fence);
+		}
+
+		memcpy(staging + slot.offset, source, bytes);
+
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, stagingBuffer);
+		upload((void*)slot.offset);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+		slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		nextSlot = (nextSlot + 1) % slots.size();
+	} else {
+		upload(source);
+	}
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	load.uploadedRows += rows;
+	if (load.uploadedRows >= height) {
+		load.uploadedLevel++;
+		load.uploadedRows = 0;
+	}
+
+	return true;
+}
+
+// Swaps the finished texture in for the placeholder.
+void TextureLoader::finishLoad(PendingLoad& load) {
+	auto image = load.image;
+	if (!image->format) {
+		glBindTexture(GL_TEXTURE_2D, load.target);
+		glGenerateMipmap(GL_TEXTURE_2D);
+	}
+
+	Program::ForgetTexture(load.texture->TextureId);
+	glDeleteTextures(1, &load.texture->TextureId);
+	load.texture->TextureId = load.target;
+	load.texture->Width = image->width;
+	load.texture->Height = image->height;
+	load.texture->Bytes = image->format
+		? TextureFile::LevelOffset(image->format, image->width, image->height, image->levels())
+		: (size_t)image->width * image->height * image->channels * 4 / 3;
+
+	Generation++;
+}
+
+// BC1 is an extension on desktop GL, RGTC is core.
+GLenum TextureLoader::compressedFormat(int channels, TextureKind kind) {
+	if (channels == 1) return GL_COMPRESSED_RED_RGTC1;
+	if (kind == TextureKind::Normal) return GL_COMPRESSED_RG_RGTC2;
+
+	if (s3tc < 0) {
+		GLint count = 0;
+		glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+
+		s3tc = 0;
+		for (GLint i = 0; i < count; i++) {
+			if (strcmp((const char*)glGetStringi(GL_EXTENSIONS, i), "GL_EXT_texture_compression_s3tc") == 0) s3tc = 1;
+		}
+	}
+
+	return s3tc ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT : 0;
+}
@@ -0,0 +1,94 @@
+#include <texture.h>
+#include <texture_file.h>
+#include <glm/glm.hpp>
+#include <string>
+#include <list>
+#include <vector>
+#include <memory>
+#include <future>
+
+#pragma once
+
+// How a map is used, which picks its block compression: normal maps keep two channels at BC5 quality.
+enum class TextureKind {
+	Color,
+	Normal
+};
+
+// Loads image files into textures without stalling the GL thread. Files decode on the thread pool,
+// and Update copies the decoded rows through a persistently mapped staging ring a band at a time,
+// spending at most UploadBudget milliseconds per call. Until its last band is in, a texture holds
+// a 1x1 placeholder of the color it was queued with.
+//
+// With Compress on, images are stored block compressed with a precomputed mip chain: BC4 for single
+// channel maps, BC5 for normal maps and BC1 for color where S3TC is available (color stays RGBA8
+// otherwise). The encoded chain is cached in CacheDirectory, later loads of the same file map it
+// instead of decoding.
+class TextureLoader {
+public:
+	~TextureLoader();
+
+	void Load(Texture*, std::string, glm::vec4 = glm::vec4(0.5f, 0.5f, 0.5f, 1.0f), TextureKind = TextureKind::Color);
+	void Cancel(Texture*);
+	void Update();
+	void Finish();
+
+	bool IsBusy();
+	int GetPendingCount();
+	std::string GetError();
+
+	static TextureLoader* Instance();
+
+	float UploadBudget = 4.0f;
+	bool Compress = true;
+	std::string CacheDirectory = "texture_cache";
+	// bumped whenever a texture becomes resident.
+	int Generation = 0;
+private:
+	struct Image {
+		unsigned char* pixels = nullptr;
+		int width = 0;
+		int height = 0;
+		int channels = 0;
+
+		// block compressed mip chain, mapped from the cache or freshly encoded. 0 for raw pixels.
+		GLenum format = 0;
+		std::shared_ptr<TextureFile> file;
+		std::vector<unsigned char> encoded;
+
+		int levels();
+		const unsigned char* blocks();
+		~Image();
+	};
+
+	struct PendingLoad {
+		Texture* texture;
+		std::string path;
+		std::shared_ptr<Image> image;
+		std::future<void> decoding;
+		bool decoded = false;
+
+		GLuint target = 0;
+		int uploadedLevel = 0;
+		int uploadedRows = 0;
+	};
+
+	struct StagingSlot {
+		size_t offset;
+		GLsync fence = nullptr;
+	};
+
+	std::list<PendingLoad> pending;
+	std::string error;
+
+	GLuint stagingBuffer = 0;
+	unsigned char* staging = nullptr;
+	std::vector<StagingSlot> slots;
+	size_t nextSlot = 0;
+	int s3tc = -1;
+
+	GLenum compressedFormat(int, TextureKind);
+	bool allocateStaging();
+	bool uploadBand(PendingLoad&);
+	void finishLoad(PendingLoad&);
+};
@@ -0,0 +1,100 @@
+#include "thread_pool.h"
+#include <algorithm>
+#include <chrono>
+
+// the pool whose worker is running on this thread, if any.
+static thread_local ThreadPool* workerOf = nullptr;
+
+ThreadPool::ThreadPool(int threads) {
+	if (threads <= 0) threads = std::max(1, (int)std::thread::hardware_concurrency() - 1);
+
+	for (int i = 0; i < threads; i++) {
+		workers.emplace_back([this] { work(); });
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::unique_lock<std::mutex> lock(tasksMutex);
+		stopping = true;
+	}
+
+	tasksChanged.notify_all();
+	for (auto& worker : workers) worker.join();
+}
+
+std::future<void> ThreadPool::Submit(std::function<void()> task) {
+	std::packaged_task<void()> packaged(task);
+	auto future = packaged.get_future();
+
+	{
+		std::unique_lock<std::mutex> lock(tasksMutex);
+		tasks.push(std::move(packaged));
+	}
+
+	tasksChanged.notify_one();
+	return future;
+}
+
+// Runs body(0..count-1) across the workers and the calling thread, returning once all are done. A worker
+// that calls this runs queued tasks while it waits, so its chunks cannot sit behind workers that are all
+// waiting too. Other threads just wait, the UI thread should not end up running an HDRI decode.
+void ThreadPool::ParallelFor(int count, std::function<void(int)> body) {
+	std::vector<std::future<void>> pending;
+	for (int i = 1; i < count; i++) {
+		pending.push_back(Submit([=] { body(i); }));
+	}
+
+	if (count > 0) body(0);
+	for (auto& p : pending) {
+		// an empty queue means the chunk is already running somewhere and will finish.
+		while (workerOf == this && p.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+			if (!runQueued()) break;
+		}
+		p.get();
+	}
+}
+
+int ThreadPool::GetThreadCount() {
+	return (int)workers.size();
+}
+
+ThreadPool* ThreadPool::Instance() {
+	static ThreadPool pool;
+	return &pool;
+}
+
+void ThreadPool::work() {
+	workerOf = this;
+
+	while (true) {
+		std::packaged_task<void()> task;
+
+		{
+			std::unique_lock<std::mutex> lock(tasksMutex);
+			tasksChanged.wait(lock, [this] { return stopping || !tasks.empty(); });
+			if (stopping && tasks.empty()) return;
+
+			task = std::move(tasks.front());
+			tasks.pop();
+		}
+
+		task();
+	}
+}
+
+// Takes one task off the queue and runs it on the calling thread, false when there was none.
+bool ThreadPool::runQueued() {
+	std::packaged_task<void()> task;
+
+	{
+		std::unique_lock<std::mutex> lock(tasksMutex);
+		if (tasks.empty()) return false;
+
+		task = std::move(tasks.front());
+		tasks.pop();
+	}
+
+	task();
+	return true;
+}
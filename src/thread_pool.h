@@ -0,0 +1,33 @@
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+
+#pragma once
+
+// Fixed set of worker threads shared by the CPU side work (denoising, image encoding, decoding).
+class ThreadPool {
+public:
+	ThreadPool(int threads = 0);
+	~ThreadPool();
+
+	std::future<void> Submit(std::function<void()>);
+	void ParallelFor(int, std::function<void(int)>);
+
+	int GetThreadCount();
+
+	static ThreadPool* Instance();
+private:
+	std::vector<std::thread> workers;
+	std::queue<std::packaged_task<void()>> tasks;
+
+	std::mutex tasksMutex;
+	std::condition_variable tasksChanged;
+	bool stopping = false;
+
+	void work();
+	bool runQueued();
+};
@@ -0,0 +1,170 @@
+#include "tile_renderer.h"
+#include <cache_file.h>
+#include <algorithm>
+#include <cstdio>
+#include <stdexcept>
+
+TileRenderer::TileRenderer() {
+	for (int i = 0; i < 4; i++) targets[i] = new Texture();
+	glGenFramebuffers(1, &fbo);
+}
+
+TileRenderer::~TileRenderer() {
+	glDeleteFramebuffers(1, &fbo);
+}
+
+// Rows are streamed to a temporary file that only takes the destination's name once the last tile is in,
+// so a cancelled or failed poster leaves any earlier image at p alone.
+void TileRenderer::Start(std::string p, int w, int h, std::vector<std::string> names, ExrCompression compression) {
+	temporary = TemporaryPath(p);
+
+	try {
+		output.reset(ImageOutput::Create(temporary, w, h, names, compression));
+	} catch (std::exception ex) {
+		std::remove(temporary.c_str());
+		status = ex.what();
+		Failed = true;
+		return;
+	}
+
+	Reserve();
+
+	path = p;
+	width = w;
+	height = h;
+	channels = (int)names.size();
+	tileX = 0;
+	tileY = 0;
+	samples = 0;
+	strip.assign((size_t)width * channels * allocatedSize, 0.0f);
+	status = "Rendering " + path;
+	Failed = false;
+}
+
+void TileRenderer::Cancel() {
+	if (!output) return;
+
+	try {
+		output->Close();
+		status = "Cancelled " + path;
+	} catch (std::exception ex) {
+		status = ex.what();
+	}
+
+	release();
+	std::remove(temporary.c_str());
+}
+
+// Allocates the targets at TileSize, they are reused by anything rendering regions while no poster is active.
+void TileRenderer::Reserve() {
+	if (allocatedSize != TileSize) allocate();
+}
+
+bool TileRenderer::IsActive() {
+	return output != nullptr;
+}
+
+bool TileRenderer::ShouldReset() {
+	return samples == 0;
+}
+
+// Counts a finished pass, true once the current tile has all of its samples.
+bool TileRenderer::FinishPass() {
+	samples++;
+	return samples >= SamplesPerTile;
+}
+
+// read(planes, rowWidth, column) copies the finished tile into the strip, top row first.
+void TileRenderer::FinishTile(std::function<void(float *, int, int)> read) {
+	read(strip.data(), width, tileX * allocatedSize);
+
+	samples = 0;
+	if (++tileX < columns()) return;
+
+	try {
+		output->WriteRows(strip.data(), stripHeight());
+		tileX = 0;
+
+		if (++tileY < rows()) return;
+
+		output->Close();
+		if (!RenameOver(temporary, path)) throw std::runtime_error(("Unable to replace " + path).c_str());
+		status = "Saved " + path;
+	} catch (std::exception ex) {
+		status = ex.what();
+		Failed = true;
+	}
+
+	release();
+	if (Failed) std::remove(temporary.c_str());
+}
+
+// offsets are in GL pixels, counted from the bottom left of the full image.
+glm::vec2 TileRenderer::GetTileOffset() {
+	int top = tileY * allocatedSize;
+	return glm::vec2(tileX * allocatedSize, height - top - stripHeight());
+}
+
+glm::vec2 TileRenderer::GetTileSize() {
+	return glm::vec2(std::min(allocatedSize, width - tileX * allocatedSize), stripHeight());
+}
+
+glm::vec2 TileRenderer::GetFullResolution() {
+	return glm::vec2(width, height);
+}
+
+Texture* TileRenderer::GetTarget(int index) {
+	return targets[index];
+}
+
+GLuint TileRenderer::GetFramebuffer() {
+	return fbo;
+}
+
+float TileRenderer::GetProgress() {
+	if (!output) return 0.0f;
+
+	float tiles = (float)(columns() * rows());
+	float done = tileY * columns() + tileX + (float)samples / SamplesPerTile;
+	return done / tiles;
+}
+
+std::string TileRenderer::GetStatus() {
+	return status;
+}
+
+int TileRenderer::columns() {
+	return (width + allocatedSize - 1) / allocatedSize;
+}
+
+int TileRenderer::rows() {
+	return (height + allocatedSize - 1) / allocatedSize;
+}
+
+int TileRenderer::stripHeight() {
+	return std::min(allocatedSize, height - tileY * allocatedSize);
+}
+
+void TileRenderer::allocate() {
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+
+	GLenum attachments[4];
+	for (int i = 0; i < 4; i++) {
+		targets[i]->DeleteTexture();
+		targets[i]->Allocate2D(TileSize, TileSize, false);
+
+		attachments[i] = GL_COLOR_ATTACHMENT0 + i;
+		glFramebufferTexture2D(GL_FRAMEBUFFER, attachments[i], GL_TEXTURE_2D, targets[i]->TextureId, 0);
+	}
+
+	glDrawBuffers(4, attachments);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	allocatedSize = TileSize;
+}
+
+void TileRenderer::release() {
+	output.reset();
+	strip.clear();
+	strip.shrink_to_fit();
+}
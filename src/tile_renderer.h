@@ -0,0 +1,65 @@
+#include <texture.h>
+#include <image_output.h>
+#include <glm/glm.hpp>
+#include <memory>
+#include <functional>
+
+#pragma once
+
+// Renders images larger than any framebuffer as a grid of tiles, each one accumulated to its own
+// sample count in a single tile sized target. Tiles go from the top row down, and every finished
+// row of tiles is streamed to the output file, so the host only keeps one strip of the image.
+class TileRenderer {
+public:
+	TileRenderer();
+	~TileRenderer();
+
+	void Start(std::string, int, int, std::vector<std::string>, ExrCompression);
+	void Cancel();
+	void Reserve();
+
+	bool IsActive();
+	bool ShouldReset();
+	bool FinishPass();
+	void FinishTile(std::function<void(float *, int, int)>);
+
+	glm::vec2 GetTileOffset();
+	glm::vec2 GetTileSize();
+	glm::vec2 GetFullResolution();
+	Texture* GetTarget(int);
+	GLuint GetFramebuffer();
+
+	float GetProgress();
+	std::string GetStatus();
+
+	// the tile size is fixed when a render starts.
+	int TileSize = 512;
+	int SamplesPerTile = 256;
+	float FocusDistance = -1.0f;
+
+	// set when the last render could not be written.
+	bool Failed = false;
+private:
+	Texture* targets[4];
+	GLuint fbo;
+	int allocatedSize = 0;
+
+	std::unique_ptr<ImageOutput> output;
+	std::string path;
+	std::string temporary;
+	std::string status;
+	std::vector<float> strip;
+
+	int width = 0;
+	int height = 0;
+	int channels = 0;
+	int tileX = 0;
+	int tileY = 0;
+	int samples = 0;
+
+	int columns();
+	int rows();
+	int stripHeight();
+	void allocate();
+	void release();
+};
@@ -0,0 +1,90 @@
+#include "animation-ui.h"
+#include <imgui.h>
+#include <cmath>
+#include <algorithm>
+
+AnimationUI::AnimationUI(Project* p, ProjectUI* u) :
+	Sequence(p), project(p), projectUI(u)
+{
+}
+
+// Advances the timeline while playing, called once per frame before rendering.
+void AnimationUI::Update() {
+	double now = glfwGetTime();
+	double delta = now - lastUpdate;
+	lastUpdate = now;
+
+	if (!playing || Sequence.IsActive()) return;
+
+	auto animation = project->ProjectAnimation;
+	seek(std::fmod(animation->Time + (float)delta, std::max(animation->Duration, 0.01f)));
+}
+
+void AnimationUI::Render() {
+	auto animation = project->ProjectAnimation;
+	auto scene = project->ProjectScene;
+
+	ImGui::Begin("Animation");
+
+	if (ImGui::SliderFloat("Time", &animation->Time, 0.0f, animation->Duration)) seek(animation->Time);
+	ImGui::SameLine();
+	ImGui::Checkbox("Play", &playing);
+
+	ImGui::InputFloat("Duration", &animation->Duration);
+	ImGui::InputInt("Frame Rate", &animation->FrameRate);
+	animation->Duration = std::max(animation->Duration, 0.01f);
+	animation->FrameRate = std::max(animation->FrameRate, 1);
+
+	if (ImGui::Button("Key Camera")) animation->KeyCamera(animation->Time, project->ProjectCamera);
+	ImGui::SameLine();
+	if (ImGui::Button("Key Uniforms")) {
+		for (auto& uniform : *scene->GetUniforms()) animation->KeyUniform(animation->Time, uniform);
+	}
+	ImGui::SameLine();
+	if (ImGui::Button("Remove Keys")) animation->RemoveKeys(animation->Time);
+
+	ImGui::Text((std::to_string(animation->CameraKeys.size()) + " camera keys, "
+		+ std::to_string(animation->UniformCurves.size()) + " animated uniforms").c_str());
+
+	ImGui::Separator();
+
+	if (Sequence.IsActive()) {
+		ImGui::ProgressBar(Sequence.GetProgress());
+		if (ImGui::Button("Cancel Sequence")) Sequence.Cancel();
+	} else {
+		if (frameRange[1] <= 0) frameRange[1] = animation->GetFrameCount() - 1;
+
+		ImGui::InputText("Frames Path", sequencePath, sizeof(sequencePath));
+		ImGui::InputInt2("Frame Range", frameRange);
+		ImGui::InputInt("Samples Per Frame", &Sequence.SamplesPerFrame);
+		ImGui::InputFloat("Seconds Per Frame", &Sequence.SecondsPerFrame);
+		Sequence.SamplesPerFrame = std::max(Sequence.SamplesPerFrame, 1);
+		Sequence.SecondsPerFrame = std::max(Sequence.SecondsPerFrame, 0.0f);
+
+		if (ImGui::Button("Render Sequence")) {
+			playing = false;
+			Sequence.Start(sequencePath, std::max(frameRange[0], 0), frameRange[1]);
+			projectUI->Offline = true;
+		}
+	}
+
+	if (!Sequence.GetStatus().empty()) {
+		ImGui::Text(Sequence.GetStatus().c_str());
+	}
+
+	ImGui::End();
+}
+
+bool AnimationUI::IsPlaying() {
+	return playing;
+}
+
+void AnimationUI::seek(float time) {
+	auto animation = project->ProjectAnimation;
+	auto scene = project->ProjectScene;
+
+	animation->Time = time;
+	animation->Apply(time, project->ProjectCamera, scene->GetUniforms());
+	scene->SceneTime = time;
+	scene->ResetAccumulation();
+}
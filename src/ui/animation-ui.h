@@ -0,0 +1,27 @@
+#include <project.h>
+#include <sequence_renderer.h>
+#include <ui/project-ui.h>
+
+#pragma once
+
+class AnimationUI {
+public:
+	AnimationUI(Project* p, ProjectUI* u);
+
+	void Update();
+	void Render();
+	bool IsPlaying();
+
+	SequenceRenderer Sequence;
+
+private:
+	Project* project;
+	ProjectUI* projectUI;
+
+	bool playing = false;
+	double lastUpdate = 0.0;
+	char sequencePath[256] = "frames/frame_####.png";
+	int frameRange[2] = { 0, 0 };
+
+	void seek(float);
+};
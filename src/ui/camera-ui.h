@@ -3,6 +3,6 @@
 
 class CameraUI {
 public:
-	Camera* Camera;
+	::Camera* Camera;
 	void Render();
 };
\ No newline at end of file
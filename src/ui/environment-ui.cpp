@@ -2,7 +2,8 @@
 #include <imgui.h>
 #include <ImGuiFileDialog.h>
 #include <thread>
-#include <glm\gtc\type_ptr.hpp>
+#include <algorithm>
+#include <glm/gtc/type_ptr.hpp>
 
 void EnvironmentUI::Render() {
 	ImGui::Begin("Environment");
@@ -27,13 +28,36 @@ void EnvironmentUI::Render() {
 		igfd::ImGuiFileDialog::Instance()->CloseDialog("ChooseFileDlgKey2");
 	}
 
+	// new width or prefilter settings reload the HDRI, the current maps render until the new ones are
+	// made. A load already under way reads them when its hash is in.
+	bool settingsChanged = ImGui::InputInt("HDRI width", &Environment->HdriWidth, 1024);
+
+	const char* sizes[] = { "128", "256", "512", "1024" };
+	Environment->ClampSettings();
+	int sizeIndex = 0;
+	while ((128 << sizeIndex) < Environment->PrefilterSize) sizeIndex++;
+	if (ImGui::Combo("Prefilter size", &sizeIndex, sizes, 4)) {
+		Environment->PrefilterSize = 128 << sizeIndex;
+		settingsChanged = true;
+	}
+
+	settingsChanged |= ImGui::InputInt("Prefilter samples", &Environment->PrefilterSamples, 16);
+
+	if (settingsChanged && !Environment->IsLoading() && !Environment->HdriPath.empty()) {
+		Environment->SetHDRI(Environment->HdriPath);
+	}
+
+	if (Environment->IsLoading()) {
+		ImGui::ProgressBar(Environment->GetLoadProgress(), ImVec2(200, 0), "Loading HDRI");
+	}
+
+	if (!Environment->GetError().empty()) {
+		ImGui::TextColored(ImVec4(1, 0, 0, 1), "%s", Environment->GetError().c_str());
+	}
+
 	if (!Environment->HdriPath.empty()) {
 		ImGui::Image((void*)(intptr_t)Environment->HdriTexture->TextureId, ImVec2(200, 100));
 
-		if (ImGui::Button("Create IRR and PC maps")) {
-			Environment->PreRender();
-		}
-		ImGui::SameLine();
 		if (ImGui::Button("Remove")) {
 			Environment->SetHDRI("");
 		}
@@ -41,6 +65,10 @@ void EnvironmentUI::Render() {
 
 		ImGui::SliderFloat("Env Exposure", &Environment->LightPathExposure, 1.0f, 100.0f);
 		ImGui::Checkbox("Use Irradiance for Background", &Environment->UseIrradianceForBackground);
+		// a loading HDRI picks the setting up itself, PreRender would finish it on the spot.
+		if (ImGui::Checkbox("Spherical Harmonics Irradiance", &Environment->UseSphericalHarmonics) && !Environment->IsLoading()) {
+			Environment->PreRender();
+		}
 	}
 
 	ImGui::Text("Lights");
@@ -5,7 +5,7 @@ class EnvironmentUI {
 public:
 	void Render();
 
-	Environment* Environment;
+	::Environment* Environment;
 private:
 	std::string filePath;
 
@@ -1,6 +1,8 @@
 #include "project-ui.h"
 #include <imgui.cpp>
 #include <ImGuiFileDialog.h>
+#include <algorithm>
+#include <cmath>
 
 ProjectUI::ProjectUI(Project* p, SceneUI* s, EnvironmentUI* e, CameraUI* c) :
 	project(p), sceneUI(s), environmentUI(e), cameraUI(c)
@@ -57,7 +59,7 @@ void ProjectUI::Render() {
 	ImGui::Checkbox("Path Trace", &Offline);
 	ImGui::SameLine();
 	if (ImGui::Button("Save Render")) {
-		igfd::ImGuiFileDialog::Instance()->OpenModal("ChooseFileDlgKey6", "Open Files", ".png", "");
+		igfd::ImGuiFileDialog::Instance()->OpenModal("ChooseFileDlgKey6", "Open Files", ".png,.exr,.pfm,.hdr", "");
 	}
 
 	if (igfd::ImGuiFileDialog::Instance()->FileDialog("ChooseFileDlgKey6", ImGuiWindowFlags_NoCollapse, ImVec2(800, 400), ImVec2(800, 400))) {
@@ -67,8 +69,137 @@ void ProjectUI::Render() {
 
 		igfd::ImGuiFileDialog::Instance()->CloseDialog("ChooseFileDlgKey6");
 	}
+
+	ImGui::Checkbox("Export AOVs", &project->ProjectScene->ExportAovs);
+	ImGui::SameLine();
+	bool rle = project->ProjectScene->ExportCompression == ExrCompression::Rle;
+	if (ImGui::Checkbox("EXR RLE", &rle)) {
+		project->ProjectScene->ExportCompression = rle ? ExrCompression::Rle : ExrCompression::None;
+	}
+
+	if (!project->ProjectScene->GetSaveStatus().empty()) {
+		ImGui::Text(project->ProjectScene->GetSaveStatus().c_str());
+	}
+
+	auto poster = project->ProjectScene->Poster;
+	if (poster->IsActive()) {
+		ImGui::ProgressBar(poster->GetProgress());
+		if (ImGui::Button("Cancel Poster")) poster->Cancel();
+	} else {
+		ImGui::InputInt2("Poster Size", posterSize);
+		ImGui::InputInt("Tile Size", &poster->TileSize);
+		ImGui::InputInt("Samples Per Tile", &poster->SamplesPerTile);
+		poster->TileSize = std::max(poster->TileSize, 16);
+		poster->SamplesPerTile = std::max(poster->SamplesPerTile, 1);
+
+		if (ImGui::Button("Render Poster")) {
+			igfd::ImGuiFileDialog::Instance()->OpenModal("ChooseFileDlgKey7", "Open Files", ".exr,.pfm,.hdr", "");
+		}
+	}
+
+	if (igfd::ImGuiFileDialog::Instance()->FileDialog("ChooseFileDlgKey7", ImGuiWindowFlags_NoCollapse, ImVec2(800, 400), ImVec2(800, 400))) {
+		if (igfd::ImGuiFileDialog::Instance()->IsOk) {
+			project->ProjectScene->StartPoster(igfd::ImGuiFileDialog::Instance()->GetFilePathName(), std::max(posterSize[0], 1), std::max(posterSize[1], 1));
+			Offline = true;
+		}
+
+		igfd::ImGuiFileDialog::Instance()->CloseDialog("ChooseFileDlgKey7");
+	}
+
+	if (!poster->GetStatus().empty()) {
+		ImGui::Text(poster->GetStatus().c_str());
+	}
 	if (Offline) {
 		ImGui::Text((std::to_string(project->ProjectScene->OfflineRenderAmounts) + std::string(" number of samples")).c_str());
+
+		if (!project->SavePath.empty()) {
+			ImGui::InputFloat("Checkpoint Seconds", &project->CheckpointInterval);
+			project->CheckpointInterval = std::max(project->CheckpointInterval, 0.0f);
+			ImGui::SameLine();
+			if (ImGui::Button("Checkpoint Now")) project->WriteCheckpoint();
+
+			if (!project->ProjectScene->GetCheckpointStatus().empty()) {
+				ImGui::Text(project->ProjectScene->GetCheckpointStatus().c_str());
+			}
+		}
+
+		int output = (int)project->ProjectScene->DisplayOutput;
+		if (ImGui::Combo("Output", &output, "Beauty\0Albedo\0Normal\0Depth\0Material Id\0")) {
+			project->ProjectScene->DisplayOutput = (RenderOutput)output;
+		}
+
+		int backend = (int)project->ProjectScene->Backend;
+		if (ImGui::Combo("Backend", &backend, "Megakernel\0Wavefront\0")) {
+			project->ProjectScene->Backend = (RenderBackend)backend;
+			project->ProjectScene->OfflineRenderAmounts = 0;
+		}
+
+		ImGui::SameLine();
+		if (ImGui::Button("Benchmark")) {
+			megakernelTime = project->ProjectScene->Benchmark(RenderBackend::Megakernel, 16);
+			wavefrontTime = project->ProjectScene->Benchmark(RenderBackend::Wavefront, 16);
+		}
+
+		// NaN when a backend could not run.
+		if (megakernelTime > 0.0f) {
+			ImGui::Text((std::string("Megakernel ") + std::to_string(megakernelTime) + " ms/pass, wavefront "
+				+ (std::isnan(wavefrontTime) ? std::string("unavailable") : std::to_string(wavefrontTime) + " ms/pass")).c_str());
+		}
+
+		if (project->ProjectScene->Backend == RenderBackend::Wavefront) {
+			ImGui::Text((std::string("Wavefront buffers ") + std::to_string(project->ProjectScene->GetWavefrontMemoryUsage() / (1024 * 1024)) + " MB").c_str());
+		}
+
+		auto scene = project->ProjectScene;
+		if (ImGui::Checkbox("Interactive (1 spp + temporal filter)", &scene->Temporal->Enabled)) {
+			scene->Temporal->Reset();
+		}
+
+		if (scene->Temporal->Enabled) {
+			ImGui::SliderInt("A-Trous Iterations", &scene->Temporal->Iterations, 1, 6);
+			ImGui::SliderFloat("Temporal Alpha", &scene->Temporal->MinAlpha, 0.05f, 1.0f);
+			ImGui::SliderFloat("Luminance Phi", &scene->Temporal->ColorPhi, 0.5f, 16.0f);
+			ImGui::SliderFloat("Depth Phi", &scene->Temporal->DepthPhi, 0.1f, 8.0f);
+		}
+
+		if (ImGui::Button("Denoise")) {
+			scene->DenoiseRender();
+			scene->ShowDenoisedPreview = true;
+		}
+		ImGui::SameLine();
+		ImGui::Checkbox("Side by Side", &scene->ShowDenoisedPreview);
+		ImGui::SameLine();
+		ImGui::Checkbox("Denoise on Save", &scene->Denoising->Enabled);
+
+		if (scene->ShowDenoisedPreview || scene->Denoising->Enabled) {
+			ImGui::SliderInt("Filter Iterations", &scene->Denoising->Iterations, 1, 8);
+			ImGui::SliderFloat("Color Sigma", &scene->Denoising->ColorSigma, 0.05f, 4.0f);
+			ImGui::SliderFloat("Normal Power", &scene->Denoising->NormalPower, 1.0f, 256.0f);
+			ImGui::SliderFloat("Albedo Sigma", &scene->Denoising->AlbedoSigma, 0.01f, 1.0f);
+		}
+
+		if (scene->GetDenoisedSamples() >= 0) {
+			ImGui::Text((std::string("Denoised at ") + std::to_string(scene->GetDenoisedSamples()) + " samples in "
+				+ std::to_string((int)scene->Denoising->LastDuration) + " ms").c_str());
+		}
+
+		// the wavefront kernels do not record guide vertices, so guiding only applies to the megakernel.
+		auto guide = project->ProjectScene->Guide;
+		ImGui::Checkbox("Path Guiding", &guide->Enabled);
+		if (guide->Enabled && project->ProjectScene->Backend == RenderBackend::Megakernel) {
+			ImGui::SliderFloat("Guide Fraction", &guide->GuideFraction, 0.1f, 0.9f);
+			ImGui::Text((std::string("Guide iteration ") + std::to_string(guide->Iteration)
+				+ ", cache " + std::to_string(guide->GetMemoryUsage() / (1024 * 1024)) + " MB").c_str());
+		}
+
+		auto caustics = project->ProjectScene->Caustics;
+		ImGui::Checkbox("Caustic Photons", &caustics->Enabled);
+		if (caustics->Enabled) {
+			ImGui::SliderFloat("Initial Radius", &caustics->InitialRadius, 0.01f, 0.5f);
+			ImGui::InputFloat3("Caustic Center", &caustics->Center.x);
+			ImGui::SliderFloat("Caustic Extent", &caustics->Extent, 0.5f, 20.0f);
+			ImGui::Text((std::string("Gather radius ") + std::to_string(caustics->GetRadius())).c_str());
+		}
 	}
 	ImGui::End();
 }
\ No newline at end of file
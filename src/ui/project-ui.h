@@ -1,7 +1,9 @@
 #include <project.h>
-#include <ui\scene-ui.h>
-#include <ui\environment-ui.h>
-#include <ui\camera-ui.h>
+#include <ui/scene-ui.h>
+#include <ui/environment-ui.h>
+#include <ui/camera-ui.h>
+
+#pragma once
 
 class ProjectUI {
 public:
@@ -16,4 +18,8 @@ private:
 	SceneUI* sceneUI;
 	EnvironmentUI* environmentUI;
 	CameraUI* cameraUI;
+
+	float megakernelTime = 0.0f;
+	float wavefrontTime = 0.0f;
+	int posterSize[2] = { 7680, 4320 };
 };
\ No newline at end of file
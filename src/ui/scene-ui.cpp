@@ -7,6 +7,8 @@
 #include <ImGuiFileDialog.h>
 #include <istream>
 #include <fstream>
+#include <texture_loader.h>
+#include <texture_cache.h>
 #include <algorithm>
 
 SceneUI::SceneUI() {
@@ -160,8 +162,35 @@ void SceneUI::renderMaterials() {
 	
 	static char newMaterialName[25] = "";
 	if (ImGui::CollapsingHeader("Materials")) {
-		int i = 0;
-		for (auto material : *Scene->GetMaterials()) {
+		auto loader = TextureLoader::Instance();
+		if (loader->IsBusy()) {
+			ImGui::Text("Loading %d textures", loader->GetPendingCount());
+		}
+		if (!loader->GetError().empty()) {
+			ImGui::Text("%s", loader->GetError().c_str());
+		}
+
+		auto cache = TextureCache::Instance();
+		ImGui::Text("%d textures, %.1f MB resident (%.1f MB unused)", cache->GetResidentCount(),
+			cache->GetResidentBytes() / 1048576.0f, cache->GetUnusedBytes() / 1048576.0f);
+
+		int budget = (int)(cache->Budget >> 20);
+		if (ImGui::InputInt("Budget (MB)##textures", &budget, 64, 256)) {
+			cache->Budget = (size_t)std::max(budget, 0) << 20;
+			cache->Trim();
+		}
+
+		ImGui::Checkbox("Compress textures", &loader->Compress);
+
+		int layerSize = Scene->MaterialMaps->LayerSize;
+		if (ImGui::InputInt("Layer size##textures", &layerSize, 256, 1024)) {
+			Scene->MaterialMaps->LayerSize = glm::clamp(layerSize, 64, 4096);
+			Scene->ResetAccumulation();
+		}
+
+		auto materials = Scene->GetMaterials();
+		for (size_t i = 0; i < materials->size(); i++) {
+			auto material = (*materials)[i];
 			if (ImGui::TreeNode(material.name.c_str())) {
 				
 				if (material.albedo->TextureId > 0) {
@@ -186,19 +215,16 @@ void SceneUI::renderMaterials() {
 
 				if (material.ambientOcclusion->TextureId > 0) {
 					ImGui::Image((void*)(intptr_t)material.ambientOcclusion->TextureId, ImVec2(50, 50));
-					ImGui::SameLine();
-				}
-
-				if (material.height->TextureId > 0) {
-					ImGui::Image((void*)(intptr_t)material.height->TextureId, ImVec2(50, 50));
 				}
 
 				ImGui::TreePop();
 				ImGui::SameLine();
+				// by index, materials sharing maps compare equal.
 				if (ImGui::Button(std::string("Delete##" + std::to_string(i)).c_str(), ImVec2(100, 50))) {
-					Scene->GetMaterials()->erase(std::remove(Scene->GetMaterials()->begin(), Scene->GetMaterials()->end(), material));
+					materials->erase(materials->begin() + i);
+					Scene::ReleaseMaterialTextures(material);
+					break;
 				}
-				i++;
 			}
 		}
 		ImGui::InputText("Name##material", newMaterialName, 25);
@@ -216,13 +242,6 @@ void SceneUI::renderMaterials() {
 
 			SceneMaterial material;
 			material.name = std::string(newMaterialName);
-			material.albedo = new Texture();
-			material.roughness = new Texture();
-			material.metal = new Texture();
-			material.normal = new Texture();
-			material.ambientOcclusion = new Texture();
-			material.height = new Texture();
-
 			const auto isType = [](std::string name, std::string type) {
 				std::string lowerName = name;
 				std::transform(lowerName.begin(), lowerName.end(), lowerName.begin(), ::tolower);
@@ -230,27 +249,15 @@ void SceneUI::renderMaterials() {
 			};
 
 			for (auto const& file : files) {
-				if (isType(file.first, "_albedo")) {
-					material.albedo->LoadFromFile2D(file.second);
-					material.albedoPath = file.second;
-				} else if (isType(file.first, "_rough")) {
-					material.roughness->LoadFromFile2D(file.second);
-					material.roughnessPath = file.second;
-				}  else if (isType(file.first, "_metal")) {
-					material.metal->LoadFromFile2D(file.second);
-					material.metalPath = file.second;
-				} else if (isType(file.first, "_normal")) {
-					material.normal->LoadFromFile2D(file.second);
-					material.normalPath = file.second;
-				} else if (isType(file.first, "_ao")) {
-					material.ambientOcclusion->LoadFromFile2D(file.second);
-					material.ambientOcclusionPath = file.second;
-				} else if (isType(file.first, "_height")) {
-					material.height->LoadFromFile2D(file.second);
-					material.heightPath = file.second;
-				}
+				if (isType(file.first, "_albedo")) material.albedoPath = file.second;
+				else if (isType(file.first, "_rough")) material.roughnessPath = file.second;
+				else if (isType(file.first, "_metal")) material.metalPath = file.second;
+				else if (isType(file.first, "_normal")) material.normalPath = file.second;
+				else if (isType(file.first, "_ao")) material.ambientOcclusionPath = file.second;
+				else if (isType(file.first, "_height")) material.heightPath = file.second;
 			}
 
+			Scene::LoadMaterialTextures(material);
 			Scene->GetMaterials()->push_back(material);
 			newMaterialName[0] = '\0';
 		}
@@ -10,7 +10,7 @@ class SceneUI {
 public:
 	SceneUI();
 
-	Scene* Scene;
+	::Scene* Scene;
 	void Render(bool);
 	void HandleInput(GLFWwindow*);
 	void UpdateText();
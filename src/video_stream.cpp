@@ -0,0 +1,208 @@
+#include "video_stream.h"
+#include <thread_pool.h>
+#include <algorithm>
+#include <csignal>
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#endif
+
+VideoStream::~VideoStream() {
+	Close();
+}
+
+// Starts a stream of width x height frames at frameRate to target, throws when it cannot be opened.
+void VideoStream::Open(std::string path, int w, int h, int frameRate) {
+	target = path;
+	width = w;
+	height = h;
+
+	auto dot = path.find_last_of('.');
+	std::string extension = dot == std::string::npos ? "" : path.substr(dot);
+	std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+	format = extension == ".ppm" ? StreamFormat::Ppm : StreamFormat::Y4m;
+
+#ifndef _WIN32
+	// a reader that goes away should fail the stream, not end the process.
+	signal(SIGPIPE, SIG_IGN);
+#endif
+
+	if (path == "-") {
+#ifdef _WIN32
+		_setmode(_fileno(stdout), _O_BINARY);
+#endif
+		file = stdout;
+		ownsFile = false;
+	} else {
+		// opening a named pipe waits here until something reads from it.
+		file = fopen(path.c_str(), "wb");
+		ownsFile = true;
+	}
+
+	if (file == nullptr) throw std::runtime_error(("Unable to open " + path + " for streaming").c_str());
+
+	if (format == StreamFormat::Y4m) {
+		// the planes are full range, readers assume limited range unless told.
+		fprintf(file, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg XCOLORRANGE=FULL\n", width, height, frameRate);
+	}
+
+	closing = false;
+	failed = false;
+	written = 0;
+	status = "Streaming to " + (path == "-" ? std::string("stdout") : path);
+	writer = std::thread(&VideoStream::write, this);
+}
+
+// Queues an RGBA frame with its rows bottom first, as GL reads them. The frame is moved from.
+void VideoStream::Push(std::vector<unsigned char>& rgba) {
+	std::unique_lock<std::mutex> lock(framesMutex);
+	framesChanged.wait(lock, [this]() { return frames.size() < Capacity || failed || closing; });
+	if (failed || closing) return;
+
+	frames.push_back(std::move(rgba));
+	framesChanged.notify_all();
+}
+
+// Writes out whatever is queued and closes the target.
+void VideoStream::Close() {
+	if (!writer.joinable()) return;
+
+	{
+		std::lock_guard<std::mutex> lock(framesMutex);
+		closing = true;
+	}
+
+	framesChanged.notify_all();
+	writer.join();
+
+	if (ownsFile) fclose(file);
+	else fflush(file);
+	file = nullptr;
+
+	if (!failed) status = "Streamed " + std::to_string(written) + " frames to " + (target == "-" ? std::string("stdout") : target);
+}
+
+bool VideoStream::HasFailed() {
+	std::lock_guard<std::mutex> lock(framesMutex);
+	return failed;
+}
+
+std::string VideoStream::GetStatus() {
+	std::lock_guard<std::mutex> lock(framesMutex);
+	return status;
+}
+
+// "-", .y4m and .ppm targets are streamed rather than written as numbered images.
+bool VideoStream::IsStream(std::string const& path) {
+	auto dot = path.find_last_of('.');
+	std::string extension = dot == std::string::npos ? "" : path.substr(dot);
+	std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+
+	return path == "-" || extension == ".y4m" || extension == ".ppm";
+}
+
+void VideoStream::write() {
+	std::vector<unsigned char> converted;
+
+	while (true) {
+		std::vector<unsigned char> frame;
+		{
+			std::unique_lock<std::mutex> lock(framesMutex);
+			framesChanged.wait(lock, [this]() { return !frames.empty() || closing; });
+			if (frames.empty()) return;
+
+			frame = std::move(frames.front());
+			frames.pop_front();
+		}
+
+		framesChanged.notify_all();
+		writeFrame(frame, converted);
+		bool broken = fflush(file) != 0 || ferror(file);
+
+		std::lock_guard<std::mutex> lock(framesMutex);
+		if (broken) {
+			failed = true;
+			status = "The stream to " + target + " was closed by its reader";
+			frames.clear();
+			framesChanged.notify_all();
+			return;
+		}
+
+		written++;
+	}
+}
+
+void VideoStream::writeFrame(std::vector<unsigned char> const& rgba, std::vector<unsigned char>& converted) {
+	if (format == StreamFormat::Y4m) {
+		toYuv(rgba, converted);
+		fputs("FRAME\n", file);
+		fwrite(converted.data(), 1, converted.size(), file);
+		return;
+	}
+
+	// PPM rows go top first and carry no alpha.
+	converted.resize((size_t)width * height * 3);
+	for (int y = 0; y < height; y++) {
+		const unsigned char* source = rgba.data() + (size_t)(height - 1 - y) * width * 4;
+		unsigned char* row = converted.data() + (size_t)y * width * 3;
+		for (int x = 0; x < width; x++) {
+			row[x * 3] = source[x * 4];
+			row[x * 3 + 1] = source[x * 4 + 1];
+			row[x * 3 + 2] = source[x * 4 + 2];
+		}
+	}
+
+	fprintf(file, "P6\n%d %d\n255\n", width, height);
+	fwrite(converted.data(), 1, converted.size(), file);
+}
+
+// Full range BT.601 planes, each chroma sample averages a 2x2 block. Bands of row pairs are
+// converted in parallel.
+void VideoStream::toYuv(std::vector<unsigned char> const& rgba, std::vector<unsigned char>& yuv) {
+	int chromaWidth = (width + 1) / 2, chromaHeight = (height + 1) / 2;
+	size_t lumaSize = (size_t)width * height, chromaSize = (size_t)chromaWidth * chromaHeight;
+	yuv.resize(lumaSize + chromaSize * 2);
+
+	unsigned char* luma = yuv.data();
+	unsigned char* cb = luma + lumaSize;
+	unsigned char* cr = cb + chromaSize;
+
+	auto clamp = [](float v) { return (unsigned char)std::min(std::max(v + 0.5f, 0.0f), 255.0f); };
+
+	int bands = ThreadPool::Instance()->GetThreadCount() + 1;
+	int pairsPerBand = (chromaHeight + bands - 1) / bands;
+
+	ThreadPool::Instance()->ParallelFor(bands, [&](int band) {
+		int end = std::min((band + 1) * pairsPerBand, chromaHeight);
+		for (int cy = band * pairsPerBand; cy < end; cy++) {
+			for (int cx = 0; cx < chromaWidth; cx++) {
+				float sumCb = 0.0f, sumCr = 0.0f;
+				int count = 0;
+
+				for (int dy = 0; dy < 2; dy++) {
+					int y = cy * 2 + dy;
+					if (y >= height) continue;
+
+					for (int dx = 0; dx < 2; dx++) {
+						int x = cx * 2 + dx;
+						if (x >= width) continue;
+
+						// GL rows start at the bottom.
+						const unsigned char* p = rgba.data() + ((size_t)(height - 1 - y) * width + x) * 4;
+						float r = p[0], g = p[1], b = p[2];
+
+						luma[(size_t)y * width + x] = clamp(0.299f * r + 0.587f * g + 0.114f * b);
+						sumCb += 128.0f - 0.168736f * r - 0.331264f * g + 0.5f * b;
+						sumCr += 128.0f + 0.5f * r - 0.418688f * g - 0.081312f * b;
+						count++;
+					}
+				}
+
+				cb[(size_t)cy * chromaWidth + cx] = clamp(sumCb / count);
+				cr[(size_t)cy * chromaWidth + cx] = clamp(sumCr / count);
+			}
+		}
+	});
+}
@@ -0,0 +1,54 @@
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdio>
+
+#pragma once
+
+enum class StreamFormat {
+	Y4m = 0,
+	Ppm
+};
+
+// Writes raw frames one after another to stdout ("-"), a file or a named pipe, for external encoders
+// and players to read as they arrive. .ppm targets get a stream of binary PPM images, anything else
+// YUV4MPEG2 4:2:0 converted on the thread pool. A writer thread drains a short queue, and Push blocks
+// while it is full, so a slow reader holds rendering back rather than frames piling up in memory.
+class VideoStream {
+public:
+	~VideoStream();
+
+	void Open(std::string, int, int, int);
+	void Push(std::vector<unsigned char>&);
+	void Close();
+
+	bool HasFailed();
+	std::string GetStatus();
+
+	static bool IsStream(std::string const&);
+
+	size_t Capacity = 2;
+private:
+	FILE* file = nullptr;
+	bool ownsFile = false;
+	StreamFormat format = StreamFormat::Y4m;
+	std::string target;
+	int width = 0;
+	int height = 0;
+
+	std::thread writer;
+	std::deque<std::vector<unsigned char>> frames;
+	std::mutex framesMutex;
+	std::condition_variable framesChanged;
+	bool closing = false;
+	bool failed = false;
+	int written = 0;
+	std::string status;
+
+	void write();
+	void writeFrame(std::vector<unsigned char> const&, std::vector<unsigned char>&);
+	void toYuv(std::vector<unsigned char> const&, std::vector<unsigned char>&);
+};
@@ -0,0 +1,182 @@
+#include "wavefront.h"
+#include <algorithm>
+
+// byte sizes of the std430 structs and offsets into WavefrontCounters, see shaders/wavefront/common.glsl
+#define PATH_STATE_SIZE 64
+#define SHADOW_RAY_SIZE 80
+#define PATH_AOV_SIZE 32
+#define COUNTERS_SIZE 192
+#define DISPATCH_RAYS_OFFSET 144
+#define DISPATCH_HITS_OFFSET 160
+#define DISPATCH_SHADOWS_OFFSET 176
+
+#define WAVEFRONT_GROUP 64
+#define PATH_LENGTH 9
+
+#define BEGIN_BOUNCE 0
+#define PARTITION 1
+#define SHADOWS 2
+#define NEXT_BOUNCE 3
+
+WavefrontRenderer::WavefrontRenderer() {
+	raygenProgram = new Program();
+	extendProgram = new Program();
+	partitionProgram = new Program();
+	shadeProgram = new Program();
+	shadowProgram = new Program();
+	finalizeProgram = new Program();
+	controlProgram = new Program();
+
+	glGenBuffers(1, &pathBuffer);
+	glGenBuffers(1, &counterBuffer);
+	glGenBuffers(2, rayQueues);
+	glGenBuffers(1, &hitBuffer);
+	glGenBuffers(1, &sortedQueue);
+	glGenBuffers(1, &shadowQueue);
+	glGenBuffers(1, &aovBuffer);
+}
+
+WavefrontRenderer::~WavefrontRenderer() {
+	glDeleteBuffers(1, &pathBuffer);
+	glDeleteBuffers(1, &counterBuffer);
+	glDeleteBuffers(2, rayQueues);
+	glDeleteBuffers(1, &hitBuffer);
+	glDeleteBuffers(1, &sortedQueue);
+	glDeleteBuffers(1, &shadowQueue);
+	glDeleteBuffers(1, &aovBuffer);
+}
+
+void WavefrontRenderer::Link(std::function<std::string(std::string)> kernelSource) {
+	std::pair<Program*, std::string> kernels[] = {
+		{ raygenProgram, "raygen" },
+		{ extendProgram, "extend" },
+		{ partitionProgram, "partition" },
+		{ shadeProgram, "shade" },
+		{ shadowProgram, "shadow" },
+		{ finalizeProgram, "finalize" },
+		{ controlProgram, "control" }
+	};
+
+	for (auto& kernel : kernels) {
+		kernel.first->Reload()
+			.Attach(kernelSource(kernel.second), GL_COMPUTE_SHADER)
+			.Link();
+	}
+}
+
+void WavefrontRenderer::Render(std::vector<Texture *> const& targets, glm::vec2 resolution, bool reset, std::function<void(Program *)> bindScene) {
+	if (allocatedCapacity != PathCapacity) allocate();
+
+	Program* scenePrograms[] = { raygenProgram, extendProgram, partitionProgram, shadeProgram, shadowProgram, finalizeProgram };
+	for (auto program : scenePrograms) {
+		program->Activate()
+			.Bind("pathCapacity", allocatedCapacity)
+			.Bind("shouldReset", reset ? 1 : 0);
+		bindScene(program);
+	}
+
+	for (int i = 0; i < targets.size(); i++) {
+		glBindImageTexture(i, targets[i]->TextureId, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+	}
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, pathBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, counterBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, hitBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 8, sortedQueue);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 9, shadowQueue);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 10, aovBuffer);
+	glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, counterBuffer);
+
+	int pixels = (int)resolution.x * (int)resolution.y;
+	GLuint chunkGroups = (allocatedCapacity + WAVEFRONT_GROUP - 1) / WAVEFRONT_GROUP;
+
+	// the focus plane goes into the first pixel in a dispatch of its own, every path of the frame reads it.
+	raygenProgram->Activate().Bind("focusPass", 1);
+	glDispatchCompute(1, 1, 1);
+	barrier();
+	raygenProgram->Bind("focusPass", 0);
+
+	for (int chunkStart = 0; chunkStart < pixels; chunkStart += allocatedCapacity) {
+		GLuint zero = 0;
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, counterBuffer);
+		glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+		int current = 0;
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, rayQueues[current]);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, rayQueues[1 - current]);
+
+		raygenProgram->Activate().Bind("chunkStart", chunkStart);
+		glDispatchCompute(chunkGroups, 1, 1);
+		barrier();
+		control(BEGIN_BOUNCE);
+
+		for (int bounce = 0; bounce < PATH_LENGTH; bounce++) {
+			extendProgram->Activate().Bind("chunkStart", chunkStart);
+			glDispatchComputeIndirect(DISPATCH_RAYS_OFFSET);
+			barrier();
+			control(PARTITION);
+
+			partitionProgram->Activate().Bind("chunkStart", chunkStart);
+			glDispatchComputeIndirect(DISPATCH_RAYS_OFFSET);
+			barrier();
+
+			shadeProgram->Activate().Bind("chunkStart", chunkStart);
+			glDispatchComputeIndirect(DISPATCH_HITS_OFFSET);
+			barrier();
+			control(SHADOWS);
+
+			shadowProgram->Activate().Bind("chunkStart", chunkStart);
+			glDispatchComputeIndirect(DISPATCH_SHADOWS_OFFSET);
+			barrier();
+
+			// the queue shading just filled becomes the one the next extension reads.
+			current = 1 - current;
+			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, rayQueues[current]);
+			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, rayQueues[1 - current]);
+			control(NEXT_BOUNCE);
+		}
+
+		finalizeProgram->Activate().Bind("chunkStart", chunkStart);
+		glDispatchCompute(chunkGroups, 1, 1);
+		barrier();
+	}
+
+	glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0);
+	glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+}
+
+size_t WavefrontRenderer::GetMemoryUsage() {
+	size_t perPath = PATH_STATE_SIZE + SHADOW_RAY_SIZE + PATH_AOV_SIZE + 2 * sizeof(GLfloat) + 3 * sizeof(GLuint);
+	return (size_t)allocatedCapacity * perPath + COUNTERS_SIZE;
+}
+
+void WavefrontRenderer::allocate() {
+	auto storage = [](GLuint buffer, size_t size) {
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, size, nullptr, GL_DYNAMIC_COPY);
+	};
+
+	size_t capacity = PathCapacity;
+	storage(pathBuffer, capacity * PATH_STATE_SIZE);
+	storage(counterBuffer, COUNTERS_SIZE);
+	storage(rayQueues[0], capacity * sizeof(GLuint));
+	storage(rayQueues[1], capacity * sizeof(GLuint));
+	storage(hitBuffer, capacity * 2 * sizeof(GLfloat));
+	storage(sortedQueue, capacity * sizeof(GLuint));
+	storage(shadowQueue, capacity * SHADOW_RAY_SIZE);
+	storage(aovBuffer, capacity * PATH_AOV_SIZE);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	allocatedCapacity = PathCapacity;
+}
+
+void WavefrontRenderer::control(int mode) {
+	controlProgram->Activate().Bind("mode", mode);
+	glDispatchCompute(1, 1, 1);
+	barrier();
+}
+
+void WavefrontRenderer::barrier() {
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+}
@@ -0,0 +1,38 @@
+#include <program.h>
+#include <texture.h>
+#include <functional>
+#include <vector>
+
+#pragma once
+
+// Compute shader path tracer that splits the offline renderer's megakernel into ray generation,
+// extension, material partition, shading and shadow kernels connected by SSBO queues. Paths are
+// processed in chunks of PathCapacity pixels to keep the queue memory bounded. The targets are the
+// beauty accumulation followed by the albedo, normal and depth/material id outputs.
+class WavefrontRenderer {
+public:
+	WavefrontRenderer();
+	~WavefrontRenderer();
+
+	void Link(std::function<std::string(std::string)>);
+	void Render(std::vector<Texture *> const&, glm::vec2, bool, std::function<void(Program *)>);
+
+	size_t GetMemoryUsage();
+
+	int PathCapacity = 1 << 19;
+private:
+	Program* raygenProgram;
+	Program* extendProgram;
+	Program* partitionProgram;
+	Program* shadeProgram;
+	Program* shadowProgram;
+	Program* finalizeProgram;
+	Program* controlProgram;
+
+	GLuint pathBuffer, counterBuffer, rayQueues[2], hitBuffer, sortedQueue, shadowQueue, aovBuffer;
+	int allocatedCapacity = 0;
+
+	void allocate();
+	void control(int);
+	void barrier();
+};